@@ -26,6 +26,17 @@ namespace CMT {
 			virtual Array<double, 1, Dynamic> logLikelihood(
 				const MatrixXd& input,
 				const MatrixXd& output) const = 0;
+			virtual Array<double, 1, Dynamic> logLikelihood(
+				const MatrixXd& input,
+				const MatrixXd& output,
+				const Preconditioner& preconditioner) const;
+			virtual double logLikelihoodSum(
+				const MatrixXd& input,
+				const MatrixXd& output) const;
+			virtual double logLikelihoodSum(
+				const MatrixXd& input,
+				const MatrixXd& output,
+				const Preconditioner& preconditioner) const;
 			virtual double evaluate(const MatrixXd& input, const MatrixXd& output) const;
 			virtual double evaluate(
 					const MatrixXd& input,
@@ -39,6 +50,16 @@ namespace CMT {
 			virtual pair<pair<ArrayXXd, ArrayXXd>, Array<double, 1, Dynamic> > computeDataGradient(
 				const MatrixXd& input,
 				const MatrixXd& output) const = 0;
+			virtual pair<pair<ArrayXXd, ArrayXXd>, Array<double, 1, Dynamic> > computeDataGradient(
+				const MatrixXd& input,
+				const MatrixXd& output,
+				const Preconditioner& preconditioner) const;
+
+		protected:
+			void checkPreconditioner(
+				const MatrixXd& input,
+				const MatrixXd& output,
+				const Preconditioner& preconditioner) const;
 	};
 }
 
@@ -21,6 +21,7 @@ namespace CMT {
 
 			virtual Array<double, 1, Dynamic> logLikelihood(
 				const MatrixXd& data) const = 0;
+			virtual double logLikelihoodSum(const MatrixXd& data) const;
 			virtual double evaluate(const MatrixXd& data) const;
 	};
 }
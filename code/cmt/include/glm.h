@@ -32,6 +32,7 @@ namespace CMT {
 			};
 
 			using Trainable::logLikelihood;
+			using Trainable::computeDataGradient;
 
 			GLM(
 				int dimIn,
@@ -79,6 +80,12 @@ namespace CMT {
 				const lbfgsfloatval_t* x,
 				lbfgsfloatval_t* g,
 				const Trainable::Parameters& params) const;
+			virtual double parameterGradient(
+				const WindowView& input,
+				const MatrixXd& output,
+				const lbfgsfloatval_t* x,
+				lbfgsfloatval_t* g,
+				const Trainable::Parameters& params) const;
 
 		protected:
 			static Nonlinearity* const defaultNonlinearity;
@@ -114,6 +121,7 @@ inline CMT::Nonlinearity* CMT::GLM::nonlinearity() const {
 
 inline void CMT::GLM::setNonlinearity(Nonlinearity* nonlinearity) {
 	mNonlinearity = nonlinearity;
+	mVersion = nextVersion();
 }
 
 
@@ -126,6 +134,7 @@ inline CMT::UnivariateDistribution* CMT::GLM::distribution() const {
 
 inline void CMT::GLM::setDistribution(UnivariateDistribution* distribution) {
 	mDistribution = distribution;
+	mVersion = nextVersion();
 }
 
 
@@ -138,6 +147,7 @@ inline Eigen::VectorXd CMT::GLM::weights() const {
 
 inline void CMT::GLM::setWeights(const VectorXd& weights) {
 	mWeights = weights;
+	mVersion = nextVersion();
 }
 
 
@@ -150,6 +160,7 @@ inline double CMT::GLM::bias() const {
 
 inline void CMT::GLM::setBias(double bias) {
 	mBias = bias;
+	mVersion = nextVersion();
 }
 
 #endif
@@ -0,0 +1,46 @@
+#ifndef CMT_IMAGECODEC_H
+#define CMT_IMAGECODEC_H
+
+#include <vector>
+#include "Eigen/Core"
+#include "mcgsm.h"
+#include "preconditioner.h"
+#include "tools.h"
+
+namespace CMT {
+	using std::vector;
+
+	using Eigen::ArrayXXi;
+
+	/**
+	 * Losslessly compresses an image of integer pixel values with an arithmetic coder whose
+	 * probabilities are given by the conditional distributions of an MCGSM.
+	 *
+	 * The model, masks and preconditioner are not stored and need to be passed to
+	 * decodeImage again.
+	 *
+	 * @param img image with pixel values between 0 and 2^bitDepth - 1
+	 * @param model model of one pixel given its causal neighborhood
+	 * @param inputMask causal neighborhood of the output pixel
+	 * @param outputMask a single output pixel
+	 * @param preconditioner an optional affine preconditioner used to train the model
+	 * @param bitDepth number of bits per pixel of the raw image
+	 * @return compressed image including a small header
+	 */
+	vector<unsigned char> encodeImage(
+		const ArrayXXi& img,
+		const MCGSM& model,
+		const ArrayXXb& inputMask,
+		const ArrayXXb& outputMask,
+		const Preconditioner* preconditioner = 0,
+		int bitDepth = 8);
+
+	ArrayXXi decodeImage(
+		const vector<unsigned char>& data,
+		const MCGSM& model,
+		const ArrayXXb& inputMask,
+		const ArrayXXb& outputMask,
+		const Preconditioner* preconditioner = 0);
+}
+
+#endif
@@ -0,0 +1,98 @@
+#ifndef CMT_IMAGEDATALOADER_H
+#define CMT_IMAGEDATALOADER_H
+
+#include <vector>
+#include <string>
+#include <utility>
+#include <random>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "Eigen/Core"
+#include "preconditioner.h"
+#include "tools.h"
+
+namespace CMT {
+	using std::vector;
+	using std::string;
+	using std::pair;
+
+	using Eigen::ArrayXXd;
+
+	/**
+	 * Samples batches of random neighborhoods from a collection of images on demand.
+	 *
+	 * Only the images are kept in memory. While one batch is in use, e.g., for training a model,
+	 * the next batch is extracted and preconditioned by a background thread. Locations are drawn
+	 * uniformly and with replacement from all locations of all images.
+	 */
+	class ImageDataLoader {
+		public:
+			ImageDataLoader(
+				const vector<ArrayXXd>& images,
+				const ArrayXXb& inputMask,
+				const ArrayXXb& outputMask,
+				int batchSize = 1000,
+				const Preconditioner* preconditioner = 0);
+			~ImageDataLoader();
+
+			inline int dimIn() const;
+			inline int dimOut() const;
+			inline int batchSize() const;
+			inline long numLocations() const;
+
+			pair<ArrayXXd, ArrayXXd> next();
+
+		private:
+			vector<ArrayXXd> mImages;
+			vector<NeighborhoodPlan> mPlans;
+			vector<long> mLocations;
+			int mMaskRows;
+			int mMaskCols;
+			int mBatchSize;
+			const Preconditioner* mPreconditioner;
+			std::mt19937 mGenerator;
+
+			// state shared with the background thread
+			std::thread mThread;
+			std::mutex mMutex;
+			std::condition_variable mCondition;
+			pair<ArrayXXd, ArrayXXd> mBatch;
+			bool mReady;
+			bool mStop;
+			string mErrorMessage;
+
+			// copying would duplicate the background thread
+			ImageDataLoader(const ImageDataLoader&);
+			ImageDataLoader& operator=(const ImageDataLoader&);
+
+			pair<ArrayXXd, ArrayXXd> sampleBatch();
+			void prefetch();
+	};
+}
+
+
+
+inline int CMT::ImageDataLoader::dimIn() const {
+	return mPreconditioner ? mPreconditioner->dimInPre() : mPlans[0].dimIn();
+}
+
+
+
+inline int CMT::ImageDataLoader::dimOut() const {
+	return mPreconditioner ? mPreconditioner->dimOutPre() : mPlans[0].dimOut();
+}
+
+
+
+inline int CMT::ImageDataLoader::batchSize() const {
+	return mBatchSize;
+}
+
+
+
+inline long CMT::ImageDataLoader::numLocations() const {
+	return mLocations.back();
+}
+
+#endif
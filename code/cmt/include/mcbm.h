@@ -30,6 +30,7 @@ namespace CMT {
 			};
 
 			using Trainable::logLikelihood;
+			using Trainable::computeDataGradient;
 			using Trainable::train;
 
 			MCBM(
@@ -74,6 +75,11 @@ namespace CMT {
 				const MatrixXd& input,
 				const MatrixXd& output) const;
 
+			virtual bool train(
+				const WindowView& input,
+				const MatrixXd& output,
+				const Trainable::Parameters& params = Parameters());
+
 			virtual int numParameters(
 				const Trainable::Parameters& params = Parameters()) const;
 			virtual lbfgsfloatval_t* parameters(
@@ -149,6 +155,7 @@ inline void CMT::MCBM::setWeights(const MatrixXd& weights) {
 	if(weights.rows() != mNumComponents || weights.cols() != mNumFeatures)
 		throw Exception("Wrong number of weights.");
 	mWeights = weights;
+	mVersion = nextVersion();
 }
 
 
@@ -163,6 +170,7 @@ inline void CMT::MCBM::setPriors(const VectorXd& priors) {
 	if(priors.size() != mNumComponents)
 		throw Exception("Wrong number of prior weights.");
 	mPriors = priors;
+	mVersion = nextVersion();
 }
 
 
@@ -179,6 +187,7 @@ inline void CMT::MCBM::setFeatures(const MatrixXd& features) {
 	if(features.cols() != mNumFeatures)
 		throw Exception("Wrong number of features.");
 	mFeatures = features;
+	mVersion = nextVersion();
 }
 
 
@@ -195,6 +204,7 @@ inline void CMT::MCBM::setPredictors(const MatrixXd& predictors) {
 	if(predictors.rows() != mNumComponents)
 		throw Exception("Wrong number of predictors.");
 	mPredictors = predictors;
+	mVersion = nextVersion();
 }
 
 
@@ -211,6 +221,7 @@ inline void CMT::MCBM::setInputBias(const MatrixXd& inputBias) {
 	if(inputBias.cols() != mNumComponents)
 		throw Exception("Wrong number of bias vectors.");
 	mInputBias = inputBias;
+	mVersion = nextVersion();
 }
 
 
@@ -225,6 +236,7 @@ inline void CMT::MCBM::setOutputBias(const VectorXd& outputBias) {
 	if(outputBias.size() != mNumComponents)
 		throw Exception("Wrong number of biases.");
 	mOutputBias = outputBias;
+	mVersion = nextVersion();
 }
 
 #endif
@@ -17,6 +17,8 @@ namespace CMT {
 	using Eigen::ArrayXXd;
 	using Eigen::MatrixXd;
 
+	class AffinePreconditioner;
+
 	class MCGSM : public Trainable {
 		public:
 			struct Parameters : public Trainable::Parameters {
@@ -35,13 +37,42 @@ namespace CMT {
 					Regularizer regularizeLinearFeatures;
 					Regularizer regularizeMeans;
 					Regularizer regularizer;
+					double pruneThreshold;
+					int pruneIter;
+					bool splitComponents;
 
 					Parameters();
 					Parameters(const Parameters& params);
 					virtual Parameters& operator=(const Parameters& params);
 			};
 
+			struct Intermediates {
+				public:
+					// model and version of parameters used to compute intermediates
+					const MCGSM* mcgsm;
+					unsigned long version;
+
+					MatrixXd featuresOutput;
+					vector<MatrixXd> predErrors;
+
+					// unnormalized log-posteriors over scales with and without outputs
+					vector<ArrayXXd> logJointIn;
+					vector<ArrayXXd> logJointOut;
+
+					// normalization constants
+					ArrayXXd logNormInScales;
+					ArrayXXd logNormOutScales;
+					Array<double, 1, Dynamic> logNormIn;
+					Array<double, 1, Dynamic> logNormOut;
+
+					Intermediates(
+						const MCGSM& mcgsm,
+						const MatrixXd& input,
+						const MatrixXd& output);
+			};
+
 			using Trainable::logLikelihood;
+			using Trainable::computeDataGradient;
 			using Trainable::initialize;
 			using Trainable::train;
 
@@ -53,6 +84,7 @@ namespace CMT {
 				int numFeatures = -1);
 			MCGSM(int dimIn, const MCGSM& mcgsm);
 			MCGSM(int dimIn, int dimOut, const MCGSM& mcgsm);
+			MCGSM(const MCGSM& mcgsm, const AffinePreconditioner& preconditioner);
 			virtual ~MCGSM();
 
 			inline int dimIn() const;
@@ -87,6 +119,14 @@ namespace CMT {
 
 			virtual void initialize(const MatrixXd& input, const MatrixXd& output);
 
+			virtual bool train(
+				const WindowView& input,
+				const MatrixXd& output,
+				const Trainable::Parameters& params = Parameters());
+
+			virtual int pruneComponents(double threshold);
+			virtual void splitComponent(int i);
+
 			virtual MatrixXd sample(const MatrixXd& input) const;
 			virtual MatrixXd sample(
 				const MatrixXd& input,
@@ -98,7 +138,9 @@ namespace CMT {
 				const MatrixXd& output) const;
 
 			virtual ArrayXXd prior(const MatrixXd& input) const;
+			virtual ArrayXXd prior(const Intermediates& intermediates) const;
 			virtual ArrayXXd posterior(const MatrixXd& input, const MatrixXd& output) const;
+			virtual ArrayXXd posterior(const Intermediates& intermediates) const;
 
 			virtual Array<double, 1, Dynamic> logLikelihood(
 				const MatrixXd& input,
@@ -107,10 +149,14 @@ namespace CMT {
 				const MatrixXd& input,
 				const MatrixXd& output,
 				const Array<int, 1, Dynamic>& labels) const;
+			virtual Array<double, 1, Dynamic> logLikelihood(
+				const Intermediates& intermediates) const;
 
 			virtual pair<pair<ArrayXXd, ArrayXXd>, Array<double, 1, Dynamic> > computeDataGradient(
 				const MatrixXd& input,
 				const MatrixXd& output) const;
+			virtual pair<pair<ArrayXXd, ArrayXXd>, Array<double, 1, Dynamic> > computeDataGradient(
+				const Intermediates& intermediates) const;
 
 			virtual int numParameters(const Trainable::Parameters& params = Parameters()) const;
 			virtual lbfgsfloatval_t* parameters(const Trainable::Parameters& params = Parameters()) const;
@@ -140,12 +186,29 @@ namespace CMT {
 			MatrixXd mLinearFeatures;
 			MatrixXd mMeans;
 
+			MatrixXd featureEnergies(const MatrixXd& input) const;
+			void checkIntermediates(const Intermediates& intermediates) const;
+
+			template <class Input>
+			bool trainPruned(
+				const Input& input,
+				const MatrixXd& output,
+				const MatrixXd* inputVal,
+				const MatrixXd* outputVal,
+				const Parameters& params);
+
 			virtual bool train(
 				const MatrixXd& input,
 				const MatrixXd& output,
 				const MatrixXd* inputVal = 0,
 				const MatrixXd* outputVal = 0,
 				const Trainable::Parameters& params = Trainable::Parameters());
+			bool train(
+				const WindowView& input,
+				const MatrixXd& output,
+				const MatrixXd* inputVal,
+				const MatrixXd* outputVal,
+				const Trainable::Parameters& params);
 	};
 }
 
@@ -191,6 +254,7 @@ inline void CMT::MCGSM::setScales(const ArrayXXd& scales) {
 	if(scales.rows() != mNumComponents || scales.cols() != mNumScales)
 		throw Exception("Wrong number of scales.");
 	mScales = scales;
+	mVersion = nextVersion();
 }
 
 
@@ -207,6 +271,7 @@ inline void CMT::MCGSM::setWeights(const ArrayXXd& weights) {
 	if(weights.rows() != mNumComponents || weights.cols() != mNumFeatures)
 		throw Exception("Wrong number of weights.");
 	mWeights = weights;
+	mVersion = nextVersion();
 }
 
 
@@ -221,6 +286,7 @@ inline void CMT::MCGSM::setPriors(const ArrayXXd& priors) {
 	if(priors.rows() != mNumComponents || priors.cols() != mNumScales)
 		throw Exception("Wrong number of prior weights.");
 	mPriors = priors;
+	mVersion = nextVersion();
 }
 
 
@@ -239,6 +305,7 @@ inline void CMT::MCGSM::setFeatures(const MatrixXd& features) {
 	if(features.cols() != mNumFeatures)
 		throw Exception("Wrong number of features.");
 	mFeatures = features;
+	mVersion = nextVersion();
 }
 
 
@@ -268,6 +335,8 @@ inline void CMT::MCGSM::setCholeskyFactors(const vector<MatrixXd>& choleskyFacto
 		mScales.row(i) += 2. * log(prec);
 		mWeights.row(i) /= prec;
 	}
+
+	mVersion = nextVersion();
 }
 
 
@@ -290,6 +359,7 @@ inline void CMT::MCGSM::setPredictors(const vector<MatrixXd>& predictors) {
 			throw Exception("Predictor has wrong dimensionality.");
 
 	mPredictors = predictors;
+	mVersion = nextVersion();
 }
 
 
@@ -304,6 +374,7 @@ inline void CMT::MCGSM::setLinearFeatures(const MatrixXd& linearFeatures) {
 	if(linearFeatures.rows() != mNumComponents || linearFeatures.cols() != mDimIn)
 		throw Exception("Linear features have wrong dimensionality.");
 	mLinearFeatures = linearFeatures;
+	mVersion = nextVersion();
 }
 
 
@@ -318,6 +389,7 @@ inline void CMT::MCGSM::setMeans(const MatrixXd& means) {
 	if(means.cols() != mNumComponents || means.rows() != mDimOut)
 		throw Exception("Means have wrong dimensionality.");
 	mMeans = means;
+	mVersion = nextVersion();
 }
 
 #endif
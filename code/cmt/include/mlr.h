@@ -30,6 +30,7 @@ namespace CMT {
 			};
 
 			using Trainable::logLikelihood;
+			using Trainable::computeDataGradient;
 
 			MLR(int dimIn, int dimOut);
 			virtual ~MLR();
@@ -111,6 +112,7 @@ inline void CMT::MLR::setWeights(const MatrixXd& weights) {
 	if(weights.rows() != mDimOut || weights.cols() != mDimIn)
 		throw Exception("Weight matrix has wrong dimensionality.");
 	mWeights = weights;
+	mVersion = nextVersion();
 }
 
 
@@ -125,6 +127,7 @@ inline void CMT::MLR::setBiases(const VectorXd& biases) {
 	if(biases.size() != mDimOut)
 		throw Exception("Wrong number of biases.");
 	mBiases = biases;
+	mVersion = nextVersion();
 }
 
 #endif
@@ -2,6 +2,9 @@
 #define CMT_PATCHMODEL_H
 
 #include <vector>
+#include <map>
+#include <string>
+#include <utility>
 #include <algorithm>
 #include <iostream>
 #include <cmath>
@@ -16,14 +19,20 @@
 
 namespace CMT {
 	using std::vector;
+	using std::map;
+	using std::string;
+	using std::pair;
+	using std::make_pair;
 
 	using std::find;
 	using std::distance;
+	using std::sort;
 
 	using std::cout;
 	using std::endl;
 
 	using std::min;
+	using std::max;
 	using std::ceil;
 
 	using Eigen::ArrayXXd;
@@ -146,9 +155,32 @@ namespace CMT {
 			vector<Tuples> mInputIndices;
 			vector<CD> mConditionalDistributions;
 			vector<PC*> mPreconditioners;
+			vector<vector<int> > mInputRows;
+			vector<int> mOutputRows;
+			vector<int> mSharedModels;
+			vector<vector<int> > mSamplingLevels;
 
 			int findIndex(int i, int j) const;
-			bool indicesMatch(int i, int j) const;
+			Tuples neighborhood(int i) const;
+			void computeGatherPlans();
+			MatrixXd gatherInput(int i, const MatrixXd& data, int col, int numCols) const;
+			void gatherInput(
+				int i,
+				const MatrixXd& data,
+				int col,
+				int numCols,
+				MatrixXd& input,
+				int offset) const;
+
+			bool trainModels(
+				const MatrixXd& data,
+				const MatrixXd* dataVal,
+				const Trainable::Parameters& params);
+			bool trainModel(
+				int i,
+				const MatrixXd& data,
+				const MatrixXd* dataVal,
+				const Trainable::Parameters& params);
 	};
 }
 
@@ -207,7 +239,10 @@ CMT::PatchModel<CD, PC>::PatchModel(
 				mConditionalDistributions.push_back(CD(dimIn));
 
 			mPreconditioners.push_back(0);
+			mSharedModels.push_back(-1);
 		}
+
+	computeGatherPlans();
 }
 
 
@@ -283,7 +318,10 @@ CMT::PatchModel<CD, PC>::PatchModel(
 				mConditionalDistributions.push_back(CD(dimIn));
 
 			mPreconditioners.push_back(0);
+			mSharedModels.push_back(-1);
 		}
+
+	computeGatherPlans();
 }
 
 
@@ -369,7 +407,10 @@ CMT::PatchModel<CD, PC>::PatchModel(
 			mConditionalDistributions.push_back(CD(dimIn));
 
 		mPreconditioners.push_back(0);
+		mSharedModels.push_back(-1);
 	}
+
+	computeGatherPlans();
 }
 
 
@@ -428,7 +469,10 @@ CMT::PatchModel<CD, PC>::PatchModel(
 			mConditionalDistributions.push_back(CD(dimIn));
 
 		mPreconditioners.push_back(0);
+		mSharedModels.push_back(-1);
 	}
+
+	computeGatherPlans();
 }
 
 
@@ -525,6 +569,7 @@ template <class CD, class PC>
 CD& CMT::PatchModel<CD, PC>::operator()(int i, int j) {
 	if(i < 0 || j < 0 || j >= mCols || i >= mRows)
 		throw Exception("Invalid indices.");
+
 	return mConditionalDistributions[findIndex(i, j)];
 }
 
@@ -586,6 +631,7 @@ void CMT::PatchModel<CD, PC>::setPreconditioner(int i, int j, const PC& precondi
 
 	PC* preconditionerOld = mPreconditioners[k];
 	mPreconditioners[k] = new PC(preconditioner);
+	mSharedModels[k] = -1;
 	
 	if(preconditionerOld)
 		delete preconditionerOld;
@@ -596,23 +642,10 @@ void CMT::PatchModel<CD, PC>::setPreconditioner(int i, int j, const PC& precondi
 template <class CD, class PC>
 void CMT::PatchModel<CD, PC>::initialize(const MatrixXd& data, const Trainable::Parameters& params) {
 	for(int i = 0; i < mRows * mCols; ++i) {
-		int m = mOutputIndices[i].first;
-		int n = mOutputIndices[i].second;
+		mSharedModels[i] = -1;
 
-		// assumes patch is stored in row-major order
-		MatrixXd output = data.row(m * mCols + n);
-		MatrixXd input(mInputIndices[i].size(), data.cols());
-
-		// subselect input from patches
-		#pragma omp parallel for
-		for(int j = 0; j < mInputIndices[i].size(); ++j) {
-			// coordinates of j-th input to i-th model
-			int m = mInputIndices[i][j].first;
-			int n = mInputIndices[i][j].second;
-
-			// assumes patch is stored in row-major order
-			input.row(j) = data.row(m * mCols + n);
-		}
+		MatrixXd output = data.row(mOutputRows[i]);
+		MatrixXd input = gatherInput(i, data, 0, data.cols());
 
 		// initialize model
 		if(mMaxPCs >= 0) {
@@ -631,188 +664,178 @@ void CMT::PatchModel<CD, PC>::initialize(const MatrixXd& data, const Trainable::
 
 template <class CD, class PC>
 bool CMT::PatchModel<CD, PC>::train(const MatrixXd& data, const Trainable::Parameters& params) {
-	bool converged = true;
-
-	for(int i = 0; i < mRows * mCols; ++i) {
-		// coordinates of i-th output pixels
-		int m = mOutputIndices[i].first;
-		int n = mOutputIndices[i].second;
-
-		// assumes patch is stored in row-major order
-		MatrixXd output = data.row(m * mCols + n);
-		MatrixXd input(mInputIndices[i].size(), data.cols());
+	return trainModels(data, 0, params);
+}
 
-		// check if an equivalent model has already been trained
-		if(params.stationary) {
-			bool copied = false;
-			for(int j = i - 1; j >= 0; --j)
-				if(indicesMatch(i, j)) {
-					if(params.verbosity > 0)
-						cout << "Copying model " << i / mCols << ", " << i % mCols << endl;
-
-					// copy model
-					mConditionalDistributions[i] = mConditionalDistributions[j];
-
-					// copy preconditioner
-					if(mMaxPCs >= 0)
-						mPreconditioners[i] = mPreconditioners[j];
-					copied = true;
-					break;
-				}
-			if(copied)
-				// don't train
-				continue;
-		}
 
-		// extract inputs and outputs from patches
-		#pragma omp parallel for
-		for(int j = 0; j < mInputIndices[i].size(); ++j) {
-			// coordinates of j-th input to i-th model
-			int m = mInputIndices[i][j].first;
-			int n = mInputIndices[i][j].second;
 
-			// assumes patch is stored in row-major order
-			input.row(j) = data.row(m * mCols + n);
-		}
+template <class CD, class PC>
+bool CMT::PatchModel<CD, PC>::train(
+	const MatrixXd& data,
+	const MatrixXd& dataVal,
+	const Trainable::Parameters& params)
+{
+	return trainModels(data, &dataVal, params);
+}
 
-		if(params.verbosity > 0)
-			cout << "Training model " << i / mCols << ", " << i % mCols << endl;
 
-		if(mMaxPCs < 0) {
-			converged &= mConditionalDistributions[i].train(input, output, params);
-		} else {
-			if(!mPreconditioners[i])
-				mPreconditioners[i] = new PC(input, output, 0., mMaxPCs);
-			converged &= mConditionalDistributions[i].train(
-				mPreconditioners[i]->operator()(input, output), params);
-		}
-	}
 
-	return converged;
+template <class CD, class PC>
+bool CMT::PatchModel<CD, PC>::train(int i, int j, const MatrixXd& data, const Trainable::Parameters& params) {
+	int k = findIndex(i, j);
+	mSharedModels[k] = -1;
+	return trainModel(k, data, 0, params);
 }
 
 
 
 template <class CD, class PC>
 bool CMT::PatchModel<CD, PC>::train(
+	int i,
+	int j,
 	const MatrixXd& data,
 	const MatrixXd& dataVal,
 	const Trainable::Parameters& params)
 {
-	bool converged = true;
+	int k = findIndex(i, j);
+	mSharedModels[k] = -1;
+	return trainModel(k, data, &dataVal, params);
+}
+
+
+
+/**
+ * Trains all conditional models. Independent models are trained concurrently, starting with the
+ * models with the most inputs. If there are too few models to keep all threads busy, models are
+ * trained one after another so that threads are used by the computations within each model.
+ *
+ * If the model is stationary, only the first model of each distinct causal neighborhood is
+ * trained and copied to all other pixels with the same neighborhood.
+ */
+template <class CD, class PC>
+bool CMT::PatchModel<CD, PC>::trainModels(
+	const MatrixXd& data,
+	const MatrixXd* dataVal,
+	const Trainable::Parameters& params)
+{
+	// index of a model an equivalent model can be copied from
+	vector<int> sources(mRows * mCols, -1);
+
+	// first model trained for each neighborhood
+	map<Tuples, int> neighborhoods;
+
+	// number of inputs and index of each model which needs training
+	vector<pair<int, int> > jobs;
 
 	for(int i = 0; i < mRows * mCols; ++i) {
-		// coordinates of i-th output pixels
-		int m = mOutputIndices[i].first;
-		int n = mOutputIndices[i].second;
+		mSharedModels[i] = -1;
 
-		// assumes patch is stored in row-major order
-		MatrixXd output = data.row(m * mCols + n);
-		MatrixXd input(mInputIndices[i].size(), data.cols());
-		MatrixXd outputVal = dataVal.row(m * mCols + n);
-		MatrixXd inputVal(mInputIndices[i].size(), dataVal.cols());
-
-		// extract inputs and outputs from patches
-		#pragma omp parallel for
-		for(int j = 0; j < mInputIndices[i].size(); ++j) {
-			// coordinates of j-th input to i-th model
-			int m = mInputIndices[i][j].first;
-			int n = mInputIndices[i][j].second;
-
-			// assumes patch is stored in row-major order
-			input.row(j) = data.row(m * mCols + n);
-			inputVal.row(j) = dataVal.row(m * mCols + n);
+		if(params.stationary) {
+			pair<map<Tuples, int>::iterator, bool> result =
+				neighborhoods.insert(make_pair(neighborhood(i), i));
+
+			if(!result.second)
+				sources[i] = result.first->second;
 		}
 
-		if(params.verbosity > 0)
-			cout << "Training model " << i / mCols << ", " << i % mCols << endl;
+		if(sources[i] < 0)
+			jobs.push_back(make_pair(-static_cast<int>(mInputIndices[i].size()), i));
+	}
 
-		if(mMaxPCs < 0) {
-			converged &= mConditionalDistributions[i].train(
-				input, output, inputVal, outputVal, params);
-		} else {
-			if(!mPreconditioners[i])
-				mPreconditioners[i] = new PC(input, output, 0., mMaxPCs);
-			converged &= mConditionalDistributions[i].train(
-				mPreconditioners[i]->operator()(input, output),
-				mPreconditioners[i]->operator()(inputVal, outputVal),
-				params);
+	// longest jobs first
+	sort(jobs.begin(), jobs.end());
+
+	int numThreads = 0;
+
+	#pragma omp parallel reduction(+:numThreads)
+	numThreads += 1;
+
+	// callbacks may call into interpreters which are not thread-safe
+	bool concurrent = !params.callback && jobs.size() > 1 && 2 * jobs.size() >= numThreads;
+	bool converged = true;
+	string errorMessage;
+
+	#pragma omp parallel for schedule(dynamic, 1) if(concurrent) reduction(&&:converged)
+	for(int t = 0; t < jobs.size(); ++t) {
+		// exceptions may not leave parallel regions
+		try {
+			converged = trainModel(jobs[t].second, data, dataVal, params) && converged;
+		} catch(Exception& exception) {
+			#pragma omp critical (patchModelTrain)
+			errorMessage = exception.message();
+			converged = false;
 		}
 	}
 
-	return converged;
-}
+	if(!errorMessage.empty())
+		throw Exception(errorMessage.c_str());
 
+	// copy trained models to equivalent positions
+	for(int i = 0; i < mRows * mCols; ++i) {
+		int j = sources[i];
 
+		if(j < 0)
+			continue;
 
-template <class CD, class PC>
-bool CMT::PatchModel<CD, PC>::train(int i, int j, const MatrixXd& data, const Trainable::Parameters& params) {
-	int k = findIndex(i, j);
+		if(params.verbosity > 0)
+			cout << "Copying model " << i / mCols << ", " << i % mCols << endl;
 
-	MatrixXd output = data.row(i * mCols + j);
-	MatrixXd input(mInputIndices[k].size(), data.cols());
+		mConditionalDistributions[i] = mConditionalDistributions[j];
 
-	// extract inputs and outputs from patches
-	#pragma omp parallel for
-	for(int l = 0; l < mInputIndices[k].size(); ++l) {
-		// coordinates of j-th input to i-th model
-		int m = mInputIndices[k][l].first;
-		int n = mInputIndices[k][l].second;
+		// each model owns its preconditioner
+		if(mMaxPCs >= 0) {
+			if(mPreconditioners[i] && mPreconditioners[i] != mPreconditioners[j])
+				delete mPreconditioners[i];
+			mPreconditioners[i] = new PC(*mPreconditioners[j]);
+		}
 
-		// assumes patch is stored in row-major order
-		input.row(l) = data.row(m * mCols + n);
+		// copies can be evaluated together with the original model
+		mSharedModels[i] = j;
+		mSharedModels[j] = j;
 	}
 
-	if(mMaxPCs < 0) {
-		return mConditionalDistributions[k].train(input, output, params);
-	} else {
-		if(!mPreconditioners[k])
-			mPreconditioners[k] = new PC(input, output, 0., mMaxPCs);
-		return mConditionalDistributions[k].train(
-			mPreconditioners[k]->operator()(input, output), params);
-	}
+	return converged;
 }
 
 
 
 template <class CD, class PC>
-bool CMT::PatchModel<CD, PC>::train(
+bool CMT::PatchModel<CD, PC>::trainModel(
 	int i,
-	int j,
 	const MatrixXd& data,
-	const MatrixXd& dataVal,
+	const MatrixXd* dataVal,
 	const Trainable::Parameters& params)
 {
-	int k = findIndex(i, j);
-
-	// assumes patch is stored in row-major order
-	MatrixXd output = data.row(i * mCols + j);
-	MatrixXd input(mInputIndices[k].size(), data.cols());
-	MatrixXd outputVal = dataVal.row(i * mCols + j);
-	MatrixXd inputVal(mInputIndices[k].size(), dataVal.cols());
-
 	// extract inputs and outputs from patches
-	#pragma omp parallel for
-	for(int l = 0; l < mInputIndices[k].size(); ++l) {
-		// coordinates of j-th input to i-th model
-		int m = mInputIndices[k][l].first;
-		int n = mInputIndices[k][l].second;
-
-		// assumes patch is stored in row-major order
-		input.row(l) = data.row(m * mCols + n);
-		inputVal.row(l) = dataVal.row(m * mCols + n);
+	MatrixXd output = data.row(mOutputRows[i]);
+	MatrixXd input = gatherInput(i, data, 0, data.cols());
+	MatrixXd outputVal;
+	MatrixXd inputVal;
+
+	if(dataVal) {
+		outputVal = dataVal->row(mOutputRows[i]);
+		inputVal = gatherInput(i, *dataVal, 0, dataVal->cols());
 	}
 
+	if(params.verbosity > 0)
+		#pragma omp critical (patchModelOutput)
+		cout << "Training model " << i / mCols << ", " << i % mCols << endl;
+
 	if(mMaxPCs < 0) {
-		return mConditionalDistributions[k].train(
-			input, output, inputVal, outputVal, params);
+		if(dataVal)
+			return mConditionalDistributions[i].train(
+				input, output, inputVal, outputVal, params);
+		return mConditionalDistributions[i].train(input, output, params);
 	} else {
-		if(!mPreconditioners[k])
-			mPreconditioners[k] = new PC(input, output, 0., mMaxPCs);
-		return mConditionalDistributions[k].train(
-			mPreconditioners[k]->operator()(input, output),
-			mPreconditioners[k]->operator()(inputVal, outputVal),
-			params);
+		if(!mPreconditioners[i])
+			mPreconditioners[i] = new PC(input, output, 0., mMaxPCs);
+		if(dataVal)
+			return mConditionalDistributions[i].train(
+				mPreconditioners[i]->operator()(input, output),
+				mPreconditioners[i]->operator()(inputVal, outputVal),
+				params);
+		return mConditionalDistributions[i].train(
+			mPreconditioners[i]->operator()(input, output), params);
 	}
 }
 
@@ -830,37 +853,68 @@ Eigen::Array<double, 1, Eigen::Dynamic> CMT::PatchModel<CD, PC>::logLikelihood(
 			if(!mPreconditioners[i])
 				throw Exception("Model has to be initialized first.");
 
-	Array<double, 1, Dynamic> logLik = Array<double, 1, Dynamic>::Zero(data.cols());
+	int numData = data.cols();
+	int numCols = streamingTileSize(numData);
+	int numTiles = (numData + numCols - 1) / numCols;
+
+	// models with identical parameters are evaluated together in one call
+	vector<vector<int> > batches;
+	map<int, int> batchIndices;
 
-	#pragma omp parallel for
 	for(int i = 0; i < mRows * mCols; ++i) {
-		int m = mOutputIndices[i].first;
-		int n = mOutputIndices[i].second;
+		int j = mSharedModels[i];
 
-		// assumes patch is stored in row-major order
-		MatrixXd output = data.row(m * mCols + n);
-		MatrixXd input(mInputIndices[i].size(), data.cols());
+		// models handed out for writing may have been changed since they were copied
+		if(j < 0 || mConditionalDistributions[i].version() != mConditionalDistributions[j].version()) {
+			batches.push_back(vector<int>(1, i));
+			continue;
+		}
 
-		for(int j = 0; j < mInputIndices[i].size(); ++j) {
-			// coordinates of j-th input to i-th model
-			int m = mInputIndices[i][j].first;
-			int n = mInputIndices[i][j].second;
+		pair<map<int, int>::iterator, bool> result =
+			batchIndices.insert(make_pair(j, batches.size()));
 
-			// assumes patch is stored in row-major order
-			input.row(j) = data.row(m * mCols + n);
-		}
+		if(result.second)
+			batches.push_back(vector<int>());
+		batches[result.first->second].push_back(i);
+	}
 
-		Array<double, 1, Dynamic> logLik_;
+	Array<double, 1, Dynamic> logLik(numData);
 
-		if(mMaxPCs < 0)
-			logLik_ = mConditionalDistributions[i].logLikelihood(input, output);
-		else
-			logLik_ = mConditionalDistributions[i].logLikelihood(
-				mPreconditioners[i]->operator()(input, output)) +
-				mPreconditioners[i]->logJacobian(input, output);
+	// evaluate all models on one tile of patches at a time, so that gathered inputs stay small
+	#pragma omp parallel for if(numTiles > 1)
+	for(int t = 0; t < numTiles; ++t) {
+		int j = t * numCols;
+		int n = min(numCols, numData - j);
+
+		ArrayXXd logLiks(mRows * mCols, n);
+
+		// with only one tile, the work is split between models instead
+		#pragma omp parallel for schedule(dynamic) if(numTiles < 2)
+		for(int b = 0; b < batches.size(); ++b) {
+			const vector<int>& pixels = batches[b];
+			int k = pixels[0];
 
-		#pragma omp critical
-		logLik += logLik_;
+			MatrixXd input(mInputRows[k].size(), pixels.size() * n);
+			MatrixXd output(1, pixels.size() * n);
+
+			for(int l = 0; l < pixels.size(); ++l) {
+				gatherInput(pixels[l], data, j, n, input, l * n);
+				output.middleCols(l * n, n) = data.block(mOutputRows[pixels[l]], j, 1, n);
+			}
+
+			Array<double, 1, Dynamic> logLikBatch;
+
+			if(mMaxPCs < 0)
+				logLikBatch = mConditionalDistributions[k].logLikelihood(input, output);
+			else
+				logLikBatch = mConditionalDistributions[k].logLikelihood(
+					input, output, *mPreconditioners[k]);
+
+			for(int l = 0; l < pixels.size(); ++l)
+				logLiks.row(pixels[l]) = logLikBatch.segment(l * n, n);
+		}
+
+		logLik.segment(j, n) = logLiks.colwise().sum();
 	}
 
 	return logLik;
@@ -877,20 +931,8 @@ Eigen::Array<double, 1, Eigen::Dynamic> CMT::PatchModel<CD, PC>::logLikelihood(
 
 	int k = findIndex(i, j);
 
-	Array<double, 1, Dynamic> logLik = Array<double, 1, Dynamic>::Zero(data.cols());
-
-	// assumes patch is stored in row-major order
-	MatrixXd output = data.row(i * mCols + j);
-	MatrixXd input(mInputIndices[k].size(), data.cols());
-
-	for(int l = 0; l < mInputIndices[k].size(); ++l) {
-		// coordinates of j-th input to i-th model
-		int m = mInputIndices[k][l].first;
-		int n = mInputIndices[k][l].second;
-
-		// assumes patch is stored in row-major order
-		input.row(l) = data.row(m * mCols + n);
-	}
+	MatrixXd output = data.row(mOutputRows[k]);
+	MatrixXd input = gatherInput(k, data, 0, data.cols());
 
 	if(mMaxPCs < 0) {
 		return mConditionalDistributions[k].logLikelihood(input, output);
@@ -898,41 +940,52 @@ Eigen::Array<double, 1, Eigen::Dynamic> CMT::PatchModel<CD, PC>::logLikelihood(
 		if(!mPreconditioners[k])
 			throw Exception("Model has to be initialized first.");
 		return mConditionalDistributions[k].logLikelihood(
-			mPreconditioners[k]->operator()(input, output)) +
-			mPreconditioners[k]->logJacobian(input, output);
+			input, output, *mPreconditioners[k]);
 	}
 }
 
 
 
+/**
+ * Generates patches pixel by pixel. Pixels whose models don't depend on each other are sampled
+ * at the same time, and large numbers of samples are split into tiles which are sampled in
+ * parallel.
+ */
 template<class CD, class PC>
 Eigen::MatrixXd CMT::PatchModel<CD, PC>::sample(int num_samples) const {
+	if(mMaxPCs >= 0)
+		for(int i = 0; i < mRows * mCols; ++i)
+			if(!mPreconditioners[i])
+				throw Exception("Model has to be initialized first.");
+
 	MatrixXd samples = MatrixXd::Zero(mRows * mCols, num_samples);
 
-	for(int i = 0; i < mRows * mCols; ++i) {
-		MatrixXd input(mInputIndices[i].size(), num_samples);
+	int numCols = streamingTileSize(num_samples);
+	int numTiles = (num_samples + numCols - 1) / numCols;
 
-		// construct input from already sampled patch
-		for(int j = 0; j < mInputIndices[i].size(); ++j) {
-			// coordinates of j-th input to i-th model
-			int m = mInputIndices[i][j].first;
-			int n = mInputIndices[i][j].second;
+	for(int l = 0; l < mSamplingLevels.size(); ++l) {
+		const vector<int>& models = mSamplingLevels[l];
 
-			// assumes patch is stored in row-major order
-			input.row(j) = samples.row(m * mCols + n);
-		}
+		// each job samples one pixel for one tile of patches
+		int numJobs = models.size() * numTiles;
 
-		int m = mOutputIndices[i].first;
-		int n = mOutputIndices[i].second;
+		#pragma omp parallel for schedule(dynamic) if(numJobs > 1)
+		for(int t = 0; t < numJobs; ++t) {
+			int i = models[t % models.size()];
+			int j = t / models.size() * numCols;
+			int n = min(numCols, num_samples - j);
 
-		if(mMaxPCs < 0) {
-			samples.row(m * mCols + n) = mConditionalDistributions[i].sample(input);
-		} else {
-			if(!mPreconditioners[i])
-				throw Exception("Model has to be initialized first.");
-			MatrixXd inputPc = mPreconditioners[i]->operator()(input);
-			MatrixXd outputPc = mConditionalDistributions[i].sample(inputPc);
-			samples.row(m * mCols + n) = mPreconditioners[i]->inverse(inputPc, outputPc).second;
+			// construct input from already sampled pixels
+			MatrixXd input = gatherInput(i, samples, j, n);
+
+			if(mMaxPCs < 0) {
+				samples.block(mOutputRows[i], j, 1, n) = mConditionalDistributions[i].sample(input);
+			} else {
+				MatrixXd inputPc = mPreconditioners[i]->operator()(input);
+				MatrixXd outputPc = mConditionalDistributions[i].sample(inputPc);
+				samples.block(mOutputRows[i], j, 1, n) =
+					mPreconditioners[i]->inverse(inputPc, outputPc).second;
+			}
 		}
 	}
 
@@ -954,26 +1007,99 @@ int CMT::PatchModel<CD, PC>::findIndex(int i, int j) const {
 
 
 
+/**
+ * Returns the locations of the inputs of the i-th model relative to its output pixel. Two models
+ * have equivalent inputs if their neighborhoods are equal.
+ */
+template<class CD, class PC>
+CMT::Tuples CMT::PatchModel<CD, PC>::neighborhood(int i) const {
+	Tuples offsets;
+
+	for(Tuples::const_iterator it = mInputIndices[i].begin(); it != mInputIndices[i].end(); ++it)
+		offsets.push_back(make_pair(
+			it->first - mOutputIndices[i].first,
+			it->second - mOutputIndices[i].second));
+
+	return offsets;
+}
+
+
+
+/**
+ * Precomputes for each model the rows of the patch data holding its inputs and output. Models are
+ * also grouped into levels such that each model only depends on the outputs of earlier levels.
+ */
 template<class CD, class PC>
-bool CMT::PatchModel<CD, PC>::indicesMatch(int i, int j) const {
-	// check if indices are shifted versions of each other
-	// assuming that indices are stored in the same order
-	if(mInputIndices[i].size() != mInputIndices[j].size())
-		return false;
-	if(mInputIndices[i].size() == 0)
-		return true;
-
-	int m = mOutputIndices[i].first - mOutputIndices[j].first;
-	int n = mOutputIndices[i].second - mOutputIndices[j].second;
-
-	for(int k = 0; k < mInputIndices[i].size(); ++k) {
-		if(mInputIndices[j][k].first + m != mInputIndices[i][k].first)
-			return false;
-		if(mInputIndices[j][k].second + n != mInputIndices[i][k].second)
-			return false;
+void CMT::PatchModel<CD, PC>::computeGatherPlans() {
+	mInputRows.clear();
+	mOutputRows.clear();
+	mSamplingLevels.clear();
+
+	// level of the model generating each pixel
+	vector<int> levels(mRows * mCols, 0);
+
+	for(int i = 0; i < mOutputIndices.size(); ++i) {
+		vector<int> rows;
+
+		// assumes patch is stored in row-major order
+		for(Tuples::const_iterator it = mInputIndices[i].begin(); it != mInputIndices[i].end(); ++it)
+			rows.push_back(it->first * mCols + it->second);
+
+		mInputRows.push_back(rows);
+		mOutputRows.push_back(mOutputIndices[i].first * mCols + mOutputIndices[i].second);
+
+		// inputs are always generated before the output
+		int level = 0;
+
+		for(int j = 0; j < rows.size(); ++j)
+			level = max(level, levels[rows[j]] + 1);
+
+		levels[mOutputRows[i]] = level;
+
+		if(level >= mSamplingLevels.size())
+			mSamplingLevels.resize(level + 1);
+		mSamplingLevels[level].push_back(i);
 	}
+}
+
+
+
+/**
+ * Extracts the input of the i-th model from a range of columns of the patch data.
+ */
+template<class CD, class PC>
+Eigen::MatrixXd CMT::PatchModel<CD, PC>::gatherInput(
+	int i,
+	const MatrixXd& data,
+	int col,
+	int numCols) const
+{
+	MatrixXd input(mInputRows[i].size(), numCols);
+	gatherInput(i, data, col, numCols, input, 0);
+	return input;
+}
+
+
+
+/**
+ * Writes the input of the i-th model into the columns of a matrix, starting at column offset.
+ */
+template<class CD, class PC>
+void CMT::PatchModel<CD, PC>::gatherInput(
+	int i,
+	const MatrixXd& data,
+	int col,
+	int numCols,
+	MatrixXd& input,
+	int offset) const
+{
+	const vector<int>& rows = mInputRows[i];
 
-	return true;
+	// patches are stored in columns, so that each patch is read from contiguous memory
+	#pragma omp parallel for if(numCols > 4096)
+	for(int n = 0; n < numCols; ++n)
+		for(int k = 0; k < rows.size(); ++k)
+			input(k, offset + n) = data(rows[k], col + n);
 }
 
 #endif
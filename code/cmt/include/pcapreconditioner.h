@@ -2,6 +2,7 @@
 #define CMT_PCAPRECONDITIONER_H
 
 #include "affinepreconditioner.h"
+#include "utils.h"
 
 namespace CMT {
 	class PCAPreconditioner : public AffinePreconditioner {
@@ -11,6 +12,10 @@ namespace CMT {
 				const ArrayXXd& output,
 				double varExplained = 99.,
 				int numPCs = -1);
+			PCAPreconditioner(
+				const Moments& moments,
+				double varExplained = 99.,
+				int numPCs = -1);
 			PCAPreconditioner(
 				const VectorXd& eigenvalues,
 				const VectorXd& meanIn,
@@ -25,6 +30,8 @@ namespace CMT {
 
 		protected:
 			VectorXd mEigenvalues;
+
+			void initialize(const Moments& moments, double varExplained, int numPCs);
 	};
 }
 
@@ -34,6 +34,7 @@ namespace CMT {
 			};
 
 			using Trainable::logLikelihood;
+			using Trainable::computeDataGradient;
 			using Trainable::initialize;
 			using Trainable::train;
 
@@ -120,6 +121,10 @@ namespace CMT {
 				const MatrixXd& inputLinearVal,
 				const MatrixXd& outputVal,
 				const Parameters& params = Parameters());
+			virtual bool train(
+				const WindowView& input,
+				const MatrixXd& output,
+				const Trainable::Parameters& params = Parameters());
 
 			virtual int numParameters(
 				const Trainable::Parameters& params = Parameters()) const;
@@ -134,6 +139,12 @@ namespace CMT {
 				const lbfgsfloatval_t* x,
 				lbfgsfloatval_t* g,
 				const Trainable::Parameters& params = Parameters()) const;
+			virtual double parameterGradient(
+				const WindowView& input,
+				const MatrixXd& output,
+				const lbfgsfloatval_t* x,
+				lbfgsfloatval_t* g,
+				const Trainable::Parameters& params) const;
 
 			virtual pair<pair<ArrayXXd, ArrayXXd>, Array<double, 1, Dynamic> > computeDataGradient(
 				const MatrixXd& input,
@@ -213,6 +224,7 @@ inline double CMT::STM::sharpness() const {
 
 inline void CMT::STM::setSharpness(double sharpness) {
 	mSharpness = sharpness;
+	mVersion = nextVersion();
 }
 
 
@@ -227,6 +239,7 @@ inline void CMT::STM::setWeights(const MatrixXd& weights) {
 	if(weights.rows() != mNumComponents || weights.cols() != mNumFeatures)
 		throw Exception("Wrong number of weights.");
 	mWeights = weights;
+	mVersion = nextVersion();
 }
 
 
@@ -241,6 +254,7 @@ inline void CMT::STM::setBiases(const VectorXd& biases) {
 	if(biases.size() != mNumComponents)
 		throw Exception("Wrong number of biases.");
 	mBiases = biases;
+	mVersion = nextVersion();
 }
 
 
@@ -257,6 +271,7 @@ inline void CMT::STM::setFeatures(const MatrixXd& features) {
 	if(features.cols() != mNumFeatures)
 		throw Exception("Wrong number of features.");
 	mFeatures = features;
+	mVersion = nextVersion();
 }
 
 
@@ -273,6 +288,7 @@ inline void CMT::STM::setPredictors(const MatrixXd& predictors) {
 	if(predictors.rows() != mNumComponents)
 		throw Exception("Wrong number of predictors.");
 	mPredictors = predictors;
+	mVersion = nextVersion();
 }
 
 
@@ -287,6 +303,7 @@ inline void CMT::STM::setLinearPredictor(const VectorXd& linearPredictor) {
 	if(linearPredictor.size() != dimInLinear())
 		throw Exception("Linear predictor has wrong dimensionality.");
 	mLinearPredictor = linearPredictor;
+	mVersion = nextVersion();
 }
 
 
@@ -299,6 +316,7 @@ inline CMT::Nonlinearity* CMT::STM::nonlinearity() const {
 
 inline void CMT::STM::setNonlinearity(Nonlinearity* nonlinearity) {
 	mNonlinearity = nonlinearity;
+	mVersion = nextVersion();
 }
 
 
@@ -311,6 +329,7 @@ inline CMT::UnivariateDistribution* CMT::STM::distribution() const {
 
 inline void CMT::STM::setDistribution(UnivariateDistribution* distribution) {
 	mDistribution = distribution;
+	mVersion = nextVersion();
 }
 
 #endif
@@ -43,6 +43,88 @@ namespace CMT {
 	 */
 	VectorXd extractFromImage(const ArrayXXd& img, const Tuples& indices);
 
+	/**
+	 * Locations of the active pixels of input and output masks, stored as channels and
+	 * linear offsets into the column-major storage of images with a fixed number of rows.
+	 *
+	 * Neighborhoods are gathered directly into preallocated memory, e.g., a column of a
+	 * data matrix, instead of copying image patches first. Pixels are ordered as in
+	 * masksToIndices, with all pixels of one channel preceding those of the next channel.
+	 * Sizes of images are not checked by the gather and scatter methods.
+	 */
+	class NeighborhoodPlan {
+		public:
+			NeighborhoodPlan(
+				const ArrayXXb& inputMask,
+				const ArrayXXb& outputMask,
+				int imageRows,
+				int numChannels = 1);
+			NeighborhoodPlan(
+				const vector<ArrayXXb>& inputMask,
+				const vector<ArrayXXb>& outputMask,
+				int imageRows);
+
+			inline int dimIn() const;
+			inline int dimOut() const;
+
+			inline void gather(
+				const ArrayXXd& img,
+				int i,
+				int j,
+				double* input,
+				double* output) const;
+			inline void gather(
+				const vector<ArrayXXd>& img,
+				int i,
+				int j,
+				double* input,
+				double* output,
+				int frame = 0) const;
+
+			inline void scatter(
+				ArrayXXd& img,
+				int i,
+				int j,
+				const double* output) const;
+			inline void scatter(
+				vector<ArrayXXd>& img,
+				int i,
+				int j,
+				const double* output,
+				int frame = 0) const;
+
+			inline void accumulate(
+				ArrayXXd& img,
+				int i,
+				int j,
+				const double* input,
+				const double* output) const;
+			inline void accumulate(
+				vector<ArrayXXd>& img,
+				int i,
+				int j,
+				const double* input,
+				const double* output) const;
+
+		private:
+			int mImageRows;
+			vector<int> mInputChannels;
+			vector<int> mInputOffsets;
+			vector<int> mOutputChannels;
+			vector<int> mOutputOffsets;
+
+			void addChannel(int channel, const pair<Tuples, Tuples>& indices);
+	};
+
+	vector<Tuples> wavefronts(
+		const vector<Tuples>& inputIndices,
+		int iMin,
+		int jMin,
+		int h,
+		int w,
+		int numBlockRows,
+		int numBlockCols);
+
 	pair<ArrayXXd, ArrayXXd> generateDataFromImage(
 		const ArrayXXd& img,
 		const ArrayXXb& inputMask,
@@ -94,6 +176,19 @@ namespace CMT {
 		const vector<ArrayXXb>& outputMask,
 		const Preconditioner* preconditioner = 0);
 
+	double evaluateImage(
+		const ArrayXXd& img,
+		const ConditionalDistribution& model,
+		const ArrayXXb& inputMask,
+		const ArrayXXb& outputMask,
+		const Preconditioner* preconditioner = 0);
+	double evaluateImage(
+		const vector<ArrayXXd>& img,
+		const ConditionalDistribution& model,
+		const vector<ArrayXXb>& inputMask,
+		const vector<ArrayXXb>& outputMask,
+		const Preconditioner* preconditioner = 0);
+
 	ArrayXXd sampleImage(
 		ArrayXXd img,
 		const ConditionalDistribution& model,
@@ -102,6 +197,14 @@ namespace CMT {
 		const Preconditioner* preconditioner = 0,
 		double minValue = -numeric_limits<double>::infinity(),
 		double maxValue = numeric_limits<double>::infinity());
+	vector<ArrayXXd> sampleImages(
+		vector<ArrayXXd> imgs,
+		const ConditionalDistribution& model,
+		const ArrayXXb& inputMask,
+		const ArrayXXb& outputMask,
+		const Preconditioner* preconditioner = 0,
+		double minValue = -numeric_limits<double>::infinity(),
+		double maxValue = numeric_limits<double>::infinity());
 	vector<ArrayXXd> sampleImage(
 		vector<ArrayXXd> img,
 		const ConditionalDistribution& model,
@@ -171,4 +274,118 @@ namespace CMT {
 		const Preconditioner* preconditioner = 0);
 }
 
+
+
+inline int CMT::NeighborhoodPlan::dimIn() const {
+	return mInputOffsets.size();
+}
+
+
+
+inline int CMT::NeighborhoodPlan::dimOut() const {
+	return mOutputOffsets.size();
+}
+
+
+
+inline void CMT::NeighborhoodPlan::gather(
+	const ArrayXXd& img,
+	int i,
+	int j,
+	double* input,
+	double* output) const
+{
+	const double* origin = img.data() + i + j * mImageRows;
+
+	if(input)
+		for(int k = 0; k < mInputOffsets.size(); ++k)
+			input[k] = origin[mInputOffsets[k]];
+	if(output)
+		for(int k = 0; k < mOutputOffsets.size(); ++k)
+			output[k] = origin[mOutputOffsets[k]];
+}
+
+
+
+inline void CMT::NeighborhoodPlan::gather(
+	const vector<ArrayXXd>& img,
+	int i,
+	int j,
+	double* input,
+	double* output,
+	int frame) const
+{
+	int origin = i + j * mImageRows;
+
+	if(input)
+		for(int k = 0; k < mInputOffsets.size(); ++k)
+			input[k] = img[frame + mInputChannels[k]].data()[origin + mInputOffsets[k]];
+	if(output)
+		for(int k = 0; k < mOutputOffsets.size(); ++k)
+			output[k] = img[frame + mOutputChannels[k]].data()[origin + mOutputOffsets[k]];
+}
+
+
+
+inline void CMT::NeighborhoodPlan::scatter(
+	ArrayXXd& img,
+	int i,
+	int j,
+	const double* output) const
+{
+	double* origin = img.data() + i + j * mImageRows;
+
+	for(int k = 0; k < mOutputOffsets.size(); ++k)
+		origin[mOutputOffsets[k]] = output[k];
+}
+
+
+
+inline void CMT::NeighborhoodPlan::scatter(
+	vector<ArrayXXd>& img,
+	int i,
+	int j,
+	const double* output,
+	int frame) const
+{
+	int origin = i + j * mImageRows;
+
+	for(int k = 0; k < mOutputOffsets.size(); ++k)
+		img[frame + mOutputChannels[k]].data()[origin + mOutputOffsets[k]] = output[k];
+}
+
+
+
+inline void CMT::NeighborhoodPlan::accumulate(
+	ArrayXXd& img,
+	int i,
+	int j,
+	const double* input,
+	const double* output) const
+{
+	double* origin = img.data() + i + j * mImageRows;
+
+	for(int k = 0; k < mInputOffsets.size(); ++k)
+		origin[mInputOffsets[k]] += input[k];
+	for(int k = 0; k < mOutputOffsets.size(); ++k)
+		origin[mOutputOffsets[k]] += output[k];
+}
+
+
+
+inline void CMT::NeighborhoodPlan::accumulate(
+	vector<ArrayXXd>& img,
+	int i,
+	int j,
+	const double* input,
+	const double* output) const
+{
+	int origin = i + j * mImageRows;
+
+	for(int k = 0; k < mInputOffsets.size(); ++k)
+		img[mInputChannels[k]].data()[origin + mInputOffsets[k]] += input[k];
+	for(int k = 0; k < mOutputOffsets.size(); ++k)
+		img[mOutputChannels[k]].data()[origin + mOutputOffsets[k]] += output[k];
+}
+
 #endif
@@ -5,6 +5,7 @@
 #include "Eigen/Core"
 #include "lbfgs.h"
 #include "conditionaldistribution.h"
+#include "utils.h"
 
 namespace CMT {
 	using std::pair;
@@ -46,8 +47,11 @@ namespace CMT {
 					virtual Parameters& operator=(const Parameters& params);
 			};
 
+			Trainable();
 			virtual ~Trainable();
 
+			inline unsigned long version() const;
+
 			virtual void initialize(const MatrixXd& input, const MatrixXd& output);
 			virtual void initialize(const pair<ArrayXXd, ArrayXXd>& data);
 
@@ -68,6 +72,10 @@ namespace CMT {
 				const pair<ArrayXXd, ArrayXXd>& data,
 				const pair<ArrayXXd, ArrayXXd>& dataVal,
 				const Parameters& params = Parameters());
+			virtual bool train(
+				const WindowView& input,
+				const MatrixXd& output,
+				const Parameters& params = Parameters());
 
 			virtual double checkGradient(
 				const MatrixXd& input,
@@ -92,6 +100,12 @@ namespace CMT {
 				const lbfgsfloatval_t* x,
 				lbfgsfloatval_t* g,
 				const Parameters& params) const = 0;
+			virtual double parameterGradient(
+				const WindowView& input,
+				const MatrixXd& output,
+				const lbfgsfloatval_t* x,
+				lbfgsfloatval_t* g,
+				const Parameters& params) const;
 
 			virtual MatrixXd fisherInformation(
 				const MatrixXd& input,
@@ -109,6 +123,9 @@ namespace CMT {
 				const MatrixXd* input;
 				const MatrixXd* output;
 
+				// used instead of input if inputs are windows of a time series
+				const WindowView* windows;
+
 				// used for validation error based early stopping
 				const MatrixXd* inputVal;
 				const MatrixXd* outputVal;
@@ -129,6 +146,11 @@ namespace CMT {
 					const MatrixXd* output,
 					const MatrixXd* inputVal,
 					const MatrixXd* outputVal);
+				InstanceLBFGS(
+					Trainable* cd,
+					const Trainable::Parameters* params,
+					const WindowView* windows,
+					const MatrixXd* output);
 				~InstanceLBFGS();
 			};
 
@@ -154,7 +176,24 @@ namespace CMT {
 				const MatrixXd* inputVal = 0,
 				const MatrixXd* outputVal = 0,
 				const Parameters& params = Parameters());
+
+			bool optimize(InstanceLBFGS& instance, const Parameters& params);
+
+			// identifies the parameters; models share a version only if they have equal parameters
+			unsigned long mVersion;
+
+			static unsigned long nextVersion();
 	};
 }
 
+
+
+/**
+ * Changes whenever the parameters change. Copies share the version of the original model until
+ * either of them is changed.
+ */
+inline unsigned long CMT::Trainable::version() const {
+	return mVersion;
+}
+
 #endif
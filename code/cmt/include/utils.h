@@ -4,6 +4,7 @@
 #include "Eigen/Core"
 #include <vector>
 #include <set>
+#include <utility>
 #include "exception.h"
 
 #define PI 3.141592653589793
@@ -20,9 +21,19 @@ namespace CMT {
 
 	using std::vector;
 	using std::set;
+	using std::pair;
+
+	/**
+	 * Matrix whose columns are separated by an arbitrary stride. If the stride is smaller than
+	 * the number of rows, consecutive columns overlap. This allows all windows of a time series
+	 * to be represented without copying the time series.
+	 */
+	typedef Eigen::Map<const MatrixXd, Eigen::Unaligned, Eigen::OuterStride<> > WindowView;
 
 	Array<double, 1, Dynamic> logSumExp(const ArrayXXd& array);
 	Array<double, 1, Dynamic> logMeanExp(const ArrayXXd& array);
+	double compensatedSum(const vector<double>& values);
+	int streamingTileSize(int numData);
 
 	MatrixXd signum(const MatrixXd& matrix);
 
@@ -36,6 +47,7 @@ namespace CMT {
 	ArrayXXd sinh(const ArrayXXd& arr);
 	ArrayXXd sech(const ArrayXXd& arr);
 
+	void seed(unsigned int seed);
 	ArrayXXd sampleNormal(int m = 1, int n = 1);
 	ArrayXXd sampleGamma(int m = 1, int n = 1, int k = 1);
 	ArrayXXi samplePoisson(int m = 1, int n = 1, double lambda = 1.);
@@ -43,6 +55,7 @@ namespace CMT {
 	ArrayXXi sampleBinomial(int w = 1, int h = 1, int n = 10, double p = .5);
 	ArrayXXi sampleBinomial(const ArrayXXi& n, const ArrayXXd& p);
 	set<int> randomSelect(int k, int n);
+	vector<long> randomSample(int k, long n);
 
 	VectorXi argSort(const VectorXd& data);
 	MatrixXd covariance(const MatrixXd& data);
@@ -50,14 +63,78 @@ namespace CMT {
 	MatrixXd corrCoef(const MatrixXd& data);
 	MatrixXd normalize(const MatrixXd& matrix);
 	MatrixXd pInverse(const MatrixXd& matrix);
+	pair<VectorXd, MatrixXd> randomizedEigen(
+		const MatrixXd& matrix,
+		int numEigen,
+		int numIter = 6,
+		int oversampling = 10);
+	bool preferRandomizedEigen(int numEigen, int dim);
 
 	double logDetPD(const MatrixXd& matrix);
 
 	MatrixXd deleteRows(const MatrixXd& matrix, vector<int> indices);
 	MatrixXd deleteCols(const MatrixXd& matrix, vector<int> indices);
 
+	WindowView windowView(const ArrayXXd& timeSeries, int windowLength);
+
 	template <class ArrayType>
 	ArrayType concatenate(const vector<ArrayType>& data, int axis=1);
+
+	/**
+	 * Accumulates means and covariances of inputs and outputs from a stream of chunks. Chunks are
+	 * processed in parallel tiles whose statistics are merged pairwise, and only O(d^2) memory is
+	 * needed irrespective of the number of data points.
+	 */
+	class Moments {
+		public:
+			Moments(int dimIn, int dimOut = 0);
+
+			inline int dimIn() const;
+			inline int dimOut() const;
+			inline double numData() const;
+
+			void update(const MatrixXd& data);
+			void update(const ArrayXXd& data);
+			void update(const MatrixXd& input, const MatrixXd& output);
+			void update(const ArrayXXd& input, const ArrayXXd& output);
+			void update(const Moments& moments);
+
+			VectorXd meanIn() const;
+			VectorXd meanOut() const;
+			MatrixXd covXX() const;
+			MatrixXd covYX() const;
+			MatrixXd covYY() const;
+			MatrixXd covariance() const;
+
+		protected:
+			int mDimIn;
+			int mDimOut;
+			double mNumData;
+			VectorXd mMean;
+			MatrixXd mScatter;
+
+			template <class ArrayType>
+			void updateTiled(const ArrayType& input, const ArrayType& output);
+			void merge(double numData, const VectorXd& mean, const MatrixXd& scatter);
+	};
+}
+
+
+
+inline int CMT::Moments::dimIn() const {
+	return mDimIn;
+}
+
+
+
+inline int CMT::Moments::dimOut() const {
+	return mDimOut;
+}
+
+
+
+inline double CMT::Moments::numData() const {
+	return mNumData;
 }
 
 
@@ -2,11 +2,13 @@
 #define CMT_WHITENINGPRECONDITIONER_H
 
 #include "affinepreconditioner.h"
+#include "utils.h"
 
 namespace CMT {
 	class WhiteningPreconditioner : public AffinePreconditioner {
 		public:
 			WhiteningPreconditioner(const ArrayXXd& input, const ArrayXXd& output);
+			WhiteningPreconditioner(const Moments& moments);
 			WhiteningPreconditioner(
 				const VectorXd& meanIn,
 				const VectorXd& meanOut,
@@ -15,6 +17,9 @@ namespace CMT {
 				const MatrixXd& preOut,
 				const MatrixXd& preOutInv,
 				const MatrixXd& predictor);
+
+		protected:
+			void initialize(const Moments& moments);
 	};
 }
 
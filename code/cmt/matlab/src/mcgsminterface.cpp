@@ -92,6 +92,21 @@ bool mcgsmParameters(CMT::MCGSM::Parameters* params, std::string key, MEX::Input
         return true;
     }
 
+    if(key == "pruneThreshold") {
+        params->pruneThreshold = value;
+        return true;
+    }
+
+    if(key == "pruneIter") {
+        params->pruneIter = value;
+        return true;
+    }
+
+    if(key == "splitComponents") {
+        params->splitComponents = value;
+        return true;
+    }
+
     return trainableParameters(params, key, value);
 }
 
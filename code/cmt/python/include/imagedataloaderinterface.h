@@ -0,0 +1,36 @@
+#ifndef IMAGEDATALOADERINTERFACE_H
+#define IMAGEDATALOADERINTERFACE_H
+
+#define PY_ARRAY_UNIQUE_SYMBOL CMT_ARRAY_API
+#define NO_IMPORT_ARRAY
+
+#include <Python.h>
+#include <arrayobject.h>
+#include "pyutils.h"
+
+#include "cmt/tools"
+using CMT::ImageDataLoader;
+
+struct ImageDataLoaderObject {
+	PyObject_HEAD
+	ImageDataLoader* loader;
+	PyObject* preconditioner;
+};
+
+extern PyTypeObject Preconditioner_type;
+
+extern const char* ImageDataLoader_doc;
+extern const char* ImageDataLoader_next_doc;
+
+PyObject* ImageDataLoader_new(PyTypeObject*, PyObject*, PyObject*);
+int ImageDataLoader_init(ImageDataLoaderObject*, PyObject*, PyObject*);
+void ImageDataLoader_dealloc(ImageDataLoaderObject*);
+
+PyObject* ImageDataLoader_dim_in(ImageDataLoaderObject*, void*);
+PyObject* ImageDataLoader_dim_out(ImageDataLoaderObject*, void*);
+PyObject* ImageDataLoader_batch_size(ImageDataLoaderObject*, void*);
+PyObject* ImageDataLoader_num_locations(ImageDataLoaderObject*, void*);
+
+PyObject* ImageDataLoader_next(ImageDataLoaderObject*);
+
+#endif
@@ -21,6 +21,11 @@ struct MCGSMObject {
 	bool owner;
 };
 
+struct MCGSMIntermediatesObject {
+	PyObject_HEAD
+	MCGSM::Intermediates* intermediates;
+};
+
 struct PatchMCGSMObject {
 	PyObject_HEAD
 	PatchModel<MCGSM, PCAPreconditioner>* patchMCGSM;
@@ -28,7 +33,9 @@ struct PatchMCGSMObject {
 };
 
 extern PyTypeObject MCGSM_type;
+extern PyTypeObject MCGSMIntermediates_type;
 extern PyTypeObject PCAPreconditioner_type;
+extern PyTypeObject AffinePreconditioner_type;
 
 extern const char* MCGSM_doc;
 extern const char* MCGSM_train_doc;
@@ -38,6 +45,9 @@ extern const char* MCGSM_sample_prior_doc;
 extern const char* MCGSM_sample_posterior_doc;
 extern const char* MCGSM_prior_doc;
 extern const char* MCGSM_posterior_doc;
+extern const char* MCGSM_fold_preconditioner_doc;
+extern const char* MCGSM_intermediates_doc;
+extern const char* MCGSM_compute_data_gradient_doc;
 extern const char* MCGSM_reduce_doc;
 extern const char* MCGSM_setstate_doc;
 
@@ -49,6 +59,9 @@ extern const char* PatchMCGSM_setstate_doc;
 
 int MCGSM_init(MCGSMObject*, PyObject*, PyObject*);
 
+PyObject* MCGSMIntermediates_new(PyTypeObject*, PyObject*, PyObject*);
+void MCGSMIntermediates_dealloc(MCGSMIntermediatesObject*);
+
 PyObject* MCGSM_num_components(MCGSMObject*, PyObject*, void*);
 PyObject* MCGSM_num_scales(MCGSMObject*, PyObject*, void*);
 PyObject* MCGSM_num_features(MCGSMObject*, PyObject*, void*);
@@ -87,6 +100,7 @@ PyObject* MCGSM_loglikelihood(MCGSMObject*, PyObject*, PyObject*);
 PyObject* MCGSM_sample(MCGSMObject*, PyObject*, PyObject*);
 PyObject* MCGSM_sample_prior(MCGSMObject*, PyObject*, PyObject*);
 PyObject* MCGSM_sample_posterior(MCGSMObject*, PyObject*, PyObject*);
+PyObject* MCGSM_fold_preconditioner(MCGSMObject*, PyObject*, PyObject*);
 PyObject* MCGSM_prior(MCGSMObject*, PyObject*, PyObject*);
 PyObject* MCGSM_posterior(MCGSMObject*, PyObject*, PyObject*);
 
@@ -94,6 +108,7 @@ PyObject* MCGSM_parameters(MCGSMObject*, PyObject*, PyObject*);
 PyObject* MCGSM_set_parameters(MCGSMObject*, PyObject*, PyObject*);
 PyObject* MCGSM_parameter_gradient(MCGSMObject*, PyObject*, PyObject*);
 
+PyObject* MCGSM_intermediates(MCGSMObject*, PyObject*, PyObject*);
 PyObject* MCGSM_compute_data_gradient(MCGSMObject*, PyObject*, PyObject*);
 
 PyObject* MCGSM_reduce(MCGSMObject*, PyObject*, PyObject*);
@@ -0,0 +1,39 @@
+#ifndef MOMENTSINTERFACE_H
+#define MOMENTSINTERFACE_H
+
+#define PY_ARRAY_UNIQUE_SYMBOL CMT_ARRAY_API
+#define NO_IMPORT_ARRAY
+
+#include <Python.h>
+#include <arrayobject.h>
+#include "pyutils.h"
+
+#include "cmt/utils"
+using CMT::Moments;
+
+struct MomentsObject {
+	PyObject_HEAD
+	Moments* moments;
+};
+
+extern PyTypeObject Moments_type;
+
+extern const char* Moments_doc;
+extern const char* Moments_update_doc;
+
+PyObject* Moments_new(PyTypeObject*, PyObject*, PyObject*);
+int Moments_init(MomentsObject*, PyObject*, PyObject*);
+void Moments_dealloc(MomentsObject*);
+
+PyObject* Moments_dim_in(MomentsObject*, void*);
+PyObject* Moments_dim_out(MomentsObject*, void*);
+PyObject* Moments_num_data(MomentsObject*, void*);
+PyObject* Moments_mean_in(MomentsObject*, void*);
+PyObject* Moments_mean_out(MomentsObject*, void*);
+PyObject* Moments_cov_xx(MomentsObject*, void*);
+PyObject* Moments_cov_yx(MomentsObject*, void*);
+PyObject* Moments_cov_yy(MomentsObject*, void*);
+
+PyObject* Moments_update(MomentsObject*, PyObject*, PyObject*);
+
+#endif
@@ -23,6 +23,7 @@ using CMT::Tuples;
 
 #include "cmt/utils"
 using CMT::Regularizer;
+using CMT::WindowView;
 
 typedef Matrix<bool, Dynamic, Dynamic> MatrixXb;
 typedef Array<bool, Dynamic, Dynamic> ArrayXXb;
@@ -36,6 +37,8 @@ MatrixXb PyArray_ToMatrixXb(PyObject* array);
 vector<ArrayXXd> PyArray_ToArraysXXd(PyObject* array);
 vector<ArrayXXb> PyArray_ToArraysXXb(PyObject* array);
 PyObject* PyArray_FromArraysXXd(const vector<ArrayXXd>& channels);
+bool PyArray_IsWindowView(PyObject* array);
+WindowView PyArray_ToWindowView(PyObject* array);
 
 Tuples PyList_AsTuples(PyObject* list);
 PyObject* PyList_FromTuples(const Tuples& tuples);
@@ -14,13 +14,17 @@ extern PyTypeObject MCGSM_type;
 
 extern const char* random_select_doc;
 extern const char* density_gradient_doc;
+extern const char* evaluate_image_doc;
 extern const char* sample_image_doc;
+extern const char* sample_images_doc;
 extern const char* sample_image_conditionally_doc;
 extern const char* sample_labels_conditionally_doc;
 extern const char* sample_video_doc;
 extern const char* generate_data_from_image_doc;
 extern const char* generate_data_from_video_doc;
 extern const char* fill_in_image_doc;
+extern const char* encode_image_doc;
+extern const char* decode_image_doc;
 extern const char* extract_windows_doc;
 extern const char* sample_spike_train_doc;
 
@@ -28,12 +32,16 @@ PyObject* random_select(PyObject*, PyObject*, PyObject*);
 PyObject* generate_data_from_image(PyObject*, PyObject*, PyObject*);
 PyObject* generate_data_from_video(PyObject*, PyObject*, PyObject*);
 PyObject* density_gradient(PyObject*, PyObject*, PyObject*);
+PyObject* evaluate_image(PyObject*, PyObject*, PyObject*);
 PyObject* sample_image(PyObject*, PyObject*, PyObject*);
+PyObject* sample_images(PyObject*, PyObject*, PyObject*);
 PyObject* sample_image_conditionally(PyObject*, PyObject*, PyObject*);
 PyObject* sample_labels_conditionally(PyObject*, PyObject*, PyObject*);
 PyObject* sample_video(PyObject*, PyObject*, PyObject*);
 PyObject* fill_in_image(PyObject*, PyObject*, PyObject*);
 PyObject* fill_in_image_map(PyObject*, PyObject*, PyObject*);
+PyObject* encode_image(PyObject*, PyObject*, PyObject*);
+PyObject* decode_image(PyObject*, PyObject*, PyObject*);
 PyObject* extract_windows(PyObject*, PyObject*, PyObject*);
 PyObject* sample_spike_train(PyObject*, PyObject*, PyObject*);
 
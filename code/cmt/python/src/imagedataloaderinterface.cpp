@@ -0,0 +1,246 @@
+#include "imagedataloaderinterface.h"
+#include "preconditionerinterface.h"
+
+#include "cmt/utils"
+using CMT::Exception;
+
+#include <vector>
+using std::vector;
+
+#include <utility>
+using std::pair;
+
+#include <new>
+using std::bad_alloc;
+
+#if PY_MAJOR_VERSION >= 3
+	#define PyInt_FromLong PyLong_FromLong
+#endif
+
+PyObject* ImageDataLoader_new(PyTypeObject* type, PyObject*, PyObject*) {
+	PyObject* self = type->tp_alloc(type, 0);
+
+	if(self) {
+		reinterpret_cast<ImageDataLoaderObject*>(self)->loader = 0;
+		reinterpret_cast<ImageDataLoaderObject*>(self)->preconditioner = 0;
+	}
+
+	return self;
+}
+
+
+
+const char* ImageDataLoader_doc =
+	"Generates batches of random inputs and outputs from images on demand.\n"
+	"\n"
+	"Only the images are kept in memory. While a batch is being used, the next\n"
+	"batch is extracted and preconditioned by a background thread. This allows\n"
+	"models to be trained on many more neighborhoods than would fit into memory,\n"
+	"for example by repeatedly calling C{train} with a few iterations each.\n"
+	"\n"
+	"Locations are drawn uniformly and with replacement from all images.\n"
+	"\n"
+	"Example:\n"
+	"\n"
+	"\t>>> loader = ImageDataLoader(images, input_mask, output_mask, 100000, wt)\n"
+	"\t>>> for _ in range(100):\n"
+	"\t>>> \tmodel.train(*loader.next(), parameters={'max_iter': 10})\n"
+	"\n"
+	"@type  images: C{ndarray}/C{list}\n"
+	"@param images: a grayscale image or a list of grayscale images\n"
+	"\n"
+	"@type  input_mask: C{ndarray}\n"
+	"@param input_mask: a Boolean array describing the input pixels\n"
+	"\n"
+	"@type  output_mask: C{ndarray}\n"
+	"@param output_mask: a Boolean array describing the output pixels\n"
+	"\n"
+	"@type  batch_size: C{int}\n"
+	"@param batch_size: number of input/output pairs per batch\n"
+	"\n"
+	"@type  preconditioner: L{Preconditioner<transforms.Preconditioner>}\n"
+	"@param preconditioner: transforms each batch before it is returned (optional)";
+
+int ImageDataLoader_init(ImageDataLoaderObject* self, PyObject* args, PyObject* kwds) {
+	const char* kwlist[] = {"images", "input_mask", "output_mask", "batch_size", "preconditioner", 0};
+
+	PyObject* imagesObj;
+	PyObject* input_mask;
+	PyObject* output_mask;
+	int batch_size = 1000;
+	PyObject* preconditionerObj = 0;
+
+	if(!PyArg_ParseTupleAndKeywords(args, kwds, "OOO|iO", const_cast<char**>(kwlist),
+		&imagesObj, &input_mask, &output_mask, &batch_size, &preconditionerObj))
+		return -1;
+
+	if(preconditionerObj == Py_None)
+		preconditionerObj = 0;
+
+	if(preconditionerObj && !PyObject_IsInstance(preconditionerObj, reinterpret_cast<PyObject*>(&Preconditioner_type))) {
+		PyErr_SetString(PyExc_TypeError, "`preconditioner` has to be of type `Preconditioner`.");
+		return -1;
+	}
+
+	// a single image or a sequence of images
+	PyObject* sequence = PyList_Check(imagesObj) || PyTuple_Check(imagesObj) ?
+		PySequence_Fast(imagesObj, "") : PyTuple_Pack(1, imagesObj);
+
+	if(!sequence)
+		return -1;
+
+	vector<ArrayXXd> images;
+
+	for(int n = 0; n < PySequence_Fast_GET_SIZE(sequence); ++n) {
+		PyObject* img = PyArray_FROM_OTF(
+			PySequence_Fast_GET_ITEM(sequence, n), NPY_DOUBLE, NPY_F_CONTIGUOUS | NPY_ALIGNED);
+
+		if(!img || PyArray_NDIM(img) != 2) {
+			Py_XDECREF(img);
+			Py_DECREF(sequence);
+			PyErr_SetString(PyExc_TypeError, "Images have to be given as two-dimensional arrays.");
+			return -1;
+		}
+
+		images.push_back(PyArray_ToMatrixXd(img));
+
+		Py_DECREF(img);
+	}
+
+	Py_DECREF(sequence);
+
+	input_mask = PyArray_FROM_OTF(input_mask, NPY_BOOL, NPY_F_CONTIGUOUS | NPY_ALIGNED);
+	output_mask = PyArray_FROM_OTF(output_mask, NPY_BOOL, NPY_F_CONTIGUOUS | NPY_ALIGNED);
+
+	if(!input_mask || !output_mask) {
+		Py_XDECREF(input_mask);
+		Py_XDECREF(output_mask);
+		PyErr_SetString(PyExc_TypeError, "Masks have to be given as Boolean arrays.");
+		return -1;
+	}
+
+	try {
+		ImageDataLoader* loader = new ImageDataLoader(
+			images,
+			PyArray_ToMatrixXb(input_mask),
+			PyArray_ToMatrixXb(output_mask),
+			batch_size,
+			preconditionerObj ? reinterpret_cast<PreconditionerObject*>(preconditionerObj)->preconditioner : 0);
+
+		delete self->loader;
+		Py_XDECREF(self->preconditioner);
+
+		self->loader = loader;
+
+		// the preconditioner is used by the loader and has to stay alive
+		Py_XINCREF(preconditionerObj);
+		self->preconditioner = preconditionerObj;
+
+	} catch(Exception exception) {
+		Py_DECREF(input_mask);
+		Py_DECREF(output_mask);
+		PyErr_SetString(PyExc_RuntimeError, exception.message());
+		return -1;
+	} catch(bad_alloc&) {
+		Py_DECREF(input_mask);
+		Py_DECREF(output_mask);
+		PyErr_SetString(PyExc_RuntimeError, "Not enough memory.");
+		return -1;
+	}
+
+	Py_DECREF(input_mask);
+	Py_DECREF(output_mask);
+
+	return 0;
+}
+
+
+
+void ImageDataLoader_dealloc(ImageDataLoaderObject* self) {
+	// stops the background thread
+	delete self->loader;
+
+	Py_XDECREF(self->preconditioner);
+
+	Py_TYPE(self)->tp_free(reinterpret_cast<PyObject*>(self));
+}
+
+
+
+PyObject* ImageDataLoader_dim_in(ImageDataLoaderObject* self, void*) {
+	if(!self->loader) {
+		PyErr_SetString(PyExc_RuntimeError, "Data loader has not been initialized.");
+		return 0;
+	}
+
+	return PyInt_FromLong(self->loader->dimIn());
+}
+
+
+
+PyObject* ImageDataLoader_dim_out(ImageDataLoaderObject* self, void*) {
+	if(!self->loader) {
+		PyErr_SetString(PyExc_RuntimeError, "Data loader has not been initialized.");
+		return 0;
+	}
+
+	return PyInt_FromLong(self->loader->dimOut());
+}
+
+
+
+PyObject* ImageDataLoader_batch_size(ImageDataLoaderObject* self, void*) {
+	if(!self->loader) {
+		PyErr_SetString(PyExc_RuntimeError, "Data loader has not been initialized.");
+		return 0;
+	}
+
+	return PyInt_FromLong(self->loader->batchSize());
+}
+
+
+
+PyObject* ImageDataLoader_num_locations(ImageDataLoaderObject* self, void*) {
+	if(!self->loader) {
+		PyErr_SetString(PyExc_RuntimeError, "Data loader has not been initialized.");
+		return 0;
+	}
+
+	return PyLong_FromLong(self->loader->numLocations());
+}
+
+
+
+const char* ImageDataLoader_next_doc =
+	"next(self)\n"
+	"\n"
+	"Returns the next batch and starts generating the one after it.\n"
+	"\n"
+	"@rtype: C{tuple}\n"
+	"@return: inputs and outputs stored in columns";
+
+PyObject* ImageDataLoader_next(ImageDataLoaderObject* self) {
+	if(!self->loader) {
+		PyErr_SetString(PyExc_RuntimeError, "Data loader has not been initialized.");
+		return 0;
+	}
+
+	try {
+		pair<ArrayXXd, ArrayXXd> batch = self->loader->next();
+
+		PyObject* inputObj = PyArray_FromMatrixXd(batch.first);
+		PyObject* outputObj = PyArray_FromMatrixXd(batch.second);
+		PyObject* tuple = Py_BuildValue("(OO)", inputObj, outputObj);
+
+		Py_DECREF(inputObj);
+		Py_DECREF(outputObj);
+
+		return tuple;
+	} catch(Exception exception) {
+		PyErr_SetString(PyExc_RuntimeError, exception.message());
+		return 0;
+	}
+
+	return 0;
+}
+
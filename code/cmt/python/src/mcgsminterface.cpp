@@ -16,6 +16,8 @@ using CMT::Exception;
 
 #if PY_MAJOR_VERSION >= 3
 	#define PyInt_FromLong PyLong_FromLong
+	#define PyInt_AsLong PyLong_AsLong
+	#define PyInt_Check PyLong_Check
 #endif
 
 Trainable::Parameters* PyObject_ToMCGSMParameters(PyObject* parameters) {
@@ -106,6 +108,31 @@ Trainable::Parameters* PyObject_ToMCGSMParameters(PyObject* parameters) {
 		PyObject* regularize_means = PyDict_GetItemString(parameters, "regularize_means");
 		if(regularize_means)
 			params->regularizeMeans = PyObject_ToRegularizer(regularize_means);
+
+		PyObject* prune_threshold = PyDict_GetItemString(parameters, "prune_threshold");
+		if(prune_threshold)
+			if(PyFloat_Check(prune_threshold))
+				params->pruneThreshold = PyFloat_AsDouble(prune_threshold);
+			else if(PyInt_Check(prune_threshold))
+				params->pruneThreshold = static_cast<double>(PyInt_AsLong(prune_threshold));
+			else
+				throw Exception("prune_threshold should be of type `float`.");
+
+		PyObject* prune_iter = PyDict_GetItemString(parameters, "prune_iter");
+		if(prune_iter)
+			if(PyInt_Check(prune_iter))
+				params->pruneIter = PyInt_AsLong(prune_iter);
+			else if(PyFloat_Check(prune_iter))
+				params->pruneIter = static_cast<int>(PyFloat_AsDouble(prune_iter));
+			else
+				throw Exception("prune_iter should be of type `int`.");
+
+		PyObject* split_components = PyDict_GetItemString(parameters, "split_components");
+		if(split_components)
+			if(PyBool_Check(split_components))
+				params->splitComponents = (split_components == Py_True);
+			else
+				throw Exception("split_components should be of type `bool`.");
 	}
 
 	return params;
@@ -195,6 +222,25 @@ int MCGSM_init(MCGSMObject* self, PyObject* args, PyObject* kwds) {
 
 
 
+PyObject* MCGSMIntermediates_new(PyTypeObject* type, PyObject*, PyObject*) {
+	PyObject* self = type->tp_alloc(type, 0);
+
+	if(self)
+		reinterpret_cast<MCGSMIntermediatesObject*>(self)->intermediates = 0;
+
+	return self;
+}
+
+
+
+void MCGSMIntermediates_dealloc(MCGSMIntermediatesObject* self) {
+	delete self->intermediates;
+
+	Py_TYPE(self)->tp_free(reinterpret_cast<PyObject*>(self));
+}
+
+
+
 PyObject* MCGSM_num_components(MCGSMObject* self, PyObject*, void*) {
 	return PyInt_FromLong(self->mcgsm->numComponents());
 }
@@ -574,6 +620,9 @@ const char* MCGSM_train_doc =
 	"\t>>> \t\t'strength': 0.,\n"
 	"\t>>> \t\t'transform': None,\n"
 	"\t>>> \t\t'norm': 'L2'},\n"
+	"\t>>> \t'prune_threshold': 0.,\n"
+	"\t>>> \t'prune_iter': 100,\n"
+	"\t>>> \t'split_components': False,\n"
 	"\t>>> })\n"
 	"\n"
 	"The parameters C{train_priors}, C{train_scales}, and so on can be used to control which "
@@ -592,6 +641,11 @@ const char* MCGSM_train_doc =
 	"The parameter C{batch_size} has no effect on the solution of the optimization but "
 	"can affect speed by reducing the number of cache misses.\n"
 	"\n"
+	"If C{prune_threshold} is positive, every C{prune_iter} iterations components whose total prior "
+	"probability falls below C{prune_threshold} are removed from the model, so that the cost of "
+	"evaluating the model matches its effective size. If C{split_components} is set, each removed "
+	"component is replaced by splitting the currently most probable component in two.\n"
+	"\n"
 	"If a callback function is given, it will be called every C{cb_iter} iterations. The first "
 	"argument to callback will be the current iteration, the second argument will be a I{copy} of "
 	"the model.\n"
@@ -808,7 +862,7 @@ const char* MCGSM_prior_doc =
 	"Computes the prior distribution over component labels, $p(c \\mid \\mathbf{x})$\n"
 	"\n"
 	"@type  input: C{ndarray}\n"
-	"@param input: inputs stored in columns\n"
+	"@param input: inputs stored in columns, or intermediates computed by L{_intermediates()}\n"
 	"\n"
 	"@rtype: C{ndarray}\n"
 	"@return: a distribution over labels for each given input";
@@ -822,6 +876,16 @@ PyObject* MCGSM_prior(MCGSMObject* self, PyObject* args, PyObject* kwds) {
 	if(!PyArg_ParseTupleAndKeywords(args, kwds, "O", const_cast<char**>(kwlist), &input))
 		return 0;
 
+	if(PyType_IsSubtype(Py_TYPE(input), &MCGSMIntermediates_type)) {
+		try {
+			return PyArray_FromMatrixXd(self->mcgsm->prior(
+				*reinterpret_cast<MCGSMIntermediatesObject*>(input)->intermediates));
+		} catch(Exception exception) {
+			PyErr_SetString(PyExc_RuntimeError, exception.message());
+			return 0;
+		}
+	}
+
 	// make sure data is stored in NumPy array
 	input = PyArray_FROM_OTF(input, NPY_DOUBLE, NPY_F_CONTIGUOUS | NPY_ALIGNED);
 
@@ -852,10 +916,10 @@ const char* MCGSM_posterior_doc =
 	"Computes the posterior distribution over component labels, $p(c \\mid \\mathbf{x}, \\mathbf{y})$\n"
 	"\n"
 	"@type  input: C{ndarray}\n"
-	"@param input: inputs stored in columns\n"
+	"@param input: inputs stored in columns, or intermediates computed by L{_intermediates()}\n"
 	"\n"
 	"@type  output: C{ndarray}\n"
-	"@param output: outputs stored in columns\n"
+	"@param output: outputs stored in columns (omitted if intermediates are given)\n"
 	"\n"
 	"@rtype: C{ndarray}\n"
 	"@return: a posterior distribution over labels for each given pair of input and output";
@@ -864,12 +928,27 @@ PyObject* MCGSM_posterior(MCGSMObject* self, PyObject* args, PyObject* kwds) {
 	const char* kwlist[] = {"input", "output", 0};
 
 	PyObject* input;
-	PyObject* output;
+	PyObject* output = 0;
 
 	// read arguments
-	if(!PyArg_ParseTupleAndKeywords(args, kwds, "OO", const_cast<char**>(kwlist), &input, &output))
+	if(!PyArg_ParseTupleAndKeywords(args, kwds, "O|O", const_cast<char**>(kwlist), &input, &output))
 		return 0;
 
+	if(PyType_IsSubtype(Py_TYPE(input), &MCGSMIntermediates_type)) {
+		try {
+			return PyArray_FromMatrixXd(self->mcgsm->posterior(
+				*reinterpret_cast<MCGSMIntermediatesObject*>(input)->intermediates));
+		} catch(Exception exception) {
+			PyErr_SetString(PyExc_RuntimeError, exception.message());
+			return 0;
+		}
+	}
+
+	if(!output) {
+		PyErr_SetString(PyExc_TypeError, "Outputs are missing.");
+		return 0;
+	}
+
 	// make sure data is stored in NumPy array
 	input = PyArray_FROM_OTF(input, NPY_DOUBLE, NPY_F_CONTIGUOUS | NPY_ALIGNED);
 	output = PyArray_FROM_OTF(output, NPY_DOUBLE, NPY_F_CONTIGUOUS | NPY_ALIGNED);
@@ -997,6 +1076,50 @@ PyObject* MCGSM_sample_posterior(MCGSMObject* self, PyObject* args, PyObject* kw
 
 
 
+const char* MCGSM_fold_preconditioner_doc =
+	"fold_preconditioner(self, preconditioner)\n"
+	"\n"
+	"Creates a model operating on raw data which is equivalent to first applying the affine\n"
+	"preconditioner and then this model. The log-Jacobian of the preconditioner is absorbed\n"
+	"into the Cholesky factors, so that the new model's log-likelihood of raw data equals the\n"
+	"log-likelihood of preconditioned data plus the log-Jacobian. Preconditioning can then be\n"
+	"skipped at inference time.\n"
+	"\n"
+	"@type  preconditioner: L{AffinePreconditioner<cmt.transforms.AffinePreconditioner>}\n"
+	"@param preconditioner: preconditioner used to transform the training data of this model\n"
+	"\n"
+	"@rtype: L{MCGSM}\n"
+	"@return: a new model operating on raw data";
+
+PyObject* MCGSM_fold_preconditioner(MCGSMObject* self, PyObject* args, PyObject* kwds) {
+	const char* kwlist[] = {"preconditioner", 0};
+
+	PyObject* preconditioner;
+
+	// read arguments
+	if(!PyArg_ParseTupleAndKeywords(args, kwds, "O!", const_cast<char**>(kwlist),
+		&AffinePreconditioner_type, &preconditioner))
+		return 0;
+
+	try {
+		MCGSM* mcgsm = new MCGSM(*self->mcgsm,
+			*reinterpret_cast<AffinePreconditionerObject*>(preconditioner)->preconditioner);
+
+		PyObject* obj = CD_new(&MCGSM_type, 0, 0);
+		reinterpret_cast<MCGSMObject*>(obj)->mcgsm = mcgsm;
+		reinterpret_cast<MCGSMObject*>(obj)->owner = true;
+
+		return obj;
+	} catch(Exception exception) {
+		PyErr_SetString(PyExc_RuntimeError, exception.message());
+		return 0;
+	}
+
+	return 0;
+}
+
+
+
 PyObject* MCGSM_parameters(MCGSMObject* self, PyObject* args, PyObject* kwds) {
 	return Trainable_parameters(
 		reinterpret_cast<TrainableObject*>(self), 
@@ -1027,7 +1150,25 @@ PyObject* MCGSM_parameter_gradient(MCGSMObject* self, PyObject* args, PyObject*
 
 
 
-PyObject* MCGSM_compute_data_gradient(MCGSMObject* self, PyObject* args, PyObject* kwds) {
+const char* MCGSM_intermediates_doc =
+	"_intermediates(self, input, output)\n"
+	"\n"
+	"Computes quantities shared by L{prior()}, L{posterior()} and L{_data_gradient()}.\n"
+	"\n"
+	"The returned object can be passed to these methods in place of the data to avoid\n"
+	"recomputing feature energies and prediction errors. It becomes invalid as soon as\n"
+	"the parameters of the model change.\n"
+	"\n"
+	"@type  input: C{ndarray}\n"
+	"@param input: inputs stored in columns\n"
+	"\n"
+	"@type  output: C{ndarray}\n"
+	"@param output: outputs stored in columns\n"
+	"\n"
+	"@rtype: C{object}\n"
+	"@return: intermediate results";
+
+PyObject* MCGSM_intermediates(MCGSMObject* self, PyObject* args, PyObject* kwds) {
 	const char* kwlist[] = {"input", "output", 0};
 
 	PyObject* input;
@@ -1048,6 +1189,92 @@ PyObject* MCGSM_compute_data_gradient(MCGSMObject* self, PyObject* args, PyObjec
 		return 0;
 	}
 
+	PyObject* result = MCGSMIntermediates_new(&MCGSMIntermediates_type, 0, 0);
+
+	if(result) {
+		try {
+			reinterpret_cast<MCGSMIntermediatesObject*>(result)->intermediates =
+				new MCGSM::Intermediates(
+					*self->mcgsm,
+					PyArray_ToMatrixXd(input),
+					PyArray_ToMatrixXd(output));
+		} catch(Exception exception) {
+			Py_DECREF(result);
+			result = 0;
+			PyErr_SetString(PyExc_RuntimeError, exception.message());
+		}
+	}
+
+	Py_DECREF(input);
+	Py_DECREF(output);
+
+	return result;
+}
+
+
+
+const char* MCGSM_compute_data_gradient_doc =
+	"_data_gradient(self, input, output)\n"
+	"\n"
+	"Computes the gradient of the log-likelihood with respect to the data.\n"
+	"\n"
+	"@type  input: C{ndarray}\n"
+	"@param input: inputs stored in columns, or intermediates computed by L{_intermediates()}\n"
+	"\n"
+	"@type  output: C{ndarray}\n"
+	"@param output: outputs stored in columns (omitted if intermediates are given)\n"
+	"\n"
+	"@rtype: C{tuple}\n"
+	"@return: gradient of inputs and outputs and log-likelihood";
+
+PyObject* MCGSM_compute_data_gradient(MCGSMObject* self, PyObject* args, PyObject* kwds) {
+	const char* kwlist[] = {"input", "output", 0};
+
+	PyObject* input;
+	PyObject* output = 0;
+
+	// read arguments
+	if(!PyArg_ParseTupleAndKeywords(args, kwds, "O|O", const_cast<char**>(kwlist), &input, &output))
+		return 0;
+
+	if(PyType_IsSubtype(Py_TYPE(input), &MCGSMIntermediates_type)) {
+		try {
+			pair<pair<ArrayXXd, ArrayXXd>, Array<double, 1, Dynamic> > gradients =
+				self->mcgsm->computeDataGradient(
+					*reinterpret_cast<MCGSMIntermediatesObject*>(input)->intermediates);
+
+			PyObject* inputGradient = PyArray_FromMatrixXd(gradients.first.first);
+			PyObject* outputGradient = PyArray_FromMatrixXd(gradients.first.second);
+			PyObject* logLikelihood = PyArray_FromMatrixXd(gradients.second);
+			PyObject* tuple = Py_BuildValue("(OOO)", inputGradient, outputGradient, logLikelihood);
+
+			Py_DECREF(inputGradient);
+			Py_DECREF(outputGradient);
+			Py_DECREF(logLikelihood);
+
+			return tuple;
+		} catch(Exception exception) {
+			PyErr_SetString(PyExc_RuntimeError, exception.message());
+			return 0;
+		}
+	}
+
+	if(!output) {
+		PyErr_SetString(PyExc_TypeError, "Outputs are missing.");
+		return 0;
+	}
+
+	// make sure data is stored in NumPy array
+	input = PyArray_FROM_OTF(input, NPY_DOUBLE, NPY_F_CONTIGUOUS | NPY_ALIGNED);
+	output = PyArray_FROM_OTF(output, NPY_DOUBLE, NPY_F_CONTIGUOUS | NPY_ALIGNED);
+
+	if(!input || !output) {
+		Py_XDECREF(input);
+		Py_XDECREF(output);
+		PyErr_SetString(PyExc_TypeError, "Data has to be stored in NumPy arrays.");
+		return 0;
+	}
+
 	try {
 		pair<pair<ArrayXXd, ArrayXXd>, Array<double, 1, Dynamic> > gradients =
 			 self->mcgsm->computeDataGradient(
@@ -11,6 +11,8 @@
 #include "fvbninterface.h"
 #include "glminterface.h"
 #include "gsminterface.h"
+#include "imagedataloaderinterface.h"
+#include "momentsinterface.h"
 #include "mcbminterface.h"
 #include "mcgsminterface.h"
 #include "mixtureinterface.h"
@@ -218,6 +220,18 @@ static PyMethodDef MCGSM_methods[] = {
 		(PyCFunction)MCGSM_sample_posterior,
 		METH_VARARGS | METH_KEYWORDS,
 		MCGSM_sample_posterior_doc},
+	{"fold_preconditioner",
+		(PyCFunction)MCGSM_fold_preconditioner,
+		METH_VARARGS | METH_KEYWORDS,
+		MCGSM_fold_preconditioner_doc},
+	{"_intermediates",
+		(PyCFunction)MCGSM_intermediates,
+		METH_VARARGS | METH_KEYWORDS,
+		MCGSM_intermediates_doc},
+	{"_data_gradient",
+		(PyCFunction)MCGSM_compute_data_gradient,
+		METH_VARARGS | METH_KEYWORDS,
+		MCGSM_compute_data_gradient_doc},
 	{"_check_gradient",
 		(PyCFunction)MCGSM_check_gradient,
 		METH_VARARGS | METH_KEYWORDS,
@@ -284,6 +298,30 @@ PyTypeObject MCGSM_type = {
 	CD_new,                 /*tp_new*/
 };
 
+PyTypeObject MCGSMIntermediates_type = {
+	PyVarObject_HEAD_INIT(0, 0)
+	"cmt.models.MCGSMIntermediates",          /*tp_name*/
+	sizeof(MCGSMIntermediatesObject),         /*tp_basicsize*/
+	0,                                        /*tp_itemsize*/
+	(destructor)MCGSMIntermediates_dealloc,   /*tp_dealloc*/
+	0,                                        /*tp_print*/
+	0,                                        /*tp_getattr*/
+	0,                                        /*tp_setattr*/
+	0,                                        /*tp_compare*/
+	0,                                        /*tp_repr*/
+	0,                                        /*tp_as_number*/
+	0,                                        /*tp_as_sequence*/
+	0,                                        /*tp_as_mapping*/
+	0,                                        /*tp_hash */
+	0,                                        /*tp_call*/
+	0,                                        /*tp_str*/
+	0,                                        /*tp_getattro*/
+	0,                                        /*tp_setattro*/
+	0,                                        /*tp_as_buffer*/
+	Py_TPFLAGS_DEFAULT,                       /*tp_flags*/
+	"Intermediate results of an MCGSM.",      /*tp_doc*/
+};
+
 static PyGetSetDef MCBM_getset[] = {
 	{"num_components", (getter)MCBM_num_components, 0, "Numer of predictors."},
 	{"num_features",
@@ -1984,7 +2022,7 @@ PyTypeObject WhiteningTransform_type = {
 };
 
 static PyGetSetDef PCAPreconditioner_getset[] = {
-	{"eigenvalues", (getter)PCAPreconditioner_eigenvalues, 0, "Eigenvalues of the covariance of the input."},
+	{"eigenvalues", (getter)PCAPreconditioner_eigenvalues, 0, "Eigenvalues of the covariance of the input (only the leading ones if computed with randomized PCA)."},
 	{0}
 };
 
@@ -2035,7 +2073,7 @@ PyTypeObject PCAPreconditioner_type = {
 };
 
 static PyGetSetDef PCATransform_getset[] = {
-	{"eigenvalues", (getter)PCATransform_eigenvalues, 0, "Eigenvalues of the covariance of the input."},
+	{"eigenvalues", (getter)PCATransform_eigenvalues, 0, "Eigenvalues of the covariance of the input (only the leading ones if computed with randomized PCA)."},
 	{0}
 };
 
@@ -2136,6 +2174,118 @@ PyTypeObject BinningTransform_type = {
 	Preconditioner_new,                 /*tp_new*/
 };
 
+static PyGetSetDef Moments_getset[] = {
+	{"dim_in", (getter)Moments_dim_in, 0, "Dimensionality of inputs."},
+	{"dim_out", (getter)Moments_dim_out, 0, "Dimensionality of outputs."},
+	{"num_data", (getter)Moments_num_data, 0, "Number of data points seen so far."},
+	{"mean_in", (getter)Moments_mean_in, 0, "Mean of inputs."},
+	{"mean_out", (getter)Moments_mean_out, 0, "Mean of outputs."},
+	{"cov_xx", (getter)Moments_cov_xx, 0, "Covariance of inputs."},
+	{"cov_yx", (getter)Moments_cov_yx, 0, "Cross-covariance of outputs and inputs."},
+	{"cov_yy", (getter)Moments_cov_yy, 0, "Covariance of outputs."},
+	{0}
+};
+
+static PyMethodDef Moments_methods[] = {
+	{"update", (PyCFunction)Moments_update, METH_VARARGS | METH_KEYWORDS, Moments_update_doc},
+	{0}
+};
+
+PyTypeObject Moments_type = {
+	PyVarObject_HEAD_INIT(0, 0)
+	"cmt.utils.Moments",           /*tp_name*/
+	sizeof(MomentsObject),         /*tp_basicsize*/
+	0,                             /*tp_itemsize*/
+	(destructor)Moments_dealloc,   /*tp_dealloc*/
+	0,                             /*tp_print*/
+	0,                             /*tp_getattr*/
+	0,                             /*tp_setattr*/
+	0,                             /*tp_compare*/
+	0,                             /*tp_repr*/
+	0,                             /*tp_as_number*/
+	0,                             /*tp_as_sequence*/
+	0,                             /*tp_as_mapping*/
+	0,                             /*tp_hash */
+	0,                             /*tp_call*/
+	0,                             /*tp_str*/
+	0,                             /*tp_getattro*/
+	0,                             /*tp_setattro*/
+	0,                             /*tp_as_buffer*/
+	Py_TPFLAGS_DEFAULT,            /*tp_flags*/
+	Moments_doc,                   /*tp_doc*/
+	0,                             /*tp_traverse*/
+	0,                             /*tp_clear*/
+	0,                             /*tp_richcompare*/
+	0,                             /*tp_weaklistoffset*/
+	0,                             /*tp_iter*/
+	0,                             /*tp_iternext*/
+	Moments_methods,               /*tp_methods*/
+	0,                             /*tp_members*/
+	Moments_getset,                /*tp_getset*/
+	0,                             /*tp_base*/
+	0,                             /*tp_dict*/
+	0,                             /*tp_descr_get*/
+	0,                             /*tp_descr_set*/
+	0,                             /*tp_dictoffset*/
+	(initproc)Moments_init,        /*tp_init*/
+	0,                             /*tp_alloc*/
+	Moments_new,                   /*tp_new*/
+};
+
+static PyGetSetDef ImageDataLoader_getset[] = {
+	{"dim_in", (getter)ImageDataLoader_dim_in, 0, "Dimensionality of inputs."},
+	{"dim_out", (getter)ImageDataLoader_dim_out, 0, "Dimensionality of outputs."},
+	{"batch_size", (getter)ImageDataLoader_batch_size, 0, "Number of input/output pairs per batch."},
+	{"num_locations", (getter)ImageDataLoader_num_locations, 0, "Number of locations inputs and outputs are drawn from."},
+	{0}
+};
+
+static PyMethodDef ImageDataLoader_methods[] = {
+	{"next", (PyCFunction)ImageDataLoader_next, METH_NOARGS, ImageDataLoader_next_doc},
+	{0}
+};
+
+PyTypeObject ImageDataLoader_type = {
+	PyVarObject_HEAD_INIT(0, 0)
+	"cmt.tools.ImageDataLoader",           /*tp_name*/
+	sizeof(ImageDataLoaderObject),         /*tp_basicsize*/
+	0,                                     /*tp_itemsize*/
+	(destructor)ImageDataLoader_dealloc,   /*tp_dealloc*/
+	0,                                     /*tp_print*/
+	0,                                     /*tp_getattr*/
+	0,                                     /*tp_setattr*/
+	0,                                     /*tp_compare*/
+	0,                                     /*tp_repr*/
+	0,                                     /*tp_as_number*/
+	0,                                     /*tp_as_sequence*/
+	0,                                     /*tp_as_mapping*/
+	0,                                     /*tp_hash */
+	0,                                     /*tp_call*/
+	0,                                     /*tp_str*/
+	0,                                     /*tp_getattro*/
+	0,                                     /*tp_setattro*/
+	0,                                     /*tp_as_buffer*/
+	Py_TPFLAGS_DEFAULT,                    /*tp_flags*/
+	ImageDataLoader_doc,                   /*tp_doc*/
+	0,                                     /*tp_traverse*/
+	0,                                     /*tp_clear*/
+	0,                                     /*tp_richcompare*/
+	0,                                     /*tp_weaklistoffset*/
+	PyObject_SelfIter,                     /*tp_iter*/
+	(iternextfunc)ImageDataLoader_next,    /*tp_iternext*/
+	ImageDataLoader_methods,               /*tp_methods*/
+	0,                                     /*tp_members*/
+	ImageDataLoader_getset,                /*tp_getset*/
+	0,                                     /*tp_base*/
+	0,                                     /*tp_dict*/
+	0,                                     /*tp_descr_get*/
+	0,                                     /*tp_descr_set*/
+	0,                                     /*tp_dictoffset*/
+	(initproc)ImageDataLoader_init,        /*tp_init*/
+	0,                                     /*tp_alloc*/
+	ImageDataLoader_new,                   /*tp_new*/
+};
+
 static const char* cmt_doc =
 	"This module provides fast implementations of different probabilistic models.";
 
@@ -2145,7 +2295,7 @@ PyObject* seed(PyObject* self, PyObject* args, PyObject* kwds) {
 	if(!PyArg_ParseTuple(args, "i", &seed))
 		return 0;
 
-	srand(seed);
+	CMT::seed(seed);
 
 	Py_INCREF(Py_None);
 	return Py_None;
@@ -2157,12 +2307,16 @@ static PyMethodDef cmt_methods[] = {
 	{"generate_data_from_image", (PyCFunction)generate_data_from_image, METH_VARARGS | METH_KEYWORDS, generate_data_from_image_doc},
 	{"generate_data_from_video", (PyCFunction)generate_data_from_video, METH_VARARGS | METH_KEYWORDS, generate_data_from_video_doc},
 	{"density_gradient", (PyCFunction)density_gradient, METH_VARARGS | METH_KEYWORDS, density_gradient_doc},
+	{"evaluate_image", (PyCFunction)evaluate_image, METH_VARARGS | METH_KEYWORDS, evaluate_image_doc},
 	{"sample_image", (PyCFunction)sample_image, METH_VARARGS | METH_KEYWORDS, sample_image_doc},
+	{"sample_images", (PyCFunction)sample_images, METH_VARARGS | METH_KEYWORDS, sample_images_doc},
 	{"sample_image_conditionally", (PyCFunction)sample_image_conditionally, METH_VARARGS | METH_KEYWORDS, sample_image_conditionally_doc},
 	{"sample_labels_conditionally", (PyCFunction)sample_labels_conditionally, METH_VARARGS | METH_KEYWORDS, sample_labels_conditionally_doc},
 	{"sample_video", (PyCFunction)sample_video, METH_VARARGS | METH_KEYWORDS, sample_video_doc},
 	{"fill_in_image", (PyCFunction)fill_in_image, METH_VARARGS | METH_KEYWORDS, fill_in_image_doc},
 	{"fill_in_image_map", (PyCFunction)fill_in_image_map, METH_VARARGS | METH_KEYWORDS, 0},
+	{"encode_image", (PyCFunction)encode_image, METH_VARARGS | METH_KEYWORDS, encode_image_doc},
+	{"decode_image", (PyCFunction)decode_image, METH_VARARGS | METH_KEYWORDS, decode_image_doc},
 	{"extract_windows", (PyCFunction)extract_windows, METH_VARARGS | METH_KEYWORDS, extract_windows_doc},
 	{"sample_spike_train", (PyCFunction)sample_spike_train, METH_VARARGS | METH_KEYWORDS, sample_spike_train_doc},
 	{0}
@@ -2231,6 +2385,10 @@ PyMODINIT_FUNC init_cmt() {
 		return RETVAL;
 	if(PyType_Ready(&GSM_type) < 0)
 		return RETVAL;
+	if(PyType_Ready(&ImageDataLoader_type) < 0)
+		return RETVAL;
+	if(PyType_Ready(&Moments_type) < 0)
+		return RETVAL;
 	if(PyType_Ready(&InvertibleNonlinearity_type) < 0)
 		return RETVAL;
 	if(PyType_Ready(&HistogramNonlinearity_type) < 0)
@@ -2241,6 +2399,8 @@ PyMODINIT_FUNC init_cmt() {
 		return RETVAL;
 	if(PyType_Ready(&MCGSM_type) < 0)
 		return RETVAL;
+	if(PyType_Ready(&MCGSMIntermediates_type) < 0)
+		return RETVAL;
 	if(PyType_Ready(&Mixture_type) < 0)
 		return RETVAL;
 	if(PyType_Ready(&MixtureComponent_type) < 0)
@@ -2296,6 +2456,8 @@ PyMODINIT_FUNC init_cmt() {
 	Py_INCREF(&GLM_type);
 	Py_INCREF(&GSM_type);
 	Py_INCREF(&HistogramNonlinearity_type);
+	Py_INCREF(&ImageDataLoader_type);
+	Py_INCREF(&Moments_type);
 	Py_INCREF(&InvertibleNonlinearity_type);
 	Py_INCREF(&LogisticFunction_type);
 	Py_INCREF(&MCBM_type);
@@ -2333,6 +2495,8 @@ PyMODINIT_FUNC init_cmt() {
 	PyModule_AddObject(module, "GLM", reinterpret_cast<PyObject*>(&GLM_type));
 	PyModule_AddObject(module, "GSM", reinterpret_cast<PyObject*>(&GSM_type));
 	PyModule_AddObject(module, "HistogramNonlinearity", reinterpret_cast<PyObject*>(&HistogramNonlinearity_type));
+	PyModule_AddObject(module, "ImageDataLoader", reinterpret_cast<PyObject*>(&ImageDataLoader_type));
+	PyModule_AddObject(module, "Moments", reinterpret_cast<PyObject*>(&Moments_type));
 	PyModule_AddObject(module, "InvertibleNonlinearity", reinterpret_cast<PyObject*>(&InvertibleNonlinearity_type));
 	PyModule_AddObject(module, "LogisticFunction", reinterpret_cast<PyObject*>(&LogisticFunction_type));
 	PyModule_AddObject(module, "MCBM", reinterpret_cast<PyObject*>(&MCBM_type));
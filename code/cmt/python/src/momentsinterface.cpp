@@ -0,0 +1,187 @@
+#include "momentsinterface.h"
+
+#include "cmt/utils"
+using CMT::Exception;
+
+#if PY_MAJOR_VERSION >= 3
+	#define PyInt_FromLong PyLong_FromLong
+#endif
+
+PyObject* Moments_new(PyTypeObject* type, PyObject*, PyObject*) {
+	PyObject* self = type->tp_alloc(type, 0);
+
+	// valid but empty until initialized
+	if(self)
+		reinterpret_cast<MomentsObject*>(self)->moments = new Moments(0, 0);
+
+	return self;
+}
+
+
+
+const char* Moments_doc =
+	"Accumulates means and covariances of inputs and outputs from a stream of data.\n"
+	"\n"
+	"Only the statistics are kept in memory, so that moments of datasets which do not\n"
+	"fit into memory can be computed chunk by chunk. Moments of different chunks can\n"
+	"also be computed separately and merged afterwards.\n"
+	"\n"
+	"Example:\n"
+	"\n"
+	"\t>>> moments = Moments(dim_in, dim_out)\n"
+	"\t>>> for input, output in chunks:\n"
+	"\t>>> \tmoments.update(input, output)\n"
+	"\n"
+	"@type  dim_in: C{int}\n"
+	"@param dim_in: dimensionality of inputs\n"
+	"\n"
+	"@type  dim_out: C{int}\n"
+	"@param dim_out: dimensionality of outputs";
+
+int Moments_init(MomentsObject* self, PyObject* args, PyObject* kwds) {
+	const char* kwlist[] = {"dim_in", "dim_out", 0};
+
+	int dim_in;
+	int dim_out = 0;
+
+	if(!PyArg_ParseTupleAndKeywords(args, kwds, "i|i", const_cast<char**>(kwlist), &dim_in, &dim_out))
+		return -1;
+
+	try {
+		Moments* moments = new Moments(dim_in, dim_out);
+		delete self->moments;
+		self->moments = moments;
+	} catch(Exception exception) {
+		PyErr_SetString(PyExc_RuntimeError, exception.message());
+		return -1;
+	}
+
+	return 0;
+}
+
+
+
+void Moments_dealloc(MomentsObject* self) {
+	delete self->moments;
+
+	Py_TYPE(self)->tp_free(reinterpret_cast<PyObject*>(self));
+}
+
+
+
+PyObject* Moments_dim_in(MomentsObject* self, void*) {
+	return PyInt_FromLong(self->moments->dimIn());
+}
+
+
+
+PyObject* Moments_dim_out(MomentsObject* self, void*) {
+	return PyInt_FromLong(self->moments->dimOut());
+}
+
+
+
+PyObject* Moments_num_data(MomentsObject* self, void*) {
+	return PyFloat_FromDouble(self->moments->numData());
+}
+
+
+
+PyObject* Moments_mean_in(MomentsObject* self, void*) {
+	return PyArray_FromMatrixXd(self->moments->meanIn());
+}
+
+
+
+PyObject* Moments_mean_out(MomentsObject* self, void*) {
+	return PyArray_FromMatrixXd(self->moments->meanOut());
+}
+
+
+
+PyObject* Moments_cov_xx(MomentsObject* self, void*) {
+	return PyArray_FromMatrixXd(self->moments->covXX());
+}
+
+
+
+PyObject* Moments_cov_yx(MomentsObject* self, void*) {
+	return PyArray_FromMatrixXd(self->moments->covYX());
+}
+
+
+
+PyObject* Moments_cov_yy(MomentsObject* self, void*) {
+	return PyArray_FromMatrixXd(self->moments->covYY());
+}
+
+
+
+const char* Moments_update_doc =
+	"update(self, input, output=None)\n"
+	"\n"
+	"Adds a chunk of data or the statistics of another L{Moments} object.\n"
+	"\n"
+	"If no outputs are given, the rows of C{input} are expected to contain inputs\n"
+	"followed by outputs.\n"
+	"\n"
+	"@type  input: C{ndarray}/L{Moments}\n"
+	"@param input: inputs stored in columns or moments to merge\n"
+	"\n"
+	"@type  output: C{ndarray}\n"
+	"@param output: outputs stored in columns";
+
+PyObject* Moments_update(MomentsObject* self, PyObject* args, PyObject* kwds) {
+	const char* kwlist[] = {"input", "output", 0};
+
+	PyObject* input;
+	PyObject* output = 0;
+
+	if(!PyArg_ParseTupleAndKeywords(args, kwds, "O|O", const_cast<char**>(kwlist), &input, &output))
+		return 0;
+
+	if(output == Py_None)
+		output = 0;
+
+	if(PyObject_IsInstance(input, reinterpret_cast<PyObject*>(&Moments_type))) {
+		try {
+			self->moments->update(*reinterpret_cast<MomentsObject*>(input)->moments);
+		} catch(Exception exception) {
+			PyErr_SetString(PyExc_RuntimeError, exception.message());
+			return 0;
+		}
+
+		Py_INCREF(Py_None);
+		return Py_None;
+	}
+
+	input = PyArray_FROM_OTF(input, NPY_DOUBLE, NPY_F_CONTIGUOUS | NPY_ALIGNED);
+
+	if(output)
+		output = PyArray_FROM_OTF(output, NPY_DOUBLE, NPY_F_CONTIGUOUS | NPY_ALIGNED);
+
+	if(!input || (!output && PyErr_Occurred())) {
+		Py_XDECREF(input);
+		Py_XDECREF(output);
+		PyErr_SetString(PyExc_TypeError, "Data has to be stored in NumPy arrays.");
+		return 0;
+	}
+
+	try {
+		if(output)
+			self->moments->update(PyArray_ToMatrixXd(input), PyArray_ToMatrixXd(output));
+		else
+			self->moments->update(PyArray_ToMatrixXd(input));
+	} catch(Exception exception) {
+		Py_DECREF(input);
+		Py_XDECREF(output);
+		PyErr_SetString(PyExc_RuntimeError, exception.message());
+		return 0;
+	}
+
+	Py_DECREF(input);
+	Py_XDECREF(output);
+
+	Py_INCREF(Py_None);
+	return Py_None;
+}
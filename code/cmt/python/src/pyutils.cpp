@@ -322,6 +322,47 @@ PyObject* PyArray_FromArraysXXd(const vector<ArrayXXd>& channels) {
 
 
 
+/**
+ * Checks whether an array is a matrix of doubles whose columns are contiguous and overlap in
+ * memory, as is the case for windows returned by extract_windows.
+ */
+bool PyArray_IsWindowView(PyObject* array) {
+	#ifdef EIGEN_DEFAULT_TO_ROW_MAJOR
+	return false;
+	#else
+	if(!PyArray_Check(array) || PyArray_NDIM(array) != 2 || PyArray_TYPE(array) != NPY_DOUBLE)
+		return false;
+
+	// contiguous arrays are handled as usual
+	if(!PyArray_ISALIGNED(array) || PyArray_FLAGS(array) & NPY_F_CONTIGUOUS)
+		return false;
+
+	if(PyArray_DIM(array, 0) < 1 || PyArray_DIM(array, 1) < 1)
+		return false;
+
+	// columns which don't overlap are copied as usual
+	return PyArray_STRIDE(array, 0) == sizeof(double)
+		&& PyArray_STRIDE(array, 1) > 0
+		&& PyArray_STRIDE(array, 1) < PyArray_DIM(array, 0) * static_cast<npy_intp>(sizeof(double))
+		&& PyArray_STRIDE(array, 1) % sizeof(double) == 0;
+	#endif
+}
+
+
+
+WindowView PyArray_ToWindowView(PyObject* array) {
+	if(!PyArray_IsWindowView(array))
+		throw Exception("Columns of the array must be stored in contiguous memory.");
+
+	return WindowView(
+		reinterpret_cast<const double*>(PyArray_DATA(array)),
+		PyArray_DIM(array, 0),
+		PyArray_DIM(array, 1),
+		Eigen::OuterStride<>(PyArray_STRIDE(array, 1) / sizeof(double)));
+}
+
+
+
 Tuples PyList_AsTuples(PyObject* list) {
 	if(!PyList_Check(list))
 		throw Exception("Indices should be given in a list.");
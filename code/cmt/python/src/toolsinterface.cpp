@@ -13,12 +13,16 @@ using CMT::ConditionalDistribution;
 #include "cmt/tools"
 using CMT::generateDataFromImage;
 using CMT::generateDataFromVideo;
+using CMT::evaluateImage;
 using CMT::sampleImage;
+using CMT::sampleImages;
 using CMT::sampleVideo;
 using CMT::fillInImage;
 using CMT::fillInImageMAP;
 using CMT::extractWindows;
 using CMT::sampleSpikeTrain;
+using CMT::encodeImage;
+using CMT::decodeImage;
 
 #include <utility>
 using std::pair;
@@ -389,6 +393,129 @@ PyObject* density_gradient(PyObject* self, PyObject* args, PyObject* kwds) {
 }
 
 
+const char* evaluate_image_doc =
+	"evaluate_image(img, model, input_mask, output_mask, preconditioner=None)\n"
+	"\n"
+	"Computes the average negative log-likelihood of all neighborhoods of an image in bits per\n"
+	"output component. The result is the same as evaluating the model on the output of\n"
+	"L{generate_data_from_image}, but neighborhoods are extracted and evaluated in small tiles,\n"
+	"so that the memory required does not grow with the size of the image.\n"
+	"\n"
+	"@type  img: C{ndarray}\n"
+	"@param img: an array representing a grayscale or color image\n"
+	"\n"
+	"@type  model: L{ConditionalDistribution<models.ConditionalDistribution>}\n"
+	"@param model: a conditional distribution such as an L{MCGSM<models.MCGSM>}\n"
+	"\n"
+	"@type  input_mask: C{ndarray}\n"
+	"@param input_mask: a Boolean array describing the input pixels\n"
+	"\n"
+	"@type  output_mask: C{ndarray}\n"
+	"@param output_mask: a Boolean array describing the output pixels\n"
+	"\n"
+	"@type  preconditioner: L{Preconditioner<transforms.Preconditioner>}\n"
+	"@param preconditioner: transforms the input before feeding it into the model\n"
+	"\n"
+	"@rtype: C{float}\n"
+	"@return: average negative log-likelihood in bits per component";
+
+PyObject* evaluate_image(PyObject* self, PyObject* args, PyObject* kwds) {
+	const char* kwlist[] = {"img", "model", "input_mask", "output_mask", "preconditioner", 0};
+
+	PyObject* img;
+	PyObject* modelObj;
+	PyObject* input_mask;
+	PyObject* output_mask;
+	PyObject* preconditionerObj = 0;
+
+	if(!PyArg_ParseTupleAndKeywords(args, kwds, "OO!OO|O", const_cast<char**>(kwlist),
+		&img, &CD_type, &modelObj, &input_mask, &output_mask, &preconditionerObj))
+		return 0;
+
+	if(preconditionerObj == Py_None)
+		preconditionerObj = 0;
+
+	if(preconditionerObj && !PyObject_IsInstance(preconditionerObj, reinterpret_cast<PyObject*>(&Preconditioner_type))) {
+		PyErr_SetString(PyExc_TypeError, "`preconditioner` has to be of type `Preconditioner`.");
+		return 0;
+	}
+
+	const ConditionalDistribution& model = *reinterpret_cast<CDObject*>(modelObj)->cd;
+
+	Preconditioner* preconditioner = preconditionerObj ?
+		reinterpret_cast<PreconditionerObject*>(preconditionerObj)->preconditioner : 0;
+
+	// make sure data is stored in NumPy array
+	img = PyArray_FROM_OTF(img, NPY_DOUBLE, NPY_F_CONTIGUOUS | NPY_ALIGNED);
+	input_mask = PyArray_FROM_OTF(input_mask, NPY_BOOL, NPY_F_CONTIGUOUS | NPY_ALIGNED);
+	output_mask = PyArray_FROM_OTF(output_mask, NPY_BOOL, NPY_F_CONTIGUOUS | NPY_ALIGNED);
+
+	if(!img) {
+		Py_XDECREF(input_mask);
+		Py_XDECREF(output_mask);
+		PyErr_SetString(PyExc_TypeError, "The image has to be given as an array.");
+		return 0;
+	}
+
+	if(!input_mask || !output_mask) {
+		Py_DECREF(img);
+		Py_XDECREF(input_mask);
+		Py_XDECREF(output_mask);
+		PyErr_SetString(PyExc_TypeError, "Masks have to be given as Boolean arrays.");
+		return 0;
+	}
+
+	try {
+		double result;
+
+		if(PyArray_NDIM(img) > 2) {
+			vector<ArrayXXd> channels = PyArray_ToArraysXXd(img);
+
+			if(PyArray_NDIM(input_mask) > 2 && PyArray_NDIM(output_mask) > 2)
+				// multi-channel image and multi-channel masks
+				result = evaluateImage(
+					channels,
+					model,
+					PyArray_ToArraysXXb(input_mask),
+					PyArray_ToArraysXXb(output_mask),
+					preconditioner);
+			else
+				// multi-channel image and single-channel masks
+				result = evaluateImage(
+					channels,
+					model,
+					vector<ArrayXXb>(channels.size(), PyArray_ToMatrixXb(input_mask)),
+					vector<ArrayXXb>(channels.size(), PyArray_ToMatrixXb(output_mask)),
+					preconditioner);
+		} else {
+			// single-channel image and single-channel masks
+			result = evaluateImage(
+				PyArray_ToMatrixXd(img),
+				model,
+				PyArray_ToMatrixXb(input_mask),
+				PyArray_ToMatrixXb(output_mask),
+				preconditioner);
+		}
+
+		Py_DECREF(img);
+		Py_DECREF(input_mask);
+		Py_DECREF(output_mask);
+
+		return PyFloat_FromDouble(result);
+
+	} catch(Exception& exception) {
+		Py_DECREF(img);
+		Py_DECREF(input_mask);
+		Py_DECREF(output_mask);
+		PyErr_SetString(PyExc_RuntimeError, exception.message());
+		return 0;
+	}
+
+	return 0;
+}
+
+
+
 const char* sample_image_doc =
 	"sample_image(img, model, input_mask, output_mask, preconditioner=None, min_value=-inf, max_value=inf)\n"
 	"\n"
@@ -524,14 +651,14 @@ PyObject* sample_image(PyObject* self, PyObject* args, PyObject* kwds) {
 			double minValue = -numeric_limits<double>::infinity();
 			double maxValue = numeric_limits<double>::infinity();
 
-			if(PySequence_Check(min_value) && PySequence_Length(min_value) > 0) {
+			if(min_value && PySequence_Check(min_value) && PySequence_Length(min_value) > 0) {
 				PyObject* item = PySequence_GetItem(min_value, 0);
 				if(PyFloat_Check(item))
 					minValue = PyFloat_AsDouble(item);
 				else if(PyInt_Check(item))
 					minValue = static_cast<double>(PyInt_AsLong(item));
 			}
-			if(PySequence_Check(max_value) && PySequence_Length(max_value) > 0) {
+			if(max_value && PySequence_Check(max_value) && PySequence_Length(max_value) > 0) {
 				PyObject* item = PySequence_GetItem(max_value, 0);
 				if(PyFloat_Check(item))
 					maxValue = PyFloat_AsDouble(item);
@@ -579,6 +706,137 @@ PyObject* sample_image(PyObject* self, PyObject* args, PyObject* kwds) {
 
 
 
+const char* sample_images_doc =
+	"sample_images(imgs, model, input_mask, output_mask, preconditioner=None, min_value=-inf, max_value=inf)\n"
+	"\n"
+	"Generates multiple images using a conditional distribution. This is equivalent to calling\n"
+	"L{sample_image} on each image, but all images are generated in lockstep so that the model\n"
+	"is applied to many inputs at once. All images need to be of the same size.\n"
+	"\n"
+	"@type  imgs: C{list}\n"
+	"@param imgs: initializations of images\n"
+	"\n"
+	"@type  model: L{ConditionalDistribution<models.ConditionalDistribution>}\n"
+	"@param model: a conditional distribution such as an L{MCGSM<models.MCGSM>}\n"
+	"\n"
+	"@type  input_mask: C{ndarray}\n"
+	"@param input_mask: a Boolean array describing the input pixels\n"
+	"\n"
+	"@type  output_mask: C{ndarray}\n"
+	"@param output_mask: a Boolean array describing the output pixels\n"
+	"\n"
+	"@type  preconditioner: L{Preconditioner<transforms.Preconditioner>}\n"
+	"@param preconditioner: transforms the input before feeding it into the model\n"
+	"\n"
+	"@type  min_value: C{float}\n"
+	"@param min_value: sampled pixels are clipped from below\n"
+	"\n"
+	"@type  max_value: C{float}\n"
+	"@param max_value: sampled pixels are clipped from above\n"
+	"\n"
+	"@rtype: C{list}\n"
+	"@return: the sampled images";
+
+PyObject* sample_images(PyObject* self, PyObject* args, PyObject* kwds) {
+	const char* kwlist[] = {"imgs", "model", "input_mask", "output_mask", "preconditioner", "min_value", "max_value", 0};
+
+	PyObject* imgs;
+	PyObject* modelObj;
+	PyObject* input_mask;
+	PyObject* output_mask;
+	PyObject* preconditionerObj = 0;
+	double minValue = -numeric_limits<double>::infinity();
+	double maxValue = numeric_limits<double>::infinity();
+
+	if(!PyArg_ParseTupleAndKeywords(args, kwds, "OO!OO|Odd", const_cast<char**>(kwlist),
+		&imgs, &CD_type, &modelObj, &input_mask, &output_mask, &preconditionerObj, &minValue, &maxValue))
+		return 0;
+
+	if(preconditionerObj == Py_None)
+		preconditionerObj = 0;
+
+	if(preconditionerObj && !PyObject_IsInstance(preconditionerObj, reinterpret_cast<PyObject*>(&Preconditioner_type))) {
+		PyErr_SetString(PyExc_TypeError, "`preconditioner` should be of type `Preconditioner`.");
+		return 0;
+	}
+
+	if(!PySequence_Check(imgs)) {
+		PyErr_SetString(PyExc_TypeError, "Images have to be given in a list.");
+		return 0;
+	}
+
+	const ConditionalDistribution& model = *reinterpret_cast<CDObject*>(modelObj)->cd;
+
+	Preconditioner* preconditioner = preconditionerObj ?
+		reinterpret_cast<PreconditionerObject*>(preconditionerObj)->preconditioner : 0;
+
+	vector<ArrayXXd> images;
+
+	for(Py_ssize_t i = 0; i < PySequence_Length(imgs); ++i) {
+		PyObject* item = PySequence_GetItem(imgs, i);
+		PyObject* img = PyArray_FROM_OTF(item, NPY_DOUBLE, NPY_F_CONTIGUOUS | NPY_ALIGNED);
+
+		Py_XDECREF(item);
+
+		if(!img || PyArray_NDIM(img) != 2) {
+			Py_XDECREF(img);
+			PyErr_SetString(PyExc_TypeError, "Images have to be given as two-dimensional arrays.");
+			return 0;
+		}
+
+		images.push_back(PyArray_ToMatrixXd(img));
+
+		Py_DECREF(img);
+	}
+
+	// make sure data is stored in NumPy array
+	input_mask = PyArray_FROM_OTF(input_mask, NPY_BOOL, NPY_F_CONTIGUOUS | NPY_ALIGNED);
+	output_mask = PyArray_FROM_OTF(output_mask, NPY_BOOL, NPY_F_CONTIGUOUS | NPY_ALIGNED);
+
+	if(!input_mask || !output_mask) {
+		Py_XDECREF(input_mask);
+		Py_XDECREF(output_mask);
+		PyErr_SetString(PyExc_TypeError, "Masks have to be given as Boolean arrays.");
+		return 0;
+	}
+
+	try {
+		images = sampleImages(
+			images,
+			model,
+			PyArray_ToMatrixXb(input_mask),
+			PyArray_ToMatrixXb(output_mask),
+			preconditioner,
+			minValue,
+			maxValue);
+
+		Py_DECREF(input_mask);
+		Py_DECREF(output_mask);
+
+		PyObject* list = PyList_New(images.size());
+
+		for(int i = 0; i < images.size(); ++i)
+			PyList_SetItem(list, i, PyArray_FromMatrixXd(images[i]));
+
+		return list;
+
+	} catch(Exception& exception) {
+		Py_DECREF(input_mask);
+		Py_DECREF(output_mask);
+		PyErr_SetString(PyExc_RuntimeError, exception.message());
+		return 0;
+	} catch(bad_alloc&) {
+		Py_DECREF(input_mask);
+		Py_DECREF(output_mask);
+		PyErr_SetString(PyExc_RuntimeError, "Could not allocate memory.");
+		return 0;
+	}
+
+	return 0;
+}
+
+
+
 const char* sample_image_conditionally_doc =
 	"sample_image(img, model, labels, input_mask, output_mask, preconditioner=None, num_iter=10, initialize=False)\n"
 	"\n"
@@ -607,7 +865,7 @@ const char* sample_image_conditionally_doc =
 	"@param num_iter: the number of Gibbs updates of each pixel\n"
 	"\n"
 	"@type  initialize: C{bool}\n"
-	"@param initialize: if true, accept all proposed pixel updates in the first iteration\n"
+	"@param initialize: if true, sample pixels in raster order and accept all proposed updates in the first iteration\n"
 	"\n"
 	"@rtype: C{ndarray}\n"
 	"@return: the sampled image";
@@ -992,7 +1250,8 @@ PyObject* sample_video(PyObject* self, PyObject* args, PyObject* kwds) {
 const char* fill_in_image_doc =
 	"fill_in_image(img, model, input_mask, output_mask, fmask, preconditioner=None, num_iter=10, num_steps=100)\n"
 	"\n"
-	"Samples pixels of an image conditioned on all other pixels.\n"
+	"Samples pixels of an image conditioned on all other pixels. Each pixel is updated\n"
+	"with a multiple-try Metropolis step, whose proposals are evaluated together.\n"
 	"\n"
 	"@type  img: C{ndarray}\n"
 	"@param img: the image with the missing pixels initialized somehow\n"
@@ -1016,7 +1275,7 @@ const char* fill_in_image_doc =
 	"@param num_iter: number of iterations of replacing all pixels\n"
 	"\n"
 	"@type  num_steps: C{int}\n"
-	"@param num_steps: number of Metropolis steps per pixel and iteration\n"
+	"@param num_steps: number of proposals per pixel and iteration\n"
 	"\n"
 	"@rtype: C{ndarray}\n"
 	"@return: an image with the missing pixels replaced";
@@ -1207,6 +1466,227 @@ PyObject* fill_in_image_map(PyObject* self, PyObject* args, PyObject* kwds) {
 
 
 
+const char* encode_image_doc =
+	"encode_image(img, model, input_mask, output_mask, preconditioner=None, bit_depth=8)\n"
+	"\n"
+	"Losslessly compresses an image with an arithmetic coder driven by the conditional\n"
+	"distributions of an MCGSM. The probability of a pixel value is the probability mass the\n"
+	"model assigns to an interval of width one around it.\n"
+	"\n"
+	"The input mask has to be causal, that is, all input pixels have to precede the output pixel\n"
+	"in raster-scan order. Pixels without a complete neighborhood are stored with $n$ bits each,\n"
+	"where $n$ is the bit depth.\n"
+	"\n"
+	"The model, masks and preconditioner are not stored and have to be passed to\n"
+	"L{decode_image} again.\n"
+	"\n"
+	"@type  img: C{ndarray}\n"
+	"@param img: a grayscale image with integer pixel values between 0 and $2^n - 1$\n"
+	"\n"
+	"@type  model: L{MCGSM<models.MCGSM>}\n"
+	"@param model: a model of pixels given their causal neighborhood\n"
+	"\n"
+	"@type  input_mask: C{ndarray}\n"
+	"@param input_mask: a Boolean array describing the input pixels\n"
+	"\n"
+	"@type  output_mask: C{ndarray}\n"
+	"@param output_mask: a Boolean array describing the output pixel\n"
+	"\n"
+	"@type  preconditioner: L{Preconditioner<transforms.Preconditioner>}\n"
+	"@param preconditioner: an affine preconditioner used to train the model\n"
+	"\n"
+	"@type  bit_depth: C{int}\n"
+	"@param bit_depth: number of bits per pixel of the raw image, at most 12\n"
+	"\n"
+	"@rtype: C{bytes}\n"
+	"@return: the compressed image";
+
+PyObject* encode_image(PyObject* self, PyObject* args, PyObject* kwds) {
+	const char* kwlist[] = {"img", "model", "input_mask", "output_mask", "preconditioner", "bit_depth", 0};
+
+	PyObject* img;
+	PyObject* modelObj;
+	PyObject* input_mask;
+	PyObject* output_mask;
+	PyObject* preconditionerObj = 0;
+	int bit_depth = 8;
+
+	if(!PyArg_ParseTupleAndKeywords(args, kwds, "OO!OO|Oi", const_cast<char**>(kwlist),
+		&img, &MCGSM_type, &modelObj, &input_mask, &output_mask, &preconditionerObj, &bit_depth))
+		return 0;
+
+	if(preconditionerObj == Py_None)
+		preconditionerObj = 0;
+
+	if(preconditionerObj && !PyObject_IsInstance(preconditionerObj, reinterpret_cast<PyObject*>(&Preconditioner_type))) {
+		PyErr_SetString(PyExc_TypeError, "`preconditioner` has to be of type `Preconditioner`.");
+		return 0;
+	}
+
+	const MCGSM& model = *reinterpret_cast<MCGSMObject*>(modelObj)->mcgsm;
+
+	Preconditioner* preconditioner = preconditionerObj ?
+		reinterpret_cast<PreconditionerObject*>(preconditionerObj)->preconditioner : 0;
+
+	// make sure data is stored in NumPy array
+	img = PyArray_FROM_OTF(img, NPY_INT64, NPY_F_CONTIGUOUS | NPY_ALIGNED);
+	input_mask = PyArray_FROM_OTF(input_mask, NPY_BOOL, NPY_F_CONTIGUOUS | NPY_ALIGNED);
+	output_mask = PyArray_FROM_OTF(output_mask, NPY_BOOL, NPY_F_CONTIGUOUS | NPY_ALIGNED);
+
+	if(!img) {
+		Py_XDECREF(input_mask);
+		Py_XDECREF(output_mask);
+		PyErr_SetString(PyExc_TypeError, "The image has to be given as an integer array.");
+		return 0;
+	}
+
+	if(!input_mask || !output_mask) {
+		Py_DECREF(img);
+		Py_XDECREF(input_mask);
+		Py_XDECREF(output_mask);
+		PyErr_SetString(PyExc_TypeError, "Masks have to be given as Boolean arrays.");
+		return 0;
+	}
+
+	try {
+		// large values would wrap around when converted to int and could no longer be rejected
+		const npy_int64* pixels = reinterpret_cast<const npy_int64*>(PyArray_DATA(img));
+
+		for(npy_intp i = 0; i < PyArray_SIZE(img); ++i)
+			if(pixels[i] < 0 || pixels[i] > numeric_limits<int>::max())
+				throw Exception("Pixel values have to lie between 0 and 2^bitDepth - 1.");
+
+		vector<unsigned char> data = encodeImage(
+			PyArray_ToMatrixXi(img).array(),
+			model,
+			PyArray_ToMatrixXb(input_mask),
+			PyArray_ToMatrixXb(output_mask),
+			preconditioner,
+			bit_depth);
+
+		Py_DECREF(img);
+		Py_DECREF(input_mask);
+		Py_DECREF(output_mask);
+
+		return PyBytes_FromStringAndSize(reinterpret_cast<const char*>(data.data()), data.size());
+
+	} catch(Exception& exception) {
+		Py_DECREF(img);
+		Py_DECREF(input_mask);
+		Py_DECREF(output_mask);
+		PyErr_SetString(PyExc_RuntimeError, exception.message());
+		return 0;
+	} catch(bad_alloc&) {
+		Py_DECREF(img);
+		Py_DECREF(input_mask);
+		Py_DECREF(output_mask);
+		PyErr_SetString(PyExc_RuntimeError, "Not enough memory.");
+		return 0;
+	}
+
+	return 0;
+}
+
+
+
+const char* decode_image_doc =
+	"decode_image(data, model, input_mask, output_mask, preconditioner=None)\n"
+	"\n"
+	"Decompresses an image compressed with L{encode_image}. Pixels are decoded wavefront\n"
+	"by wavefront, evaluating the model for all pixels of a wavefront at once.\n"
+	"\n"
+	"@type  data: C{bytes}\n"
+	"@param data: the compressed image\n"
+	"\n"
+	"@type  model: L{MCGSM<models.MCGSM>}\n"
+	"@param model: the model used to compress the image\n"
+	"\n"
+	"@type  input_mask: C{ndarray}\n"
+	"@param input_mask: a Boolean array describing the input pixels\n"
+	"\n"
+	"@type  output_mask: C{ndarray}\n"
+	"@param output_mask: a Boolean array describing the output pixel\n"
+	"\n"
+	"@type  preconditioner: L{Preconditioner<transforms.Preconditioner>}\n"
+	"@param preconditioner: the preconditioner used to compress the image\n"
+	"\n"
+	"@rtype: C{ndarray}\n"
+	"@return: the decompressed image";
+
+PyObject* decode_image(PyObject* self, PyObject* args, PyObject* kwds) {
+	const char* kwlist[] = {"data", "model", "input_mask", "output_mask", "preconditioner", 0};
+
+	PyObject* dataObj;
+	PyObject* modelObj;
+	PyObject* input_mask;
+	PyObject* output_mask;
+	PyObject* preconditionerObj = 0;
+
+	if(!PyArg_ParseTupleAndKeywords(args, kwds, "OO!OO|O", const_cast<char**>(kwlist),
+		&dataObj, &MCGSM_type, &modelObj, &input_mask, &output_mask, &preconditionerObj))
+		return 0;
+
+	if(preconditionerObj == Py_None)
+		preconditionerObj = 0;
+
+	if(preconditionerObj && !PyObject_IsInstance(preconditionerObj, reinterpret_cast<PyObject*>(&Preconditioner_type))) {
+		PyErr_SetString(PyExc_TypeError, "`preconditioner` has to be of type `Preconditioner`.");
+		return 0;
+	}
+
+	char* buffer;
+	Py_ssize_t length;
+
+	if(!PyBytes_Check(dataObj) || PyBytes_AsStringAndSize(dataObj, &buffer, &length) < 0) {
+		PyErr_SetString(PyExc_TypeError, "Data has to be given as bytes.");
+		return 0;
+	}
+
+	const MCGSM& model = *reinterpret_cast<MCGSMObject*>(modelObj)->mcgsm;
+
+	Preconditioner* preconditioner = preconditionerObj ?
+		reinterpret_cast<PreconditionerObject*>(preconditionerObj)->preconditioner : 0;
+
+	input_mask = PyArray_FROM_OTF(input_mask, NPY_BOOL, NPY_F_CONTIGUOUS | NPY_ALIGNED);
+	output_mask = PyArray_FROM_OTF(output_mask, NPY_BOOL, NPY_F_CONTIGUOUS | NPY_ALIGNED);
+
+	if(!input_mask || !output_mask) {
+		Py_XDECREF(input_mask);
+		Py_XDECREF(output_mask);
+		PyErr_SetString(PyExc_TypeError, "Masks have to be given as Boolean arrays.");
+		return 0;
+	}
+
+	try {
+		MatrixXi img = decodeImage(
+			vector<unsigned char>(buffer, buffer + length),
+			model,
+			PyArray_ToMatrixXb(input_mask),
+			PyArray_ToMatrixXb(output_mask),
+			preconditioner).matrix();
+
+		Py_DECREF(input_mask);
+		Py_DECREF(output_mask);
+
+		return PyArray_FromMatrixXi(img);
+
+	} catch(Exception& exception) {
+		Py_DECREF(input_mask);
+		Py_DECREF(output_mask);
+		PyErr_SetString(PyExc_RuntimeError, exception.message());
+		return 0;
+	} catch(bad_alloc&) {
+		Py_DECREF(input_mask);
+		Py_DECREF(output_mask);
+		PyErr_SetString(PyExc_RuntimeError, "Not enough memory.");
+		return 0;
+	}
+
+	return 0;
+}
+
+
+
 const char* extract_windows_doc =
 	"extract_windows(time_series, window_length)\n"
 	"\n"
@@ -1229,6 +1709,11 @@ const char* extract_windows_doc =
 	"\t>>> stm = STM(20, 50, 3, 10)\n"
 	"\t>>> stm.train(inputs, outputs)\n"
 	"\n"
+	"The windows are returned as a read-only view of the time series, so that\n"
+	"no additional memory is required. Models train on such views directly and\n"
+	"only copy a few batches of windows at a time. Operations such as C{vstack}\n"
+	"create a regular copy of all windows.\n"
+	"\n"
 	"@type  time_series: C{ndarray}\n"
 	"@param time_series: an NxT array representing an N-dimensional time series of length T\n"
 	"\n"
@@ -1255,6 +1740,7 @@ PyObject* extract_windows(PyObject* self, PyObject* args, PyObject* kwds) {
 		return 0;
 	}
 
+	#ifdef EIGEN_DEFAULT_TO_ROW_MAJOR
 	try {
 		PyObject* result = PyArray_FromMatrixXd(
 			extractWindows(PyArray_ToMatrixXd(time_series), window_length));
@@ -1271,11 +1757,45 @@ PyObject* extract_windows(PyObject* self, PyObject* args, PyObject* kwds) {
 		PyErr_SetString(PyExc_RuntimeError, "Could not allocate memory.");
 		return 0;
 	}
+	#else
+	if(PyArray_NDIM(time_series) != 2) {
+		Py_DECREF(time_series);
+		PyErr_SetString(PyExc_TypeError, "time_series should be two-dimensional.");
+		return 0;
+	}
+
+	if(window_length < 1 || window_length > PyArray_DIM(time_series, 1)) {
+		Py_DECREF(time_series);
+		PyErr_SetString(PyExc_RuntimeError,
+			"Window length should be between one and the length of the time series.");
+		return 0;
+	}
 
+	// consecutive windows overlap in memory
+	npy_intp dims[2];
+	dims[0] = PyArray_DIM(time_series, 0) * window_length;
+	dims[1] = PyArray_DIM(time_series, 1) - window_length + 1;
 
-	Py_DECREF(time_series);
+	npy_intp strides[2];
+	strides[0] = sizeof(double);
+	strides[1] = sizeof(double) * PyArray_DIM(time_series, 0);
 
-	return 0;
+	PyObject* windows = PyArray_New(&PyArray_Type, 2, dims, NPY_DOUBLE, strides,
+		PyArray_DATA(time_series), sizeof(double), NPY_ALIGNED, 0);
+
+	if(!windows) {
+		Py_DECREF(time_series);
+		return 0;
+	}
+
+	// the view keeps the time series alive (steals reference)
+	if(PyArray_SetBaseObject(reinterpret_cast<PyArrayObject*>(windows), time_series) < 0) {
+		Py_DECREF(windows);
+		return 0;
+	}
+
+	return windows;
+	#endif
 }
 
 
@@ -196,8 +196,19 @@ PyObject* Trainable_train(
 		&parameters))
 		return 0;
 
+	if(input_val == Py_None)
+		input_val = 0;
+	if(output_val == Py_None)
+		output_val = 0;
+
+	// overlapping windows of a time series are not copied all at once
+	bool windows = !input_val && !output_val && PyArray_IsWindowView(input);
+
 	// make sure data is stored in NumPy array
-	input = PyArray_FROM_OTF(input, NPY_DOUBLE, NPY_F_CONTIGUOUS | NPY_ALIGNED);
+	if(windows)
+		Py_INCREF(input);
+	else
+		input = PyArray_FROM_OTF(input, NPY_DOUBLE, NPY_F_CONTIGUOUS | NPY_ALIGNED);
 	output = PyArray_FROM_OTF(output, NPY_DOUBLE, NPY_F_CONTIGUOUS | NPY_ALIGNED);
 
 	if(!input || !output) {
@@ -207,11 +218,6 @@ PyObject* Trainable_train(
 		return 0;
 	}
 
-	if(input_val == Py_None)
-		input_val = 0;
-	if(output_val == Py_None)
-		output_val = 0;
-
 	if((input_val && PyDict_Check(input_val)) || (output_val && PyDict_Check(output_val))) {
 		// for some reason PyArray_FROM_OTF segfaults when input_val is a dictionary
 		Py_DECREF(input);
@@ -246,6 +252,11 @@ PyObject* Trainable_train(
 				PyArray_ToMatrixXd(input_val),
 				PyArray_ToMatrixXd(output_val),
 				*params);
+		} else if(windows) {
+			converged = self->distribution->train(
+				PyArray_ToWindowView(input),
+				PyArray_ToMatrixXd(output),
+				*params);
 		} else {
 			converged = self->distribution->train(
 				PyArray_ToMatrixXd(input), 
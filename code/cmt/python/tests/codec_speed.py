@@ -0,0 +1,71 @@
+"""
+Measures the throughput of the MCGSM image codec.
+"""
+
+import sys
+import socket
+
+from argparse import ArgumentParser
+from time import time
+from datetime import datetime
+from numpy import clip, round, sin, cos, mgrid
+from numpy.random import randn
+from cmt.models import MCGSM
+from cmt.transforms import WhiteningPreconditioner
+from cmt.tools import encode_image, decode_image, generate_data_from_image, generate_masks
+
+parser = ArgumentParser(sys.argv[0], description=__doc__)
+parser.add_argument('--height',         '-y', type=int, default=512)
+parser.add_argument('--width',          '-x', type=int, default=512)
+parser.add_argument('--neighborhood',   '-n', type=int, default=5)
+parser.add_argument('--num_components', '-c', type=int, default=8)
+parser.add_argument('--num_scales',     '-s', type=int, default=4)
+parser.add_argument('--repetitions',    '-r', type=int, default=2)
+
+args = parser.parse_args(sys.argv[1:])
+
+###
+print(socket.gethostname())
+print(datetime.now())
+print(args)
+print('')
+
+###
+# smooth test image with noise
+y, x = mgrid[:args.height, :args.width]
+img = 128. + 60. * sin(x / 17.) * cos(y / 23.) + 4. * randn(args.height, args.width)
+img = clip(round(img), 0, 255).astype(int)
+
+input_mask, output_mask = generate_masks(args.neighborhood)
+
+data = generate_data_from_image(img[:128, :128], input_mask, output_mask)
+wt = WhiteningPreconditioner(*data)
+
+model = MCGSM(
+	dim_in=data[0].shape[0],
+	dim_out=1,
+	num_components=args.num_components,
+	num_scales=args.num_scales,
+	num_features=data[0].shape[0])
+model.train(*wt(*data), parameters={'max_iter': 50})
+
+# size of the raw image in megabytes
+size = img.size / 1e6
+
+###
+print('encode_image')
+t = time()
+for r in range(args.repetitions):
+	data = encode_image(img, model, input_mask, output_mask, wt)
+t = (time() - t) / float(args.repetitions)
+print('{0:12.8f} seconds ({1:.3f} MB/s, {2:.3f} bit/px)'.format(t, size / t, len(data) * 8. / img.size))
+print('')
+
+###
+print('decode_image')
+t = time()
+for r in range(args.repetitions):
+	decode_image(data, model, input_mask, output_mask, wt)
+t = (time() - t) / float(args.repetitions)
+print('{0:12.8f} seconds ({1:.3f} MB/s)'.format(t, size / t))
+print('')
@@ -9,7 +9,7 @@ from scipy.stats import kstest, ks_2samp, norm
 from pickle import dump, load
 from tempfile import mkstemp
 from cmt.models import MCGSM, MoGSM, PatchMCGSM, GSM
-from cmt.tools import generate_masks
+from cmt.tools import generate_masks, extract_windows
 from cmt.transforms import WhiteningPreconditioner
 
 class Tests(unittest.TestCase):
@@ -131,6 +131,68 @@ class Tests(unittest.TestCase):
 
 
 
+	def test_prune(self):
+		mcgsm = MCGSM(8, 2, 6, 2, 10)
+
+		# make two components improbable
+		priors = mcgsm.priors.copy()
+		priors[[1, 4]] = -100.
+		mcgsm.priors = priors
+
+		input = randn(mcgsm.dim_in, 1000)
+		output = randn(mcgsm.dim_out, 1000)
+
+		mcgsm.train(input, output, parameters={
+			'max_iter': 2,
+			'prune_threshold': 1e-8,
+			'prune_iter': 1})
+
+		# all parameters should have been resized consistently
+		self.assertEqual(mcgsm.num_components, 4)
+		self.assertEqual(mcgsm.priors.shape[0], 4)
+		self.assertEqual(mcgsm.scales.shape[0], 4)
+		self.assertEqual(mcgsm.weights.shape[0], 4)
+		self.assertEqual(len(mcgsm.cholesky_factors), 4)
+		self.assertEqual(len(mcgsm.predictors), 4)
+		self.assertEqual(mcgsm.linear_features.shape[0], 4)
+		self.assertEqual(mcgsm.means.shape[1], 4)
+		self.assertFalse(any(isnan(mcgsm.loglikelihood(input, output))))
+
+		priors = mcgsm.priors.copy()
+		priors[0] = -100.
+		mcgsm.priors = priors
+
+		# pruned components should be replaced by splitting others
+		mcgsm.train(input, output, parameters={
+			'max_iter': 2,
+			'prune_threshold': 1e-8,
+			'prune_iter': 1,
+			'split_components': True})
+
+		self.assertEqual(mcgsm.num_components, 4)
+		self.assertEqual(len(mcgsm.predictors), 4)
+		self.assertFalse(any(isnan(mcgsm.loglikelihood(input, output))))
+
+		# components should also be pruned when inputs are views into larger arrays
+		for input in [randn(8, 2000)[:, ::2], extract_windows(randn(2, 1003), 4)]:
+			mcgsm = MCGSM(8, 2, 6, 2, 10)
+
+			priors = mcgsm.priors.copy()
+			priors[[1, 4]] = -100.
+			mcgsm.priors = priors
+
+			output = randn(mcgsm.dim_out, input.shape[1])
+
+			mcgsm.train(input, output, parameters={
+				'max_iter': 2,
+				'prune_threshold': 1e-8,
+				'prune_iter': 1})
+
+			self.assertEqual(mcgsm.num_components, 4)
+			self.assertFalse(any(isnan(mcgsm.loglikelihood(input, output))))
+
+
+
 	def test_mogsm(self):
 		mcgsm = MCGSM(
 			dim_in=0,
@@ -328,6 +390,68 @@ class Tests(unittest.TestCase):
 
 		self.assertAlmostEqual(loglik1, loglik2, 8)
 
+		# large data sets are evaluated in tiles
+		inputs = randn(mcgsm.dim_in, 50000)
+		outputs = mcgsm.sample(inputs)
+
+		loglik1 = -mcgsm.evaluate(inputs, outputs)
+		loglik2 = mcgsm.loglikelihood(inputs, outputs).mean() / log(2.) / mcgsm.dim_out
+
+		self.assertAlmostEqual(loglik1, loglik2, 8)
+
+		# wrong dimensionalities should raise exceptions instead of terminating
+		self.assertRaises(RuntimeError, mcgsm.evaluate, randn(mcgsm.dim_in + 1, 1000), outputs[:, :1000])
+		self.assertRaises(RuntimeError, mcgsm.evaluate, inputs[:, :1000], randn(mcgsm.dim_out + 1, 1000))
+		self.assertRaises(RuntimeError, GSM(3, 2).evaluate, randn(4, 1000))
+
+		# preconditioners which don't fit data or model should be rejected before evaluation
+		self.assertRaises(RuntimeError, mcgsm.evaluate,
+			randn(mcgsm.dim_in + 1, 1000), outputs[:, :1000], pre)
+		self.assertRaises(RuntimeError, mcgsm.evaluate,
+			randn(mcgsm.dim_in + 1, 1000), outputs[:, :1000],
+			WhiteningPreconditioner(randn(mcgsm.dim_in + 1, 1000), outputs[:, :1000]))
+
+		loglik1 = -mcgsm.evaluate(inputs, outputs, pre)
+		loglik2 = (mcgsm.loglikelihood(*pre(inputs, outputs)).mean()
+			+ pre.logjacobian(inputs, outputs).mean()) / log(2.) / mcgsm.dim_out
+
+		self.assertAlmostEqual(loglik1, loglik2, 8)
+
+
+
+	def test_fold_preconditioner(self):
+		for dim_in in [5, 0]:
+			mcgsm = MCGSM(dim_in, 3, 4, 2, 10)
+			mcgsm.linear_features = randn(mcgsm.num_components, mcgsm.dim_in)
+			mcgsm.means = randn(mcgsm.dim_out, mcgsm.num_components)
+
+			inputs = randn(mcgsm.dim_in, 100) * 4. + 2.
+			outputs = dot(randn(mcgsm.dim_out, mcgsm.dim_out), randn(mcgsm.dim_out, 100)) + 1.
+
+			pre = WhiteningPreconditioner(inputs, outputs)
+
+			loglik1 = mcgsm.loglikelihood(*pre(inputs, outputs)) + pre.logjacobian(inputs, outputs)
+			folded = mcgsm.fold_preconditioner(pre)
+			loglik2 = folded.loglikelihood(inputs, outputs)
+
+			self.assertLess(max(abs(loglik1 - loglik2)), 1e-8)
+
+			# representation of folded model should be normalized
+			for cholesky_factor in folded.cholesky_factors:
+				self.assertAlmostEqual(cholesky_factor[0, 0], 1.)
+
+			# parameters should survive a round trip
+			folded._set_parameters(folded._parameters())
+			loglik3 = folded.loglikelihood(inputs, outputs)
+
+			self.assertLess(max(abs(loglik2 - loglik3)), 1e-8)
+
+			# training should start from the folded density
+			loss = folded.evaluate(inputs, outputs)
+			folded.train(inputs, outputs, parameters={'max_iter': 5})
+
+			self.assertLess(folded.evaluate(inputs, outputs), loss + 1e-8)
+
 
 
 	def test_data_gradient(self):
@@ -376,6 +500,45 @@ class Tests(unittest.TestCase):
 
 
 
+	def test_intermediates(self):
+		for dim_in in [5, 0]:
+			mcgsm = MCGSM(dim_in, 3, 4, 5, 10)
+			mcgsm.linear_features = randn(mcgsm.num_components, mcgsm.dim_in) / 5.
+			mcgsm.means = randn(mcgsm.dim_out, mcgsm.num_components) / 5.
+
+			inputs = randn(mcgsm.dim_in, 100)
+			outputs = mcgsm.sample(inputs)
+
+			intermediates = mcgsm._intermediates(inputs, outputs)
+
+			# cached and uncached results should be the same
+			self.assertLess(max(abs(
+				mcgsm.prior(intermediates) - mcgsm.prior(inputs))), 1e-10)
+			self.assertLess(max(abs(
+				mcgsm.posterior(intermediates) - mcgsm.posterior(inputs, outputs))), 1e-10)
+
+			for g, g_ in zip(mcgsm._data_gradient(intermediates), mcgsm._data_gradient(inputs, outputs)):
+				self.assertLess(sum(abs(g - g_)), 1e-8)
+
+			# intermediates of a different model should be rejected
+			mcgsm_copy = MCGSM(dim_in, 3, 4, 5, 10)
+			mcgsm_copy._set_parameters(mcgsm._parameters())
+
+			self.assertRaises(RuntimeError, mcgsm_copy.prior, intermediates)
+
+			# intermediates should be rejected after parameters changed
+			mcgsm.priors = mcgsm.priors
+			self.assertRaises(RuntimeError, mcgsm.prior, intermediates)
+
+			intermediates = mcgsm._intermediates(inputs, outputs)
+			mcgsm._set_parameters(mcgsm_copy._parameters())
+			self.assertRaises(RuntimeError, mcgsm.posterior, intermediates)
+			self.assertRaises(RuntimeError, mcgsm._data_gradient, intermediates)
+
+			self.assertRaises(RuntimeError, mcgsm._intermediates, randn(dim_in + 1, 100), outputs)
+
+
+
 	def test_pickle(self):
 		mcgsm0 = MCGSM(11, 2, 4, 7, 21)
 
@@ -476,6 +639,19 @@ class Tests(unittest.TestCase):
 
 		self.assertTrue(converged)
 
+		# log-likelihood of patches should be the sum of the log-likelihoods of pixels
+		logLik = zeros([1, data.shape[1]])
+		for i in range(2):
+			for j in range(2):
+				logLik += model.loglikelihood(i, j, data)
+
+		self.assertLess(max(abs(model.loglikelihood(data) - logLik)), 1e-8)
+
+		samples = model.sample(5000)
+
+		self.assertEqual(samples.shape, (4, 5000))
+		self.assertFalse(any(isnan(samples)))
+
 
 
 	def test_patchmcgsm_stationary(self):
@@ -489,12 +665,26 @@ class Tests(unittest.TestCase):
 		data = randn(4, 10000)
 
 		model.initialize(data)
+
+		# reference to a model which will be overwritten by a copy
+		mcgsm = model[2, 2]
+
 		model.train(data, parameters={
 			'verbosity': 0,
 			'max_iter': 10,
 			'stationary': True,
 			'treshold': 1e-4})
 
+		# copied models are evaluated together
+		patches = randn(9, 1000)
+
+		logLik = zeros([1, patches.shape[1]])
+		for i in range(3):
+			for j in range(3):
+				logLik += model.loglikelihood(i, j, patches)
+
+		self.assertLess(max(abs(model.loglikelihood(patches) - logLik)), 1e-8)
+
 		self.assertTrue(all(model[0, 2].predictors == model[0, 1].predictors))
 		self.assertFalse(all(model[1, 0].predictors == model[0, 1].predictors))
 		self.assertTrue(all(model[1, 2].weights == model[1, 1].weights))
@@ -502,6 +692,27 @@ class Tests(unittest.TestCase):
 		self.assertTrue(all(model[1, 2].scales == model[1, 1].scales))
 		self.assertTrue(all(model[1, 2].priors == model[1, 1].priors))
 
+		# changing a copied model should not affect the other models
+		model[1, 2].priors = model[1, 2].priors + 1.
+
+		logLik = zeros([1, patches.shape[1]])
+		for i in range(3):
+			for j in range(3):
+				logLik += model.loglikelihood(i, j, patches)
+
+		self.assertLess(max(abs(model.loglikelihood(patches) - logLik)), 1e-8)
+
+		# changes through references obtained before training should be detected as well
+		self.assertTrue(all(mcgsm.priors == model[1, 1].priors))
+		mcgsm.scales = mcgsm.scales + 1.
+
+		logLik = zeros([1, patches.shape[1]])
+		for i in range(3):
+			for j in range(3):
+				logLik += model.loglikelihood(i, j, patches)
+
+		self.assertLess(max(abs(model.loglikelihood(patches) - logLik)), 1e-8)
+
 		xmask, ymask = generate_masks(3)
 
 		model = PatchMCGSM(3, 3, xmask, ymask, model=MCGSM(sum(xmask), 1, 2, 2))
@@ -519,6 +730,27 @@ class Tests(unittest.TestCase):
 		self.assertTrue(all(model[2, 0].features == model[1, 0].features))
 		self.assertTrue(all(model[2, 2].scales == model[1, 2].scales))
 
+		# copied models with preconditioners and validation data
+		xmask = ones([2, 2], dtype='bool')
+		ymask = zeros([2, 2], dtype='bool')
+		xmask[-1, -1] = False
+		ymask[-1, -1] = True
+
+		model = PatchMCGSM(3, 3, xmask, ymask, model=MCGSM(2, 1, 2, 2), max_pcs=2)
+
+		data = randn(9, 10000)
+		data_val = randn(9, 1000)
+
+		model.train(data, data_val, parameters={
+			'verbosity': 0,
+			'max_iter': 10,
+			'stationary': True})
+
+		self.assertTrue(all(model[2, 2].features == model[1, 1].features))
+		self.assertTrue(all(model.preconditioner(2, 2).pre_in == model.preconditioner(1, 1).pre_in))
+
+		del model
+
 
 
 def logsumexp(x, ax=None):
@@ -4,12 +4,13 @@ import unittest
 from numpy import *
 from numpy import sum, max, round
 from numpy.random import *
-from numpy.linalg import inv, slogdet
+from numpy.linalg import inv, slogdet, eigvalsh
 from pickle import dump, load
 from tempfile import mkstemp
 from cmt.transforms import AffinePreconditioner, WhiteningPreconditioner, PCAPreconditioner
 from cmt.transforms import AffineTransform, WhiteningTransform, PCATransform
 from cmt.transforms import BinningTransform
+from cmt.utils import Moments
 
 class Tests(unittest.TestCase):
 	def test_adjust_gradient(self):
@@ -331,6 +332,18 @@ class Tests(unittest.TestCase):
 
 		self.assertLess(max(abs(Yr - Y)), 1e-10)
 
+		# few principal components of high-dimensional inputs use randomized PCA
+		X = dot(randn(100, 100) * exp(-arange(100) / 2.), randn(100, 5000))
+		Y = randn(1, 5000) + X[:1]
+
+		pca = PCAPreconditioner(X, Y, num_pcs=5)
+
+		eigenvalues = eigvalsh(cov(X, bias=True))[-5:]
+
+		self.assertEqual(pca.pre_in.shape, (5, 100))
+		self.assertLess(max(abs(pca.eigenvalues.ravel() / eigenvalues - 1.)), 1e-6)
+		self.assertLess(max(abs(cov(pca(X), bias=True) - eye(5))), 1e-8)
+
 
 
 	def test_pca_preconditioner_pickle(self):
@@ -483,5 +496,35 @@ class Tests(unittest.TestCase):
 
 
 
+	def test_moments(self):
+		X = dot(randn(5, 5), randn(5, 20000)) + randn(5, 1)
+		Y = dot(randn(2, 2), randn(2, 20000)) + dot(randn(2, 5), X)
+
+		# one-shot statistics
+		m = mean(vstack([X, Y]), 1)
+		C = cov(vstack([X, Y]), bias=True)
+
+		# update in chunks of different sizes
+		moments0 = Moments(5, 2)
+		moments0.update(X[:, :7], Y[:, :7])
+		moments0.update(X[:, 7:12000], Y[:, 7:12000])
+
+		# merge statistics of separately processed chunk
+		moments1 = Moments(5, 2)
+		moments1.update(vstack([X[:, 12000:], Y[:, 12000:]]))
+		moments0.update(moments1)
+
+		self.assertEqual(moments0.num_data, 20000)
+		self.assertLess(max(abs(moments0.mean_in.ravel() - m[:5])), 1e-10)
+		self.assertLess(max(abs(moments0.mean_out.ravel() - m[5:])), 1e-10)
+		self.assertLess(max(abs(moments0.cov_xx - C[:5, :5])), 1e-8)
+		self.assertLess(max(abs(moments0.cov_yx - C[5:, :5])), 1e-8)
+		self.assertLess(max(abs(moments0.cov_yy - C[5:, 5:])), 1e-8)
+
+		self.assertRaises(RuntimeError, moments0.update, X, Y[:1])
+		self.assertRaises(RuntimeError, moments0.update, Moments(5, 1))
+
+
+
 if __name__ == '__main__':
 	unittest.main()
@@ -8,6 +8,7 @@ from pickle import dump, load
 from tempfile import mkstemp
 from cmt.models import STM, GLM, Bernoulli, Poisson
 from cmt.nonlinear import LogisticFunction, ExponentialFunction
+from cmt.tools import extract_windows
 from scipy.stats import norm
 
 class Tests(unittest.TestCase):
@@ -277,6 +278,26 @@ class Tests(unittest.TestCase):
 
 
 
+	def test_train_windows(self):
+		stimulus = randn(2, 2000)
+		inputs = extract_windows(stimulus, 10)
+		outputs = asarray(rand(1, inputs.shape[1]) < 1. / (1. + exp(-inputs[:5].sum(0))), dtype='float')
+
+		parameters = {'max_iter': 20, 'batch_size': 100}
+
+		for dim_in_linear in [0, 6]:
+			stm1 = STM(20 - dim_in_linear, dim_in_linear, 2, 3, LogisticFunction, Bernoulli)
+			stm2 = STM(20 - dim_in_linear, dim_in_linear, 2, 3, LogisticFunction, Bernoulli)
+			stm2._set_parameters(stm1._parameters(parameters), parameters)
+
+			# training on a view of the stimulus should be equivalent to training on a copy
+			stm1.train(inputs, outputs, parameters=parameters)
+			stm2.train(array(inputs, order='F'), outputs, parameters=parameters)
+
+			self.assertLess(max(abs(stm1._parameters(parameters) - stm2._parameters(parameters))), 1e-8)
+
+
+
 	def test_pickle(self):
 		stm0 = STM(5, 10, 4, 21)
 
@@ -6,19 +6,25 @@ from numpy import max, all
 from numpy.random import *
 from cmt.models import MCGSM, GLM, Bernoulli
 from cmt.transforms import WhiteningPreconditioner, AffineTransform
-from cmt.utils import random_select
+from cmt.utils import random_select, seed
 from cmt.nonlinear import LogisticFunction
-from cmt.tools import generate_data_from_image, sample_image
+from cmt.tools import generate_data_from_image, sample_image, sample_images
 from cmt.tools import generate_data_from_video, sample_video
-from cmt.tools import fill_in_image, fill_in_image_map
+from cmt.tools import fill_in_image, fill_in_image_map, density_gradient, evaluate_image
 from cmt.tools import extract_windows, sample_spike_train
-from cmt.tools import generate_masks
+from cmt.tools import encode_image, decode_image
+from cmt.tools import sample_image_conditionally, sample_labels_conditionally
+from cmt.tools import generate_masks, ImageDataLoader
 
 class ToolsTest(unittest.TestCase):
 	def test_random_select(self):
 		# select all elements
 		self.assertTrue(set(random_select(8, 8)) == set(range(8)))
 
+		# selected elements should be distinct
+		self.assertEqual(len(set(random_select(100, 1000))), 100)
+		self.assertEqual(len(set(random_select(10, 100000))), 10)
+
 		# n should be larger than k
 		self.assertRaises(Exception, random_select, 10, 4)
 
@@ -113,6 +119,12 @@ class ToolsTest(unittest.TestCase):
 
 		self.assertLess(max(abs(img_rec - img[2:, 1:])), 1e-16)
 
+		# sampling all locations should yield every output exactly once
+		img = randn(64, 64)
+		inputs, outputs = generate_data_from_image(img, xmask, ymask, 62 * 63)
+
+		self.assertLess(max(abs(sort(outputs.ravel()) - sort(img[2:, 1:].ravel()))), 1e-16)
+
 
 
 
@@ -167,6 +179,68 @@ class ToolsTest(unittest.TestCase):
 
 
 
+	def test_density_gradient(self):
+		xmask, ymask = generate_masks(3)
+
+		model = MCGSM(sum(xmask), 1, 2, 2, 2)
+
+		img = randn(12, 11)
+
+		def loglik(img):
+			inputs, outputs = generate_data_from_image(img, xmask, ymask)
+			return sum(model.loglikelihood(inputs, outputs))
+
+		gradient = density_gradient(img, model, xmask, ymask)
+
+		# compare with numerical gradient
+		for i, j in [(0, 0), (5, 6), (11, 10), (3, 10)]:
+			img_p = img.copy()
+			img_m = img.copy()
+			img_p[i, j] += 1e-5
+			img_m[i, j] -= 1e-5
+
+			self.assertAlmostEqual(gradient[i, j], (loglik(img_p) - loglik(img_m)) / 2e-5, 4)
+
+
+
+	def test_evaluate_image(self):
+		xmask = asarray([
+				[1, 1, 1],
+				[1, 0, 0],
+				[0, 0, 0]], dtype='bool')
+		ymask = asarray([
+				[0, 0, 0],
+				[0, 1, 0],
+				[0, 0, 0]], dtype='bool')
+
+		# image large enough to be split into several tiles
+		img = randn(300, 217)
+		inputs, outputs = generate_data_from_image(img, xmask, ymask)
+
+		model = MCGSM(4, 1, 2, 2, 2)
+		wt = WhiteningPreconditioner(inputs, outputs)
+
+		self.assertAlmostEqual(
+			evaluate_image(img, model, xmask, ymask),
+			model.evaluate(inputs, outputs), 8)
+		self.assertAlmostEqual(
+			evaluate_image(img, model, xmask, ymask, wt),
+			model.evaluate(inputs, outputs, wt), 8)
+
+		# color image
+		img = randn(20, 30, 3)
+		inputs, outputs = generate_data_from_image(img, xmask, ymask)
+
+		model = MCGSM(12, 3, 2, 2, 2)
+
+		self.assertAlmostEqual(
+			evaluate_image(img, model, xmask, ymask),
+			model.evaluate(inputs, outputs), 8)
+
+		self.assertRaises(RuntimeError, evaluate_image, img[:2, :2], model, xmask, ymask)
+
+
+
 	def test_sample_image(self):
 		xmask = asarray([
 			[1, 1],
@@ -194,6 +268,64 @@ class ToolsTest(unittest.TestCase):
 		self.assertRaises(TypeError, sample_image, (img_init, model, xmask, ymask, 10.))
 		self.assertRaises(TypeError, sample_image, (img_init, model, xmask, ymask, model))
 
+		# blocks should be generated in the same order as in a raster scan
+		xmask = asarray([
+			[1, 1, 1, 1, 1],
+			[1, 1, 0, 0, 0]], dtype='bool')
+		ymask = asarray([
+			[0, 0, 0, 0, 0],
+			[0, 0, 1, 0, 0]], dtype='bool')
+
+		weights = rand(1, 7)
+		weights *= .9 / sum(weights)
+
+		# nearly deterministic model
+		model = MCGSM(7, 1, 1, 1, 1)
+		model.predictors = [weights]
+		model.cholesky_factors = [asarray([[1e8]])]
+		model.linear_features = zeros_like(model.linear_features)
+
+		img_init = randn(20, 30)
+		img_sample = sample_image(img_init, model, xmask, ymask)
+
+		img = img_init.copy()
+		for i in range(img.shape[0] - 1):
+			for j in range(img.shape[1] - 4):
+				img[i + 1, j + 2] = dot(weights, img[i:i + 2, j:j + 5][xmask])[0]
+
+		self.assertLess(max(abs(img - img_sample)), 1e-5)
+
+
+
+	def test_sample_images(self):
+		xmask = asarray([
+			[1, 1, 1],
+			[1, 0, 0]], dtype='bool')
+		ymask = asarray([
+			[0, 0, 0],
+			[0, 1, 0]], dtype='bool')
+
+		weights = rand(1, 4)
+		weights *= .9 / sum(weights)
+
+		# nearly deterministic model
+		model = MCGSM(4, 1, 1, 1, 1)
+		model.predictors = [weights]
+		model.cholesky_factors = [asarray([[1e8]])]
+		model.linear_features = zeros_like(model.linear_features)
+
+		imgs_init = [randn(10, 12) for _ in range(5)]
+		imgs_sample = sample_images(imgs_init, model, xmask, ymask, max_value=2.)
+
+		self.assertEqual(len(imgs_sample), 5)
+
+		# images should be generated independently
+		for img_init, img_sample in zip(imgs_init, imgs_sample):
+			img = sample_image(img_init, model, xmask, ymask, max_value=[2.])
+			self.assertLess(max(abs(img - img_sample)), 1e-5)
+
+		self.assertRaises(RuntimeError, sample_images, [randn(10, 12), randn(10, 11)], model, xmask, ymask)
+
 
 
 	def test_sample_video(self):
@@ -224,6 +356,13 @@ class ToolsTest(unittest.TestCase):
 		# the first frame should be untouched
 		self.assertLess(max(abs(video_init[:, :, 0] - video_sample[:, :, 0])), 1e-10)
 
+		# frames don't need to be square
+		video_init = randn(16, 21, 5)
+		video_sample = sample_video(video_init, model, xmask, ymask)
+
+		self.assertEqual(video_sample.shape, video_init.shape)
+		self.assertLess(max(abs(video_init[:, :, 0] - video_sample[:, :, 0])), 1e-10)
+
 
 
 	def test_fill_in_image(self):
@@ -247,10 +386,119 @@ class ToolsTest(unittest.TestCase):
 		# this should raise an exception
 		self.assertRaises(TypeError, fill_in_image, (img, model, xmask, ymask, fmask, 10.))
 
+		# only missing pixels should be replaced
+		img_filled = fill_in_image(img, model, xmask, ymask, fmask, num_iter=2, num_steps=10)
+		self.assertLess(max(abs(img_filled - img)[~fmask]), 1e-10)
+
 		# this should raise no exception
 		wt = WhiteningPreconditioner(randn(4, 1000), randn(1, 1000))
 		fill_in_image_map(img, model, xmask, ymask, fmask, wt, num_iter=1, patch_size=20)
 
+		# blocks at the border should be optimized as well
+		img_map = fill_in_image_map(img, model, xmask, ymask, fmask, num_iter=1, patch_size=3)
+		self.assertLess(max(abs(img_map - img)[~fmask]), 1e-10)
+		self.assertGreater(max(abs(img_map - img)[fmask]), 0.)
+
+		# many pixels are updated in parallel, but results should be reproducible
+		fmask = zeros([20, 20], dtype='bool')
+		fmask[1:-1, 1:-1] = rand(18, 18) > .5
+		img = randn(20, 20)
+
+		seed(2)
+		img_filled = fill_in_image(img, model, xmask, ymask, fmask, num_iter=3, num_steps=5)
+		seed(2)
+		self.assertTrue(all(
+			fill_in_image(img, model, xmask, ymask, fmask, num_iter=3, num_steps=5) == img_filled))
+
+		self.assertLess(max(abs(img_filled - img)[~fmask]), 1e-10)
+		self.assertGreater(max(abs(img_filled - img)[fmask]), 0.)
+
+
+
+	def test_sample_image_conditionally(self):
+		xmask = asarray([
+				[1, 1, 1],
+				[1, 0, 0],
+				[0, 0, 0]], dtype='bool')
+		ymask = asarray([
+				[0, 0, 0],
+				[0, 1, 0],
+				[0, 0, 0]], dtype='bool')
+
+		model = MCGSM(4, 1, 2, 2)
+		img = randn(20, 20)
+
+		labels = sample_labels_conditionally(img, model, xmask, ymask)
+
+		for initialize in [False, True]:
+			# many blocks are updated in parallel, but results should be reproducible
+			seed(3)
+			img_sampled = sample_image_conditionally(img, labels, model, xmask, ymask,
+				num_iter=3, initialize=initialize)
+			seed(3)
+			self.assertTrue(all(sample_image_conditionally(img, labels, model, xmask, ymask,
+				num_iter=3, initialize=initialize) == img_sampled))
+
+			# only pixels with complete neighborhoods are sampled
+			self.assertLess(max(abs(img_sampled - img)[[0, -1]]), 1e-10)
+			self.assertLess(max(abs(img_sampled - img)[:, [0, -1]]), 1e-10)
+			self.assertGreater(max(abs(img_sampled - img)[1:-1, 1:-1]), 0.)
+
+		# initialization samples every pixel
+		img_sampled = sample_image_conditionally(img, labels, model, xmask, ymask,
+			num_iter=1, initialize=True)
+		self.assertTrue(all(img_sampled[1:-1, 1:-1] != img[1:-1, 1:-1]))
+
+
+
+	def test_encode_image(self):
+		xmask = asarray([
+				[1, 1, 1],
+				[1, 0, 0]], dtype='bool')
+		ymask = asarray([
+				[0, 0, 0],
+				[0, 1, 0]], dtype='bool')
+
+		# smooth image with integer pixel values
+		img = cumsum(randint(-3, 4, size=[30, 40]), 1) // 2 + 128
+		img = clip(img, 0, 255)
+
+		inputs, outputs = generate_data_from_image(img.astype(float), xmask, ymask)
+		wt = WhiteningPreconditioner(inputs, outputs)
+
+		model = MCGSM(4, 1, 2, 2, 2)
+		model.train(*wt(inputs, outputs), parameters={'max_iter': 20})
+
+		data = encode_image(img, model, xmask, ymask, wt)
+
+		# compression should be lossless
+		self.assertTrue(all(decode_image(data, model, xmask, ymask, wt) == img))
+		self.assertLess(len(data), img.size)
+
+		# pixels should be coded without a preconditioner as well
+		model = MCGSM(4, 1, 2, 2, 2)
+		data = encode_image(img, model, xmask, ymask, bit_depth=9)
+		self.assertTrue(all(decode_image(data, model, xmask, ymask) == img))
+
+		# input pixels following the output pixel can't be decoded first
+		xmask[1, 2] = True
+		self.assertRaises(RuntimeError, encode_image, img, MCGSM(5, 1), xmask, ymask)
+		xmask[1, 2] = False
+
+		self.assertRaises(RuntimeError, encode_image, img + 256, model, xmask, ymask)
+		self.assertRaises(RuntimeError, decode_image, data[:10], model, xmask, ymask)
+
+		# values which would wrap around to valid pixel values should be rejected
+		img_large = img.copy()
+		img_large[10, 10] = 2**32 + 5
+		self.assertRaises(RuntimeError, encode_image, img_large, model, xmask, ymask)
+
+		# image sizes in corrupt headers should not cause huge allocations
+		corrupt = data[:6] + b'\xff\xff\xff\xff\x7f\xff\xff\xff' + data[14:]
+		self.assertRaises(RuntimeError, decode_image, corrupt, model, xmask, ymask)
+		corrupt = data[:6] + b'\x00\x01\x00\x00\x00\x01\x00\x00' + data[14:]
+		self.assertRaises(RuntimeError, decode_image, corrupt, model, xmask, ymask)
+
 
 
 	def test_preprocess_spike_train(self):
@@ -275,6 +523,40 @@ class ToolsTest(unittest.TestCase):
 
 
 
+	def test_extract_windows(self):
+		time_series = randn(3, 20)
+		windows = extract_windows(time_series, 4)
+
+		self.assertEqual(windows.shape, (12, 17))
+
+		for t in range(windows.shape[1]):
+			self.assertLess(max(abs(windows[:, t] - time_series[:, t:t + 4].T.ravel())), 1e-16)
+
+		# windows should share memory with the time series
+		self.assertFalse(windows.flags.writeable)
+		self.assertFalse(windows.flags.f_contiguous)
+
+		self.assertRaises(Exception, extract_windows, time_series, 0)
+		self.assertRaises(Exception, extract_windows, time_series, 21)
+
+		# training on windows should give the same result as training on a copy
+		stimulus = randn(2, 2000)
+		inputs = extract_windows(stimulus, 5)
+		outputs = asarray(rand(1, inputs.shape[1]) < 1. / (1. + exp(-inputs[:3].sum(0))), dtype='float')
+
+		glm1 = GLM(10, LogisticFunction, Bernoulli)
+		glm2 = GLM(10, LogisticFunction, Bernoulli)
+		glm2.weights = glm1.weights
+		glm2.bias = glm1.bias
+
+		parameters = {'max_iter': 20, 'batch_size': 50}
+		glm1.train(inputs, outputs, parameters=parameters)
+		glm2.train(array(inputs, order='F'), outputs, parameters=parameters)
+
+		self.assertLess(max(abs(glm1.weights - glm2.weights)), 1e-6)
+
+
+
 	def test_sample_spike_train(self):
 		inputs = array([
 			[0, 0, 0, 0, 1, 1, 1, 1],
@@ -309,6 +591,64 @@ class ToolsTest(unittest.TestCase):
 
 
 
+	def test_image_data_loader(self):
+		input_mask = asarray([[1, 1, 1], [1, 0, 0], [0, 0, 0]], dtype='bool')
+		output_mask = asarray([[0, 0, 0], [0, 1, 0], [0, 0, 0]], dtype='bool')
+
+		images = [randn(12, 10), randn(7, 9)]
+
+		loader = ImageDataLoader(images, input_mask, output_mask, 50)
+
+		self.assertEqual(loader.dim_in, 4)
+		self.assertEqual(loader.dim_out, 1)
+		self.assertEqual(loader.batch_size, 50)
+		self.assertEqual(loader.num_locations, 10 * 8 + 5 * 7)
+
+		# all input/output pairs which can be extracted from the images
+		data = [generate_data_from_image(img, input_mask, output_mask) for img in images]
+		data = vstack([hstack([d[0] for d in data]), hstack([d[1] for d in data])]).T
+
+		inputs, outputs = loader.next()
+
+		self.assertEqual(inputs.shape, (4, 50))
+		self.assertEqual(outputs.shape, (1, 50))
+
+		# every sampled pair should correspond to an image location
+		for x in vstack([inputs, outputs]).T:
+			self.assertLess(min(sum(abs(data - x), 1)), 1e-10)
+
+		# consecutive batches should differ
+		self.assertGreater(max(abs(loader.next()[0] - inputs)), 0.)
+
+		# loaders can be iterated over
+		for k, (inputs, outputs) in enumerate(loader):
+			self.assertEqual(inputs.shape, (4, 50))
+			if k > 2:
+				break
+
+		# batches should be preconditioned
+		wt = WhiteningPreconditioner(data[:, :4].T, data[:, 4:].T)
+		loader = ImageDataLoader(images[0], input_mask, output_mask, 20, wt)
+
+		inputs, outputs = loader.next()
+
+		self.assertEqual(inputs.shape, (4, 20))
+		inputs, outputs = wt.inverse(inputs, outputs)
+		for x in vstack([inputs, outputs]).T:
+			self.assertLess(min(sum(abs(data - x), 1)), 1e-8)
+
+		# images smaller than the masks should be rejected
+		self.assertRaises(Exception, ImageDataLoader, [randn(2, 2)], input_mask, output_mask)
+		self.assertRaises(Exception, ImageDataLoader, images, input_mask, output_mask, 0)
+
+		# uninitialized loaders should raise exceptions instead of crashing
+		loader = ImageDataLoader.__new__(ImageDataLoader)
+		self.assertRaises(RuntimeError, getattr, loader, 'dim_in')
+		self.assertRaises(RuntimeError, getattr, loader, 'num_locations')
+		self.assertRaises(RuntimeError, loader.next)
+
+
+
 	def test_generate_maks(self):
 		# make sure masks don't overlap
 		input_mask, output_mask = generate_masks(7, 1)
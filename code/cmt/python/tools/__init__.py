@@ -2,12 +2,17 @@ __all__ = [
 	"generate_data_from_image",
 	"generate_data_from_video",
 	"density_gradient",
+	"evaluate_image",
 	"sample_image",
+	"sample_images",
 	"sample_image_conditionally",
 	"sample_labels_conditionally",
 	"sample_video",
 	"fill_in_image",
 	"fill_in_image_map",
+	"encode_image",
+	"decode_image",
+	"ImageDataLoader",
 	"extract_windows",
 	"sample_spike_train",
 	"generate_masks",
@@ -23,12 +28,17 @@ __all__ = [
 from _cmt import generate_data_from_image
 from _cmt import generate_data_from_video
 from _cmt import density_gradient
+from _cmt import evaluate_image
 from _cmt import sample_image
+from _cmt import sample_images
 from _cmt import sample_image_conditionally
 from _cmt import sample_labels_conditionally
 from _cmt import sample_video
 from _cmt import fill_in_image
 from _cmt import fill_in_image_map
+from _cmt import encode_image
+from _cmt import decode_image
+from _cmt import ImageDataLoader
 from _cmt import extract_windows
 from _cmt import sample_spike_train
 from .masks import generate_masks
@@ -1,3 +1,5 @@
-__all__ = ["random_select"]
+__all__ = ["random_select", "seed", "Moments"]
 
 from _cmt import random_select
+from _cmt import seed
+from _cmt import Moments
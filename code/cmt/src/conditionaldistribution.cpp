@@ -2,13 +2,25 @@
 using Eigen::Dynamic;
 using Eigen::Array;
 using Eigen::MatrixXd;
+using Eigen::ArrayXXd;
 
 #include "conditionaldistribution.h"
 #include "exception.h"
+#include "utils.h"
 
 #include <cmath>
 using std::log;
 
+#include <vector>
+using std::vector;
+
+#include <utility>
+using std::pair;
+using std::make_pair;
+
+#include <algorithm>
+using std::min;
+
 CMT::ConditionalDistribution::~ConditionalDistribution() {
 }
 
@@ -22,11 +34,141 @@ Array<double, 1, Dynamic> CMT::ConditionalDistribution::logLikelihood(
 
 
 
+/**
+ * Makes sure the preconditioner fits data and model before tiles are processed in parallel,
+ * since exceptions may not leave parallel regions.
+ */
+void CMT::ConditionalDistribution::checkPreconditioner(
+	const MatrixXd& input,
+	const MatrixXd& output,
+	const Preconditioner& preconditioner) const
+{
+	if(input.rows() != preconditioner.dimIn() || output.rows() != preconditioner.dimOut())
+		throw Exception("Data and preconditioner are incompatible.");
+	if(preconditioner.dimInPre() != dimIn() || preconditioner.dimOutPre() != dimOut())
+		throw Exception("Model and preconditioner are incompatible.");
+}
+
+
+
+/**
+ * Computes log-likelihoods of data after transforming it with the given preconditioner, taking
+ * the Jacobian of the transformation into account. Data points are transformed in tiles, so that
+ * no preconditioned copy of the complete data is ever created.
+ */
+Array<double, 1, Dynamic> CMT::ConditionalDistribution::logLikelihood(
+	const MatrixXd& input,
+	const MatrixXd& output,
+	const Preconditioner& preconditioner) const
+{
+	if(input.cols() != output.cols())
+		throw Exception("The number of inputs and outputs should be the same.");
+
+	checkPreconditioner(input, output, preconditioner);
+
+	int numData = output.cols();
+	int numCols = streamingTileSize(numData);
+	int numTiles = (numData + numCols - 1) / numCols;
+
+	Array<double, 1, Dynamic> logLik(numData);
+
+	#pragma omp parallel for if(numTiles > 1)
+	for(int t = 0; t < numTiles; ++t) {
+		int j = t * numCols;
+		int n = min(numCols, numData - j);
+
+		ArrayXXd inputTile = input.middleCols(j, n);
+		ArrayXXd outputTile = output.middleCols(j, n);
+
+		logLik.segment(j, n) = logLikelihood(preconditioner(inputTile, outputTile))
+			+ preconditioner.logJacobian(inputTile, outputTile);
+	}
+
+	return logLik;
+}
+
+
+
+/**
+ * Computes the sum of the log-likelihoods of the given data. Data points are processed in tiles,
+ * so that memory requirements do not depend on the number of data points.
+ */
+double CMT::ConditionalDistribution::logLikelihoodSum(
+	const MatrixXd& input,
+	const MatrixXd& output) const
+{
+	int numData = output.cols();
+	int numCols = streamingTileSize(numData);
+	int numTiles = (numData + numCols - 1) / numCols;
+
+	if(numTiles < 2)
+		return logLikelihood(input, output).sum();
+
+	if(input.cols() != numData)
+		throw Exception("The number of inputs and outputs should be the same.");
+
+	// exceptions may not leave the parallel region below
+	if(input.rows() != dimIn() || output.rows() != dimOut())
+		throw Exception("Data has wrong dimensionality.");
+
+	vector<double> logLikSums(numTiles);
+
+	#pragma omp parallel for
+	for(int t = 0; t < numTiles; ++t) {
+		int j = t * numCols;
+		int n = min(numCols, numData - j);
+
+		logLikSums[t] = logLikelihood(input.middleCols(j, n), output.middleCols(j, n)).sum();
+	}
+
+	// summing in fixed order keeps the result independent of the number of threads
+	return compensatedSum(logLikSums);
+}
+
+
+
+/**
+ * Computes the sum of the log-likelihoods of preconditioned data, including the log-Jacobian
+ * of the transformation. Data points are transformed and evaluated in tiles.
+ */
+double CMT::ConditionalDistribution::logLikelihoodSum(
+	const MatrixXd& input,
+	const MatrixXd& output,
+	const Preconditioner& preconditioner) const
+{
+	if(input.cols() != output.cols())
+		throw Exception("The number of inputs and outputs should be the same.");
+
+	checkPreconditioner(input, output, preconditioner);
+
+	int numData = output.cols();
+	int numCols = streamingTileSize(numData);
+	int numTiles = (numData + numCols - 1) / numCols;
+
+	vector<double> logLikSums(numTiles);
+
+	#pragma omp parallel for if(numTiles > 1)
+	for(int t = 0; t < numTiles; ++t) {
+		int j = t * numCols;
+		int n = min(numCols, numData - j);
+
+		ArrayXXd inputTile = input.middleCols(j, n);
+		ArrayXXd outputTile = output.middleCols(j, n);
+
+		logLikSums[t] = logLikelihood(preconditioner(inputTile, outputTile)).sum()
+			+ preconditioner.logJacobian(inputTile, outputTile).sum();
+	}
+
+	return compensatedSum(logLikSums);
+}
+
+
+
 double CMT::ConditionalDistribution::evaluate(
 	const MatrixXd& input,
 	const MatrixXd& output) const
 {
-	return -logLikelihood(input, output).mean() / log(2.) / dimOut();
+	return -logLikelihoodSum(input, output) / output.cols() / log(2.) / dimOut();
 }
 
 
@@ -36,8 +178,7 @@ double CMT::ConditionalDistribution::evaluate(
 	const MatrixXd& output,
 	const Preconditioner& preconditioner) const
 {
-	return -logLikelihood(preconditioner(input, output)).mean() / log(2.) / dimOut()
-		- preconditioner.logJacobian(input, output).mean() / log(2.) / dimOut();
+	return -logLikelihoodSum(input, output, preconditioner) / output.cols() / log(2.) / dimOut();
 }
 
 
@@ -45,7 +186,7 @@ double CMT::ConditionalDistribution::evaluate(
 double CMT::ConditionalDistribution::evaluate(
 	const pair<ArrayXXd, ArrayXXd>& data) const
 {
-	return -logLikelihood(data.first, data.second).mean() / log(2.) / dimOut();
+	return evaluate(data.first, data.second);
 }
 
 
@@ -54,8 +195,55 @@ double CMT::ConditionalDistribution::evaluate(
 	const pair<ArrayXXd, ArrayXXd>& data,
 	const Preconditioner& preconditioner) const
 {
-	return -logLikelihood(preconditioner(data.first, data.second)).mean() / log(2.) / dimOut()
-		- preconditioner.logJacobian(data).mean() / log(2.) / dimOut();
+	return evaluate(data.first, data.second, preconditioner);
+}
+
+
+
+/**
+ * Computes gradients of the log-likelihood with respect to inputs and outputs before
+ * preconditioning. Data points are transformed in tiles.
+ */
+pair<pair<ArrayXXd, ArrayXXd>, Array<double, 1, Dynamic> > CMT::ConditionalDistribution::computeDataGradient(
+	const MatrixXd& input,
+	const MatrixXd& output,
+	const Preconditioner& preconditioner) const
+{
+	if(input.cols() != output.cols())
+		throw Exception("The number of inputs and outputs should be the same.");
+
+	checkPreconditioner(input, output, preconditioner);
+
+	int numData = output.cols();
+	int numCols = streamingTileSize(numData);
+	int numTiles = (numData + numCols - 1) / numCols;
+
+	ArrayXXd inputGradients(input.rows(), numData);
+	ArrayXXd outputGradients(output.rows(), numData);
+	Array<double, 1, Dynamic> logLik(numData);
+
+	#pragma omp parallel for if(numTiles > 1)
+	for(int t = 0; t < numTiles; ++t) {
+		int j = t * numCols;
+		int n = min(numCols, numData - j);
+
+		ArrayXXd inputTile = input.middleCols(j, n);
+		ArrayXXd outputTile = output.middleCols(j, n);
+
+		pair<ArrayXXd, ArrayXXd> data = preconditioner(inputTile, outputTile);
+		pair<pair<ArrayXXd, ArrayXXd>, Array<double, 1, Dynamic> > results =
+			computeDataGradient(data.first, data.second);
+
+		// adjust gradient and likelihood to take transformation into account
+		pair<ArrayXXd, ArrayXXd> gradients =
+			preconditioner.adjustGradient(results.first.first, results.first.second);
+
+		inputGradients.middleCols(j, n) = gradients.first;
+		outputGradients.middleCols(j, n) = gradients.second;
+		logLik.segment(j, n) = results.second + preconditioner.logJacobian(inputTile, outputTile);
+	}
+
+	return make_pair(make_pair(inputGradients, outputGradients), logLik);
 }
 
 
@@ -1,16 +1,55 @@
 #include "distribution.h"
-#include <cmath>
+#include "utils.h"
+#include "exception.h"
+using CMT::Exception;
 
+#include <cmath>
 using std::log;
 
+#include <vector>
+using std::vector;
+
+#include <algorithm>
+using std::min;
+
 CMT::Distribution::~Distribution() {
 }
 
 
 
+/**
+ * Computes the sum of the log-likelihoods of the given data. Data points are processed in tiles,
+ * so that memory requirements do not depend on the number of data points.
+ */
+double CMT::Distribution::logLikelihoodSum(const MatrixXd& data) const {
+	int numData = data.cols();
+	int numCols = streamingTileSize(numData);
+	int numTiles = (numData + numCols - 1) / numCols;
+
+	if(numTiles < 2)
+		return logLikelihood(data).sum();
+
+	// exceptions may not leave the parallel region below
+	if(data.rows() != dim())
+		throw Exception("Data has wrong dimensionality.");
+
+	vector<double> logLikSums(numTiles);
+
+	#pragma omp parallel for
+	for(int t = 0; t < numTiles; ++t) {
+		int j = t * numCols;
+		logLikSums[t] = logLikelihood(data.middleCols(j, min(numCols, numData - j))).sum();
+	}
+
+	// summing in fixed order keeps the result independent of the number of threads
+	return compensatedSum(logLikSums);
+}
+
+
+
 /**
  * Computes the average negative log-likelihood in bits per component.
  */
 double CMT::Distribution::evaluate(const MatrixXd& data) const {
-	return -logLikelihood(data).mean() / log(2.) / dim();
+	return -logLikelihoodSum(data) / data.cols() / log(2.) / dim();
 }
@@ -3,6 +3,7 @@
 
 #include "glm.h"
 using CMT::GLM;
+using CMT::WindowView;
 
 #include "nonlinearities.h"
 using CMT::Nonlinearity;
@@ -25,6 +26,7 @@ using Eigen::Dynamic;
 using Eigen::Array;
 using Eigen::ArrayXXd;
 using Eigen::MatrixXd;
+using Eigen::OuterStride;
 
 Nonlinearity* const GLM::defaultNonlinearity = new LogisticFunction;
 UnivariateDistribution* const GLM::defaultDistribution = new Bernoulli;
@@ -223,6 +225,8 @@ void CMT::GLM::setParameters(
 
 		nonlinearity->setParameters(nonlParams);
 	}
+
+	mVersion = nextVersion();
 }
 
 
@@ -232,6 +236,24 @@ double CMT::GLM::parameterGradient(
 	const MatrixXd& outputCompl,
 	const lbfgsfloatval_t* x,
 	lbfgsfloatval_t* g,
+	const Trainable::Parameters& params) const
+{
+	return parameterGradient(
+		WindowView(inputCompl.data(), inputCompl.rows(), inputCompl.cols(), OuterStride<>(inputCompl.rows())),
+		outputCompl, x, g, params);
+}
+
+
+
+/**
+ * If the inputs are windows of a time series, the linear responses are a temporal convolution
+ * of the time series with the weights and are computed without copying the windows.
+ */
+double CMT::GLM::parameterGradient(
+	const WindowView& inputCompl,
+	const MatrixXd& outputCompl,
+	const lbfgsfloatval_t* x,
+	lbfgsfloatval_t* g,
 	const Trainable::Parameters& params_) const
 {
 	const Parameters& params = dynamic_cast<const Parameters&>(params_);
@@ -284,9 +306,12 @@ double CMT::GLM::parameterGradient(
 
 	double logLik = 0.;
 
+	int stride = static_cast<int>(inputCompl.outerStride());
+
 	#pragma omp parallel for
 	for(int b = 0; b < inputCompl.cols(); b += batchSize) {
-		const MatrixXd& input = inputCompl.middleCols(b, min(batchSize, numData - b));
+		const WindowView input(inputCompl.data() + static_cast<long>(b) * stride,
+			inputCompl.rows(), min(batchSize, numData - b), OuterStride<>(stride));
 		const MatrixXd& output = outputCompl.middleCols(b, min(batchSize, numData - b));
 
 		// linear responses
@@ -309,7 +334,7 @@ double CMT::GLM::parameterGradient(
 
 				// weights gradient
 				if(params.trainWeights && mDimIn) {
-					VectorXd weightsGrad_ = (input.array().rowwise() * tmp3).rowwise().sum();
+					VectorXd weightsGrad_ = input * tmp3.matrix().transpose();
 
 					#pragma omp critical
 					weightsGrad += weightsGrad_;
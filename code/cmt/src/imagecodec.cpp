@@ -0,0 +1,601 @@
+#include "imagecodec.h"
+#include "affinepreconditioner.h"
+#include "utils.h"
+using CMT::streamingTileSize;
+
+#include "exception.h"
+using CMT::Exception;
+
+#include "tools.h"
+using CMT::Tuple;
+using CMT::Tuples;
+using CMT::ArrayXXb;
+using CMT::MCGSM;
+using CMT::Preconditioner;
+using CMT::AffinePreconditioner;
+using CMT::masksToIndices;
+using CMT::wavefronts;
+
+#include "Eigen/Core"
+using Eigen::ArrayXXi;
+using Eigen::ArrayXXd;
+using Eigen::MatrixXd;
+using Eigen::VectorXd;
+
+#include <algorithm>
+using std::max;
+using std::min;
+
+#include <cmath>
+using std::exp;
+using std::abs;
+using std::erfc;
+
+#include <limits>
+using std::numeric_limits;
+
+#include <stdint.h>
+
+#include <utility>
+using std::pair;
+
+#include <vector>
+using std::vector;
+
+// version of the file format
+#define CODEC_VERSION 1
+#define CODEC_HEADER_SIZE 14
+
+// images with more pixels are considered corrupt when decoding
+#define CODEC_MAX_PIXELS (1u << 28)
+
+// probabilities are quantized to multiples of 2^-16
+#define CODEC_TOTAL (1u << 16)
+
+// renormalization thresholds of the range coder
+#define CODEC_TOP (1u << 24)
+#define CODEC_BOTTOM (1u << 16)
+
+/**
+ * Carry-less range coder (Subbotin). Frequencies may sum to at most 2^16.
+ */
+class RangeEncoder {
+	public:
+		RangeEncoder(vector<unsigned char>& data) : mData(data), mLow(0), mRange(0xFFFFFFFFu) {
+		}
+
+		inline void encode(uint32_t cumFreq, uint32_t freq, uint32_t totFreq) {
+			mRange /= totFreq;
+			mLow += cumFreq * mRange;
+			mRange *= freq;
+
+			while((mLow ^ (mLow + mRange)) < CODEC_TOP ||
+				(mRange < CODEC_BOTTOM && ((mRange = -mLow & (CODEC_BOTTOM - 1)), true))) {
+				mData.push_back(mLow >> 24);
+				mLow <<= 8;
+				mRange <<= 8;
+			}
+		}
+
+		inline void flush() {
+			for(int i = 0; i < 4; ++i, mLow <<= 8)
+				mData.push_back(mLow >> 24);
+		}
+
+	private:
+		vector<unsigned char>& mData;
+		uint32_t mLow;
+		uint32_t mRange;
+};
+
+
+
+class RangeDecoder {
+	public:
+		RangeDecoder(const vector<unsigned char>& data, int offset) :
+			mData(data), mPosition(offset), mLow(0), mRange(0xFFFFFFFFu), mCode(0)
+		{
+			for(int i = 0; i < 4; ++i)
+				mCode = (mCode << 8) | nextByte();
+		}
+
+		inline uint32_t frequency(uint32_t totFreq) {
+			mRange /= totFreq;
+
+			uint32_t freq = (mCode - mLow) / mRange;
+
+			if(freq >= totFreq)
+				throw Exception("Image data is corrupt.");
+
+			return freq;
+		}
+
+		inline void decode(uint32_t cumFreq, uint32_t freq) {
+			mLow += cumFreq * mRange;
+			mRange *= freq;
+
+			while((mLow ^ (mLow + mRange)) < CODEC_TOP ||
+				(mRange < CODEC_BOTTOM && ((mRange = -mLow & (CODEC_BOTTOM - 1)), true))) {
+				mCode = (mCode << 8) | nextByte();
+				mLow <<= 8;
+				mRange <<= 8;
+			}
+		}
+
+	private:
+		const vector<unsigned char>& mData;
+		int mPosition;
+		uint32_t mLow;
+		uint32_t mRange;
+		uint32_t mCode;
+
+		inline uint32_t nextByte() {
+			return mPosition < mData.size() ? mData[mPosition++] : 0;
+		}
+};
+
+
+
+/**
+ * Conditional distribution of a pixel under an MCGSM, a mixture of Gaussians whose weights and
+ * means depend on the causal neighborhood. Encoder and decoder need to arrive at exactly the same
+ * probabilities, so everything is computed pixel by pixel with plain loops whose results don't
+ * depend on how pixels are batched or distributed among threads.
+ */
+class PixelMixtures {
+	public:
+		PixelMixtures(const MCGSM& model);
+
+		inline int numWeights() const {
+			return mNumComponents * mNumScales;
+		}
+
+		void compute(const MatrixXd& inputs, ArrayXXd& weights, ArrayXXd& means) const;
+		int quantizedCDF(const double* weights, const double* means, int value, int numValues) const;
+
+	private:
+		int mDimIn;
+		int mNumComponents;
+		int mNumScales;
+		int mNumFeatures;
+
+		// parameters arranged so that all vectors used in dot products are contiguous
+		MatrixXd mFeatures;
+		MatrixXd mWeightsSqr;
+		MatrixXd mLinearFeatures;
+		MatrixXd mPredictors;
+		VectorXd mMeans;
+		ArrayXXd mPriors;
+		ArrayXXd mScalesExp;
+		ArrayXXd mPrecisions;
+};
+
+
+
+static inline double dot(const double* x, const double* y, int n) {
+	double result = 0.;
+	for(int i = 0; i < n; ++i)
+		result += x[i] * y[i];
+	return result;
+}
+
+
+
+PixelMixtures::PixelMixtures(const MCGSM& model) :
+	mDimIn(model.dimIn()),
+	mNumComponents(model.numComponents()),
+	mNumScales(model.numScales()),
+	mNumFeatures(model.numFeatures())
+{
+	if(model.dimOut() != 1)
+		throw Exception("Model has to predict a single pixel.");
+
+	mFeatures = model.features();
+	mWeightsSqr = model.weights().square().matrix().transpose();
+	mLinearFeatures = model.linearFeatures().transpose();
+	mPredictors = MatrixXd(mDimIn, mNumComponents);
+	mMeans = model.means().row(0).transpose();
+	mPriors = model.priors().transpose();
+	mScalesExp = model.scales().exp().transpose();
+	mPrecisions = ArrayXXd(mNumScales, mNumComponents);
+
+	vector<MatrixXd> predictors = model.predictors();
+	vector<MatrixXd> choleskyFactors = model.choleskyFactors();
+
+	for(int i = 0; i < mNumComponents; ++i) {
+		mPredictors.col(i) = predictors[i].row(0).transpose();
+
+		// square root of half the precision of each Gaussian
+		mPrecisions.col(i) = (mScalesExp.col(i) / 2.).sqrt() * abs(choleskyFactors[i](0, 0));
+	}
+}
+
+
+
+/**
+ * Computes mixture weights and component means for each column of inputs.
+ */
+void PixelMixtures::compute(const MatrixXd& inputs, ArrayXXd& weights, ArrayXXd& means) const {
+	int numData = inputs.cols();
+
+	weights.resize(numWeights(), numData);
+	means.resize(mNumComponents, numData);
+
+	#pragma omp parallel if(numData > 64)
+	{
+		vector<double> featureOutputs(mNumFeatures);
+
+		#pragma omp for
+		for(int j = 0; j < numData; ++j) {
+			const double* input = inputs.data() + j * mDimIn;
+			double* weight = weights.data() + j * numWeights();
+			double* mean = means.data() + j * mNumComponents;
+
+			for(int k = 0; k < mNumFeatures; ++k) {
+				double response = dot(mFeatures.data() + k * mDimIn, input, mDimIn);
+				featureOutputs[k] = response * response;
+			}
+
+			double maxEnergy = -numeric_limits<double>::infinity();
+
+			for(int i = 0; i < mNumComponents; ++i) {
+				double energy =
+					dot(mWeightsSqr.data() + i * mNumFeatures, featureOutputs.data(), mNumFeatures)
+					- 2. * dot(mLinearFeatures.data() + i * mDimIn, input, mDimIn);
+
+				for(int s = 0; s < mNumScales; ++s) {
+					weight[i * mNumScales + s] =
+						mPriors(s, i) - mScalesExp(s, i) / 2. * energy;
+					maxEnergy = max(maxEnergy, weight[i * mNumScales + s]);
+				}
+
+				mean[i] = dot(mPredictors.data() + i * mDimIn, input, mDimIn) + mMeans[i];
+			}
+
+			// normalize weights
+			double weightSum = 0.;
+
+			for(int k = 0; k < numWeights(); ++k) {
+				weight[k] = exp(weight[k] - maxEnergy);
+				weightSum += weight[k];
+			}
+
+			for(int k = 0; k < numWeights(); ++k)
+				weight[k] /= weightSum;
+		}
+	}
+}
+
+
+
+/**
+ * Cumulative frequency of all pixel values smaller than the given value. Every pixel value
+ * is assigned a frequency of at least one, the remaining frequencies are distributed according
+ * to the probability mass of the model in the interval around the value.
+ */
+int PixelMixtures::quantizedCDF(
+	const double* weights,
+	const double* means,
+	int value,
+	int numValues) const
+{
+	if(value <= 0)
+		return 0;
+	if(value >= numValues)
+		return CODEC_TOTAL;
+
+	// probability mass of all values smaller than the given value
+	double cdf = 0.;
+
+	for(int i = 0; i < mNumComponents; ++i) {
+		double diff = means[i] - (value - .5);
+
+		for(int s = 0; s < mNumScales; ++s)
+			cdf += weights[i * mNumScales + s] * erfc(diff * mPrecisions(s, i));
+	}
+
+	cdf = min(max(cdf / 2., 0.), 1.);
+
+	return value + static_cast<int>(cdf * (CODEC_TOTAL - numValues));
+}
+
+
+
+/**
+ * Common checks and preprocessing of encoder and decoder.
+ */
+static PixelMixtures prepareCoding(
+	const MCGSM& model,
+	const ArrayXXb& inputMask,
+	const ArrayXXb& outputMask,
+	const Preconditioner* preconditioner,
+	Tuples& inputIndices,
+	Tuple& outputIndex)
+{
+	pair<Tuples, Tuples> inOutIndices = masksToIndices(inputMask, outputMask);
+	inputIndices = inOutIndices.first;
+
+	if(inOutIndices.second.size() != 1)
+		throw Exception("Only one-pixel output masks are currently supported.");
+
+	outputIndex = inOutIndices.second[0];
+
+	// every input pixel has to be known before the output pixel is decoded
+	for(int i = 0; i < inputIndices.size(); ++i)
+		if(inputIndices[i].first > outputIndex.first || (inputIndices[i].first == outputIndex.first
+			&& inputIndices[i].second > outputIndex.second))
+			throw Exception("Input mask has to be causal.");
+
+	if(preconditioner) {
+		const AffinePreconditioner* affinePreconditioner =
+			dynamic_cast<const AffinePreconditioner*>(preconditioner);
+
+		if(!affinePreconditioner)
+			throw Exception("Only affine preconditioners are supported.");
+		if(affinePreconditioner->dimIn() != inputIndices.size())
+			throw Exception("Preconditioner and masks are incompatible.");
+
+		// the distribution of untransformed pixels is again an MCGSM
+		return PixelMixtures(MCGSM(model, *affinePreconditioner));
+	}
+
+	if(model.dimIn() != inputIndices.size())
+		throw Exception("Model and masks are incompatible.");
+
+	return PixelMixtures(model);
+}
+
+
+
+/**
+ * Positions of neighborhoods grouped into wavefronts. Outputs are coded wavefront by wavefront
+ * after all pixels which aren't covered by the output of any neighborhood.
+ */
+static vector<Tuples> codingOrder(
+	int rows,
+	int cols,
+	const Tuples& inputIndices,
+	const ArrayXXb& inputMask,
+	const Tuple& outputIndex)
+{
+	int h = rows - inputMask.rows() + 1;
+	int w = cols - inputMask.cols() + 1;
+
+	return wavefronts(
+		vector<Tuples>(1, inputIndices),
+		outputIndex.first,
+		outputIndex.second,
+		1, 1,
+		max(h, 0),
+		max(w, 0));
+}
+
+
+
+static inline bool isCovered(int i, int j, int h, int w, const Tuple& outputIndex) {
+	return i >= outputIndex.first && i < outputIndex.first + h
+		&& j >= outputIndex.second && j < outputIndex.second + w;
+}
+
+
+
+static void gatherInputs(
+	const ArrayXXi& img,
+	const Tuples& positions,
+	int offset,
+	const Tuples& inputIndices,
+	MatrixXd& inputs)
+{
+	#pragma omp parallel for if(inputs.cols() > 1024)
+	for(int k = 0; k < inputs.cols(); ++k) {
+		const Tuple& position = positions[offset + k];
+
+		for(int l = 0; l < inputIndices.size(); ++l)
+			inputs(l, k) = img(
+				position.first + inputIndices[l].first,
+				position.second + inputIndices[l].second);
+	}
+}
+
+
+
+vector<unsigned char> CMT::encodeImage(
+	const ArrayXXi& img,
+	const MCGSM& model,
+	const ArrayXXb& inputMask,
+	const ArrayXXb& outputMask,
+	const Preconditioner* preconditioner,
+	int bitDepth)
+{
+	if(bitDepth < 1 || bitDepth > 12)
+		throw Exception("Bit depth has to be between 1 and 12.");
+
+	int numValues = 1 << bitDepth;
+
+	if(img.size() && (img.minCoeff() < 0 || img.maxCoeff() >= numValues))
+		throw Exception("Pixel values have to lie between 0 and 2^bitDepth - 1.");
+
+	Tuples inputIndices;
+	Tuple outputIndex;
+
+	PixelMixtures mixtures = prepareCoding(
+		model, inputMask, outputMask, preconditioner, inputIndices, outputIndex);
+
+	int rows = img.rows();
+	int cols = img.cols();
+	int h = rows - inputMask.rows() + 1;
+	int w = cols - inputMask.cols() + 1;
+
+	// header
+	vector<unsigned char> data;
+	data.reserve(CODEC_HEADER_SIZE + static_cast<size_t>(rows) * cols * bitDepth / 16);
+	data.push_back('C');
+	data.push_back('M');
+	data.push_back('T');
+	data.push_back('I');
+	data.push_back(CODEC_VERSION);
+	data.push_back(bitDepth);
+
+	for(int i = 3; i >= 0; --i)
+		data.push_back((rows >> (8 * i)) & 0xFF);
+	for(int i = 3; i >= 0; --i)
+		data.push_back((cols >> (8 * i)) & 0xFF);
+
+	RangeEncoder encoder(data);
+
+	// pixels without a complete neighborhood are coded with a uniform distribution
+	for(int i = 0; i < rows; ++i)
+		for(int j = 0; j < cols; ++j)
+			if(!isCovered(i, j, h, w, outputIndex))
+				encoder.encode(img(i, j), 1, numValues);
+
+	// all pixel values are known, so neighborhoods don't need to be coded wavefront by wavefront
+	Tuples positions;
+	vector<Tuples> fronts = codingOrder(rows, cols, inputIndices, inputMask, outputIndex);
+
+	for(int f = 0; f < fronts.size(); ++f)
+		positions.insert(positions.end(), fronts[f].begin(), fronts[f].end());
+
+	int numPositions = positions.size();
+	int numCols = 16 * streamingTileSize(numPositions);
+
+	MatrixXd inputs;
+	ArrayXXd weights;
+	ArrayXXd means;
+	vector<int> cumFreqs;
+	vector<int> freqs;
+
+	for(int j = 0; j < numPositions; j += numCols) {
+		int n = min(numCols, numPositions - j);
+
+		inputs.resize(inputIndices.size(), n);
+		gatherInputs(img, positions, j, inputIndices, inputs);
+		mixtures.compute(inputs, weights, means);
+
+		cumFreqs.resize(n);
+		freqs.resize(n);
+
+		#pragma omp parallel for
+		for(int k = 0; k < n; ++k) {
+			int value = img(
+				positions[j + k].first + outputIndex.first,
+				positions[j + k].second + outputIndex.second);
+
+			const double* weight = weights.data() + k * weights.rows();
+			const double* mean = means.data() + k * means.rows();
+
+			cumFreqs[k] = mixtures.quantizedCDF(weight, mean, value, numValues);
+			freqs[k] = mixtures.quantizedCDF(weight, mean, value + 1, numValues) - cumFreqs[k];
+		}
+
+		for(int k = 0; k < n; ++k)
+			encoder.encode(cumFreqs[k], freqs[k], CODEC_TOTAL);
+	}
+
+	encoder.flush();
+
+	return data;
+}
+
+
+
+ArrayXXi CMT::decodeImage(
+	const vector<unsigned char>& data,
+	const MCGSM& model,
+	const ArrayXXb& inputMask,
+	const ArrayXXb& outputMask,
+	const Preconditioner* preconditioner)
+{
+	if(data.size() < CODEC_HEADER_SIZE
+		|| data[0] != 'C' || data[1] != 'M' || data[2] != 'T' || data[3] != 'I')
+		throw Exception("Data does not contain a compressed image.");
+	if(data[4] != CODEC_VERSION)
+		throw Exception("Unsupported version of compressed image.");
+
+	int bitDepth = data[5];
+	uint32_t height = 0;
+	uint32_t width = 0;
+
+	for(int i = 6; i < 10; ++i)
+		height = (height << 8) | data[i];
+	for(int i = 10; i < 14; ++i)
+		width = (width << 8) | data[i];
+
+	// the header is untrusted, so bound the size of the image before allocating it
+	if(bitDepth < 1 || bitDepth > 12
+		|| height > CODEC_MAX_PIXELS || width > CODEC_MAX_PIXELS
+		|| static_cast<uint64_t>(height) * width > CODEC_MAX_PIXELS)
+		throw Exception("Image data is corrupt.");
+
+	int rows = static_cast<int>(height);
+	int cols = static_cast<int>(width);
+
+	int numValues = 1 << bitDepth;
+
+	Tuples inputIndices;
+	Tuple outputIndex;
+
+	PixelMixtures mixtures = prepareCoding(
+		model, inputMask, outputMask, preconditioner, inputIndices, outputIndex);
+
+	int h = rows - inputMask.rows() + 1;
+	int w = cols - inputMask.cols() + 1;
+
+	ArrayXXi img(rows, cols);
+
+	RangeDecoder decoder(data, CODEC_HEADER_SIZE);
+
+	for(int i = 0; i < rows; ++i)
+		for(int j = 0; j < cols; ++j)
+			if(!isCovered(i, j, h, w, outputIndex)) {
+				img(i, j) = decoder.frequency(numValues);
+				decoder.decode(img(i, j), 1);
+			}
+
+	vector<Tuples> fronts = codingOrder(rows, cols, inputIndices, inputMask, outputIndex);
+
+	MatrixXd inputs;
+	ArrayXXd weights;
+	ArrayXXd means;
+
+	// pixels on a wavefront only depend on pixels of previous wavefronts
+	for(int f = 0; f < fronts.size(); ++f) {
+		const Tuples& positions = fronts[f];
+
+		inputs.resize(inputIndices.size(), positions.size());
+		gatherInputs(img, positions, 0, inputIndices, inputs);
+		mixtures.compute(inputs, weights, means);
+
+		for(int k = 0; k < positions.size(); ++k) {
+			const double* weight = weights.data() + k * weights.rows();
+			const double* mean = means.data() + k * means.rows();
+
+			int target = decoder.frequency(CODEC_TOTAL);
+
+			// binary search for the value whose interval contains the target
+			int lower = 0;
+			int upper = numValues;
+			int cumFreqLower = 0;
+			int cumFreqUpper = CODEC_TOTAL;
+
+			while(upper - lower > 1) {
+				int value = (lower + upper) / 2;
+				int cumFreq = mixtures.quantizedCDF(weight, mean, value, numValues);
+
+				if(cumFreq <= target) {
+					lower = value;
+					cumFreqLower = cumFreq;
+				} else {
+					upper = value;
+					cumFreqUpper = cumFreq;
+				}
+			}
+
+			decoder.decode(cumFreqLower, cumFreqUpper - cumFreqLower);
+
+			img(positions[k].first + outputIndex.first, positions[k].second + outputIndex.second) = lower;
+		}
+	}
+
+	return img;
+}
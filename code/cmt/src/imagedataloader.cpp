@@ -0,0 +1,185 @@
+#include "imagedataloader.h"
+#include "exception.h"
+using CMT::Exception;
+
+#include "Eigen/Core"
+using Eigen::ArrayXXd;
+
+#include <algorithm>
+using std::upper_bound;
+
+#include <random>
+using std::uniform_int_distribution;
+
+#include <thread>
+using std::thread;
+
+#include <mutex>
+using std::mutex;
+using std::unique_lock;
+
+#include <new>
+using std::bad_alloc;
+
+#include <cstdlib>
+using std::rand;
+
+#include <vector>
+using std::vector;
+using std::pair;
+using std::make_pair;
+
+CMT::ImageDataLoader::ImageDataLoader(
+	const vector<ArrayXXd>& images,
+	const ArrayXXb& inputMask,
+	const ArrayXXb& outputMask,
+	int batchSize,
+	const Preconditioner* preconditioner) :
+	mImages(images),
+	mMaskRows(inputMask.rows()),
+	mMaskCols(inputMask.cols()),
+	mBatchSize(batchSize),
+	mPreconditioner(preconditioner),
+	mGenerator(rand()),
+	mReady(false),
+	mStop(false)
+{
+	if(mImages.empty())
+		throw Exception("At least one image is required.");
+	if(batchSize < 1)
+		throw Exception("Batch size should be positive.");
+
+	// number of locations of all images up to and including each image
+	long total = 0;
+
+	for(int n = 0; n < mImages.size(); ++n) {
+		long h = mImages[n].rows() - mMaskRows + 1;
+		long w = mImages[n].cols() - mMaskCols + 1;
+
+		if(w < 1 || h < 1)
+			throw Exception("All images should be at least as large as the masks.");
+
+		mPlans.push_back(NeighborhoodPlan(inputMask, outputMask, mImages[n].rows()));
+		total += w * h;
+		mLocations.push_back(total);
+	}
+
+	if(preconditioner)
+		if(preconditioner->dimIn() != mPlans[0].dimIn() || preconditioner->dimOut() != mPlans[0].dimOut())
+			throw Exception("Preconditioner and masks are incompatible.");
+
+	mThread = thread(&ImageDataLoader::prefetch, this);
+}
+
+
+
+CMT::ImageDataLoader::~ImageDataLoader() {
+	{
+		unique_lock<mutex> lock(mMutex);
+		mStop = true;
+	}
+
+	mCondition.notify_all();
+	mThread.join();
+}
+
+
+
+/**
+ * Waits for the batch prepared by the background thread and starts preparing the next one.
+ */
+pair<ArrayXXd, ArrayXXd> CMT::ImageDataLoader::next() {
+	pair<ArrayXXd, ArrayXXd> batch;
+	string errorMessage;
+
+	{
+		unique_lock<mutex> lock(mMutex);
+
+		while(!mReady)
+			mCondition.wait(lock);
+
+		batch.first.swap(mBatch.first);
+		batch.second.swap(mBatch.second);
+		errorMessage.swap(mErrorMessage);
+		mReady = false;
+	}
+
+	mCondition.notify_all();
+
+	if(!errorMessage.empty())
+		throw Exception(errorMessage.c_str());
+
+	return batch;
+}
+
+
+
+pair<ArrayXXd, ArrayXXd> CMT::ImageDataLoader::sampleBatch() {
+	pair<ArrayXXd, ArrayXXd> batch = make_pair(
+		ArrayXXd(mPlans[0].dimIn(), mBatchSize),
+		ArrayXXd(mPlans[0].dimOut(), mBatchSize));
+
+	uniform_int_distribution<long> uniform(0, numLocations() - 1);
+
+	for(int k = 0; k < mBatchSize; ++k) {
+		long location = uniform(mGenerator);
+
+		// find image containing the location
+		int n = upper_bound(mLocations.begin(), mLocations.end(), location) - mLocations.begin();
+
+		if(n > 0)
+			location -= mLocations[n - 1];
+
+		int w = mImages[n].cols() - mMaskCols + 1;
+
+		mPlans[n].gather(mImages[n], location / w, location % w,
+			batch.first.col(k).data(), batch.second.col(k).data());
+	}
+
+	if(mPreconditioner)
+		return mPreconditioner->operator()(batch.first, batch.second);
+
+	return batch;
+}
+
+
+
+/**
+ * Runs in the background thread and keeps one batch ready at all times.
+ */
+void CMT::ImageDataLoader::prefetch() {
+	while(true) {
+		{
+			unique_lock<mutex> lock(mMutex);
+
+			while(mReady && !mStop)
+				mCondition.wait(lock);
+
+			if(mStop)
+				return;
+		}
+
+		pair<ArrayXXd, ArrayXXd> batch;
+		string errorMessage;
+
+		// exceptions may not leave the thread
+		try {
+			batch = sampleBatch();
+		} catch(Exception& exception) {
+			errorMessage = exception.message();
+		} catch(bad_alloc&) {
+			errorMessage = "Not enough memory.";
+		}
+
+		{
+			unique_lock<mutex> lock(mMutex);
+
+			mBatch.first.swap(batch.first);
+			mBatch.second.swap(batch.second);
+			mErrorMessage = errorMessage;
+			mReady = true;
+		}
+
+		mCondition.notify_all();
+	}
+}
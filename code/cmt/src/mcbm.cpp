@@ -372,6 +372,8 @@ void CMT::MCBM::setParameters(const lbfgsfloatval_t* x, const Trainable::Paramet
 		mOutputBias = VectorLBFGS(const_cast<double*>(x) + offset, mNumComponents);
 		offset += mOutputBias.size();
 	}
+
+	mVersion = nextVersion();
 }
 
 
@@ -577,8 +579,23 @@ bool CMT::MCBM::train(
 		double prob = output.array().mean();
 		mPriors.setZero();
 		mOutputBias.setConstant(prob > 0. ? log(prob) : -50.);
+		mVersion = nextVersion();
 		return true;
 	} else {
 		return Trainable::train(input, output, inputVal, outputVal, params);
 	}
 }
+
+
+
+bool CMT::MCBM::train(
+	const WindowView& input,
+	const MatrixXd& output,
+	const Trainable::Parameters& params)
+{
+	if(!mDimIn)
+		// windows are empty and copied at no cost
+		return train(MatrixXd(input), output, 0, 0, params);
+
+	return Trainable::train(input, output, params);
+}
@@ -1,6 +1,7 @@
 #include "mcgsm.h"
 #include "utils.h"
 #include "mogsm.h"
+#include "affinepreconditioner.h"
 
 #include <utility>
 using std::pair;
@@ -13,6 +14,7 @@ using Eigen::MatrixXd;
 using Eigen::Array;
 using Eigen::ArrayXXd;
 using Eigen::ArrayXd;
+using Eigen::VectorXd;
 using Eigen::Map;
 
 #include <cmath>
@@ -40,7 +42,10 @@ CMT::MCGSM::Parameters::Parameters() :
 	regularizePredictors(0.),
 	regularizeWeights(0.),
 	regularizeLinearFeatures(0.),
-	regularizeMeans(0.)
+	regularizeMeans(0.),
+	pruneThreshold(0.),
+	pruneIter(100),
+	splitComponents(false)
 {
 }
 
@@ -60,7 +65,10 @@ CMT::MCGSM::Parameters::Parameters(const Parameters& params) :
 	regularizePredictors(params.regularizePredictors),
 	regularizeWeights(params.regularizeWeights),
 	regularizeLinearFeatures(params.regularizeLinearFeatures),
-	regularizeMeans(params.regularizeMeans)
+	regularizeMeans(params.regularizeMeans),
+	pruneThreshold(params.pruneThreshold),
+	pruneIter(params.pruneIter),
+	splitComponents(params.splitComponents)
 {
 }
 
@@ -82,12 +90,90 @@ CMT::MCGSM::Parameters& CMT::MCGSM::Parameters::operator=(const Parameters& para
 	regularizeWeights = params.regularizeWeights;
 	regularizeLinearFeatures = params.regularizeLinearFeatures;
 	regularizeWeights = params.regularizeWeights;
+	pruneThreshold = params.pruneThreshold;
+	pruneIter = params.pruneIter;
+	splitComponents = params.splitComponents;
 
 	return *this;
 }
 
 
 
+/**
+ * Number of data points processed by a single task. Tiles are chosen such that the working
+ * set of a task, which grows linearly with the given number of rows, fits into L2 cache.
+ */
+static int tileSize(int numRows) {
+	return max(64, 32768 / max(numRows, 1));
+}
+
+
+
+CMT::MCGSM::Intermediates::Intermediates(
+	const MCGSM& mcgsm,
+	const MatrixXd& input,
+	const MatrixXd& output) :
+	mcgsm(&mcgsm),
+	version(mcgsm.version()),
+	predErrors(mcgsm.mNumComponents),
+	logJointIn(mcgsm.mNumComponents),
+	logJointOut(mcgsm.mNumComponents),
+	logNormInScales(mcgsm.mNumComponents, output.cols()),
+	logNormOutScales(mcgsm.mNumComponents, output.cols())
+{
+	if(input.rows() != mcgsm.mDimIn || output.rows() != mcgsm.mDimOut)
+		throw Exception("Data has wrong dimensionality.");
+	if(mcgsm.mDimIn && input.cols() != output.cols())
+		throw Exception("The number of inputs and outputs should be the same.");
+
+	int numComponents = mcgsm.mNumComponents;
+	int dimOut = mcgsm.mDimOut;
+
+	MatrixXd weightsOutput;
+
+	if(mcgsm.mDimIn) {
+		featuresOutput = mcgsm.mFeatures.transpose() * input;
+		weightsOutput = mcgsm.mWeights.square().matrix() * featuresOutput.array().square().matrix()
+			- 2. * mcgsm.mLinearFeatures * input;
+	}
+
+	#pragma omp parallel for
+	for(int i = 0; i < numComponents; ++i) {
+		VectorXd scalesExp = mcgsm.mScales.row(i).transpose().exp();
+
+		// gate energy
+		if(mcgsm.mDimIn) {
+			logJointIn[i] = -scalesExp / 2. * weightsOutput.row(i);
+			logJointIn[i].colwise() += mcgsm.mPriors.row(i).transpose();
+			predErrors[i] = mcgsm.mCholeskyFactors[i].transpose()
+				* ((output - mcgsm.mPredictors[i] * input).colwise() - mcgsm.mMeans.col(i));
+		} else {
+			logJointIn[i] = ArrayXXd(mcgsm.mNumScales, output.cols());
+			logJointIn[i].colwise() = mcgsm.mPriors.row(i).transpose();
+			predErrors[i] = mcgsm.mCholeskyFactors[i].transpose()
+				* (output.colwise() - mcgsm.mMeans.col(i));
+		}
+
+		// normalized expert energy
+		ArrayXXd negEnergyExpert = -scalesExp / 2. * predErrors[i].colwise().squaredNorm();
+		double logDet = mcgsm.mCholeskyFactors[i].diagonal().array().abs().log().sum();
+		negEnergyExpert.colwise() += dimOut / 2. * mcgsm.mScales.row(i).transpose()
+			+ logDet - dimOut / 2. * log(2. * PI);
+
+		logJointOut[i] = logJointIn[i] + negEnergyExpert;
+
+		// marginalize out scales
+		logNormInScales.row(i) = logSumExp(logJointIn[i]);
+		logNormOutScales.row(i) = logSumExp(logJointOut[i]);
+	}
+
+	// marginalize out components
+	logNormIn = logSumExp(logNormInScales);
+	logNormOut = logSumExp(logNormOutScales);
+}
+
+
+
 CMT::MCGSM::MCGSM(
 	int dimIn,
 	int dimOut,
@@ -184,6 +270,76 @@ CMT::MCGSM::MCGSM(int dimIn, const MCGSM& mcgsm) :
 
 
 
+/**
+ * Creates a model on unpreconditioned data which is equivalent to applying the preconditioner
+ * and then evaluating the given model. The log-Jacobian of the preconditioner is absorbed into
+ * the Cholesky factors, so that the log-likelihoods of both pipelines are identical.
+ */
+CMT::MCGSM::MCGSM(const MCGSM& mcgsm, const AffinePreconditioner& preconditioner) :
+	mDimIn(preconditioner.dimIn()),
+	mDimOut(preconditioner.dimOut()),
+	mNumComponents(mcgsm.numComponents()),
+	mNumScales(mcgsm.numScales()),
+	mNumFeatures(mcgsm.numFeatures())
+{
+	if(preconditioner.dimInPre() != mcgsm.dimIn() || preconditioner.dimOutPre() != mcgsm.dimOut())
+		throw Exception("Model and preconditioner are incompatible.");
+	if(preconditioner.dimOutPre() != preconditioner.dimOut())
+		throw Exception("Output transformation of preconditioner has to be invertible.");
+
+	MatrixXd preIn = preconditioner.preIn();
+	MatrixXd preOut = preconditioner.preOut();
+	MatrixXd preOutInv = preconditioner.preOutInv();
+	VectorXd meanInPre = VectorXd::Zero(mcgsm.dimIn());
+
+	if(mcgsm.dimIn())
+		meanInPre = preIn * preconditioner.meanIn();
+
+	mPriors = mcgsm.mPriors;
+	mScales = mcgsm.mScales;
+	mWeights = mcgsm.mWeights;
+
+	// features of transformed inputs and their offsets
+	mFeatures = preIn.transpose() * mcgsm.mFeatures;
+	VectorXd featuresMean = mcgsm.mFeatures.transpose() * meanInPre;
+	MatrixXd weightsSqr = mcgsm.mWeights.square();
+
+	// offsets turn into linear features and scale-dependent constants of the gates
+	mLinearFeatures = mcgsm.mLinearFeatures * preIn
+		+ weightsSqr * featuresMean.asDiagonal() * mFeatures.transpose();
+	ArrayXd gateConsts = (weightsSqr * featuresMean.array().square().matrix()
+		+ 2. * mcgsm.mLinearFeatures * meanInPre).array();
+	mPriors -= mScales.exp().colwise() * gateConsts / 2.;
+
+	mMeans = MatrixXd(mDimOut, mNumComponents);
+
+	vector<MatrixXd> choleskyFactors;
+
+	for(int i = 0; i < mNumComponents; ++i) {
+		MatrixXd predictor = preOutInv * mcgsm.mPredictors[i];
+
+		if(mcgsm.dimIn())
+			predictor += preconditioner.predictor();
+
+		mPredictors.push_back(predictor * preIn);
+		mMeans.col(i) = preconditioner.meanOut() + preOutInv * mcgsm.mMeans.col(i) - predictor * meanInPre;
+
+		// precision of outputs before preconditioning
+		MatrixXd precision = preOut.transpose()
+			* mcgsm.mCholeskyFactors[i] * mcgsm.mCholeskyFactors[i].transpose() * preOut;
+		choleskyFactors.push_back(precision.llt().matrixL());
+	}
+
+	// the scale of each Cholesky factor is moved into scales and weights, but linear features
+	// enter the gates like squared weights and have to be rescaled here
+	for(int i = 0; i < mNumComponents; ++i)
+		mLinearFeatures.row(i) /= choleskyFactors[i](0, 0) * choleskyFactors[i](0, 0);
+
+	setCholeskyFactors(choleskyFactors);
+}
+
+
+
 CMT::MCGSM::~MCGSM() {
 }
 
@@ -236,8 +392,11 @@ void CMT::MCGSM::initialize(const MatrixXd& input, const MatrixXd& output) {
 
 		setCholeskyFactors(choleskyFactors);
 	} else {
-		MatrixXd covXX = covariance(input);
-		MatrixXd covXY = covariance(input, output);
+		Moments moments(mDimIn, mDimOut);
+		moments.update(input, output);
+
+		MatrixXd covXX = moments.covXX();
+		MatrixXd covYX = moments.covYX();
 
 		MatrixXd whitening = SelfAdjointEigenSolver<MatrixXd>(covXX).operatorInverseSqrt();
 
@@ -249,8 +408,9 @@ void CMT::MCGSM::initialize(const MatrixXd& input, const MatrixXd& output) {
 		mMeans.setZero();
 
 		// optimal linear predictor and precision
-		MatrixXd predictor = covXY.transpose() * covXX.inverse();
-		MatrixXd choleskyFactor = covariance(output - predictor * input).inverse().llt().matrixL();
+		MatrixXd predictor = covYX * covXX.inverse();
+		MatrixXd covResidual = moments.covYY() - predictor * covYX.transpose();
+		MatrixXd choleskyFactor = covResidual.inverse().llt().matrixL();
 		vector<MatrixXd> choleskyFactors;
 
 		for(int i = 0; i < mNumComponents; ++i) {
@@ -264,6 +424,89 @@ void CMT::MCGSM::initialize(const MatrixXd& input, const MatrixXd& output) {
 
 
 
+int CMT::MCGSM::pruneComponents(double threshold) {
+	// prior probability mass of each component
+	ArrayXd logMass = logSumExp(mPriors.transpose()).transpose();
+	ArrayXd mass = (logMass - logSumExp(logMass)(0)).exp();
+
+	int kMax;
+	mass.maxCoeff(&kMax);
+
+	// the most probable component is always kept
+	vector<int> indices;
+	for(int k = 0; k < mNumComponents; ++k)
+		if(mass[k] >= threshold || k == kMax)
+			indices.push_back(k);
+
+	int numPruned = mNumComponents - indices.size();
+
+	if(!numPruned)
+		return 0;
+
+	ArrayXXd priors(indices.size(), mNumScales);
+	ArrayXXd scales(indices.size(), mNumScales);
+	ArrayXXd weights(indices.size(), mNumFeatures);
+	MatrixXd linearFeatures(indices.size(), mDimIn);
+	MatrixXd means(mDimOut, indices.size());
+	vector<MatrixXd> choleskyFactors;
+	vector<MatrixXd> predictors;
+
+	for(int i = 0; i < indices.size(); ++i) {
+		int k = indices[i];
+
+		priors.row(i) = mPriors.row(k);
+		scales.row(i) = mScales.row(k);
+		weights.row(i) = mWeights.row(k);
+		linearFeatures.row(i) = mLinearFeatures.row(k);
+		means.col(i) = mMeans.col(k);
+		choleskyFactors.push_back(mCholeskyFactors[k]);
+		predictors.push_back(mPredictors[k]);
+	}
+
+	mNumComponents = indices.size();
+	mPriors = priors;
+	mScales = scales;
+	mWeights = weights;
+	mLinearFeatures = linearFeatures;
+	mMeans = means;
+	mCholeskyFactors = choleskyFactors;
+	mPredictors = predictors;
+	mVersion = nextVersion();
+
+	return numPruned;
+}
+
+
+
+void CMT::MCGSM::splitComponent(int i) {
+	if(i < 0 || i >= mNumComponents)
+		throw Exception("Invalid component index.");
+
+	int k = mNumComponents++;
+
+	// both halves share the prior mass of the original component
+	mPriors.row(i) -= log(2.);
+
+	mPriors.conservativeResize(mNumComponents, mNumScales);
+	mScales.conservativeResize(mNumComponents, mNumScales);
+	mWeights.conservativeResize(mNumComponents, mNumFeatures);
+	mLinearFeatures.conservativeResize(mNumComponents, mDimIn);
+	mMeans.conservativeResize(mDimOut, mNumComponents);
+
+	mPriors.row(k) = mPriors.row(i);
+	mScales.row(k) = mScales.row(i) + sampleNormal(1, mNumScales) / 100.;
+	mWeights.row(k) = mWeights.row(i);
+	mLinearFeatures.row(k) = mLinearFeatures.row(i);
+	mMeans.col(k) = mMeans.col(i);
+
+	// perturb predictor to break the symmetry between the two components
+	mCholeskyFactors.push_back(mCholeskyFactors[i]);
+	mPredictors.push_back(mPredictors[i] + sampleNormal(mDimOut, mDimIn).matrix() / 100.);
+	mVersion = nextVersion();
+}
+
+
+
 MatrixXd CMT::MCGSM::sample(const MatrixXd& input) const {
 	// initialize samples with Gaussian noise
 	MatrixXd output = sampleNormal(mDimOut, input.cols());
@@ -443,35 +686,52 @@ ArrayXXd CMT::MCGSM::prior(const MatrixXd& input) const {
 	if(input.rows() != mDimIn)
 		throw Exception("Data has wrong dimensionality.");
 
-	ArrayXXd prior(mNumComponents, input.cols());
+	int numData = input.cols();
+	int numCols = tileSize(mNumScales + mDimIn);
+	int numTiles = (numData + numCols - 1) / numCols;
 
-	MatrixXd weightsOutput;
+	ArrayXXd prior(mNumComponents, numData);
+	MatrixXd weightsOutput = featureEnergies(input);
 	MatrixXd scalesExp = mScales.exp().transpose();
 
-	if(mDimIn) {
-		ArrayXXd featuresOutput = mFeatures.transpose() * input;
-		weightsOutput = mWeights.square().matrix() * featuresOutput.square().matrix()
-			- 2. * mLinearFeatures * input;
-	}
-
+	// parallelize over tiles of data points and components
 	#pragma omp parallel for
-	for(int i = 0; i < mNumComponents; ++i) {
+	for(int t = 0; t < numTiles * mNumComponents; ++t) {
+		int i = t % mNumComponents;
+		int j = t / mNumComponents * numCols;
+		int n = min(numCols, numData - j);
+
 		// compute unnormalized posterior
-		ArrayXXd negEnergy(mNumScales, input.cols());
-		
+		ArrayXXd negEnergy(mNumScales, n);
+
 		if(mDimIn) {
-			negEnergy = -scalesExp.col(i) / 2. * weightsOutput.row(i);
+			negEnergy = -scalesExp.col(i) / 2. * weightsOutput.row(i).segment(j, n);
 			negEnergy.colwise() += mPriors.row(i).transpose();
 		} else {
 			negEnergy.colwise() = mPriors.row(i).transpose();
 		}
 
 		// marginalize out scales
-		prior.row(i) = logSumExp(negEnergy);
+		prior.block(i, j, 1, n) = logSumExp(negEnergy);
+	}
+
+	// normalize prior
+	#pragma omp parallel for
+	for(int j = 0; j < numData; j += numCols) {
+		int n = min(numCols, numData - j);
+		prior.middleCols(j, n) = (prior.middleCols(j, n).rowwise()
+			- logSumExp(prior.middleCols(j, n))).exp();
 	}
 
-	// return normalized prior
-	return (prior.rowwise() - logSumExp(prior)).exp();
+	return prior;
+}
+
+
+
+ArrayXXd CMT::MCGSM::prior(const Intermediates& intermediates) const {
+	checkIntermediates(intermediates);
+
+	return (intermediates.logNormInScales.rowwise() - intermediates.logNormIn).exp();
 }
 
 
@@ -482,29 +742,33 @@ ArrayXXd CMT::MCGSM::posterior(const MatrixXd& input, const MatrixXd& output) co
 	if(input.cols() != output.cols())
 		throw Exception("The number of inputs and outputs should be the same.");
 
-	ArrayXXd posterior(mNumComponents, input.cols());
+	int numData = output.cols();
+	int numCols = tileSize(mNumScales + mDimIn + 2 * mDimOut);
+	int numTiles = (numData + numCols - 1) / numCols;
 
-	MatrixXd weightsOutput;
+	ArrayXXd posterior(mNumComponents, numData);
+	MatrixXd weightsOutput = featureEnergies(input);
 	MatrixXd scalesExp = mScales.array().exp().transpose();
 
-	if(mDimIn) {
-		ArrayXXd featuresOutput = mFeatures.transpose() * input;
-		weightsOutput = mWeights.square().matrix() * featuresOutput.square().matrix()
-			- 2. * mLinearFeatures * input;
-	}
-
+	// parallelize over tiles of data points and components
 	#pragma omp parallel for
-	for(int i = 0; i < mNumComponents; ++i) {
+	for(int t = 0; t < numTiles * mNumComponents; ++t) {
+		int i = t % mNumComponents;
+		int j = t / mNumComponents * numCols;
+		int n = min(numCols, numData - j);
+
 		Matrix<double, 1, Dynamic> errorSqr;
 		ArrayXXd negEnergy;
 
 		// compute unnormalized posterior
 		if(mDimIn) {
 			errorSqr = (mCholeskyFactors[i].transpose() *
-				((output - mPredictors[i] * input).colwise() - mMeans.col(i))).colwise().squaredNorm();
-			negEnergy = -scalesExp.col(i) / 2. * (weightsOutput.row(i) + errorSqr);
+				((output.middleCols(j, n) - mPredictors[i] * input.middleCols(j, n)).colwise()
+					- mMeans.col(i))).colwise().squaredNorm();
+			negEnergy = -scalesExp.col(i) / 2. * (weightsOutput.row(i).segment(j, n) + errorSqr);
 		} else {
-			errorSqr = (mCholeskyFactors[i].transpose() * (output.colwise() - mMeans.col(i))).colwise().squaredNorm();
+			errorSqr = (mCholeskyFactors[i].transpose() *
+				(output.middleCols(j, n).colwise() - mMeans.col(i))).colwise().squaredNorm();
 			negEnergy = -scalesExp.col(i) / 2. * errorSqr;
 		}
 
@@ -514,11 +778,26 @@ ArrayXXd CMT::MCGSM::posterior(const MatrixXd& input, const MatrixXd& output) co
 		negEnergy.colwise() += mPriors.row(i).transpose() + logPartf;
 
 		// marginalize out scales
-		posterior.row(i) = logSumExp(negEnergy);
+		posterior.block(i, j, 1, n) = logSumExp(negEnergy);
+	}
+
+	// normalize posterior
+	#pragma omp parallel for
+	for(int j = 0; j < numData; j += numCols) {
+		int n = min(numCols, numData - j);
+		posterior.middleCols(j, n) = (posterior.middleCols(j, n).rowwise()
+			- logSumExp(posterior.middleCols(j, n))).exp();
 	}
 
-	// return normalized posterior
-	return (posterior.rowwise() - logSumExp(posterior)).exp();
+	return posterior;
+}
+
+
+
+ArrayXXd CMT::MCGSM::posterior(const Intermediates& intermediates) const {
+	checkIntermediates(intermediates);
+
+	return (intermediates.logNormOutScales.rowwise() - intermediates.logNormOut).exp();
 }
 
 
@@ -532,35 +811,41 @@ Array<double, 1, Dynamic> CMT::MCGSM::logLikelihood(
 	if(mDimIn && input.cols() != output.cols())
 		throw Exception("The number of inputs and outputs should be the same.");
 
-	ArrayXXd logLikelihood(mNumComponents, input.cols());
-	ArrayXXd normConsts(mNumComponents, input.cols());
+	int numData = output.cols();
+	int numCols = tileSize(mNumScales + mDimIn + 2 * mDimOut);
+	int numTiles = (numData + numCols - 1) / numCols;
 
-	MatrixXd weightsOutput;
-	MatrixXd scalesExp = mScales.array().exp().transpose();
+	ArrayXXd logLikelihood(mNumComponents, numData);
+	ArrayXXd normConsts(mNumComponents, numData);
 
-	if(mDimIn) {
-		ArrayXXd featuresOutput = mFeatures.transpose() * input;
-		weightsOutput = mWeights.square().matrix() * featuresOutput.square().matrix()
-			- 2. * mLinearFeatures * input;
-	}
+	MatrixXd weightsOutput = featureEnergies(input);
+	MatrixXd scalesExp = mScales.array().exp().transpose();
 
+	// parallelize over tiles of data points and components
 	#pragma omp parallel for
-	for(int i = 0; i < mNumComponents; ++i) {
-		ArrayXXd negEnergy(mNumScales, output.cols());
+	for(int t = 0; t < numTiles * mNumComponents; ++t) {
+		int i = t % mNumComponents;
+		int j = t / mNumComponents * numCols;
+		int n = min(numCols, numData - j);
+
+		ArrayXXd negEnergy(mNumScales, n);
 		MatrixXd outputWhitened;
 
 		// compute gate energy
 		if(mDimIn) {
-			negEnergy = -scalesExp.col(i) / 2. * weightsOutput.row(i);
+			negEnergy = -scalesExp.col(i) / 2. * weightsOutput.row(i).segment(j, n);
 			negEnergy.colwise() += mPriors.row(i).transpose();
-			outputWhitened = mCholeskyFactors[i].transpose() * ((output - mPredictors[i] * input).colwise() - mMeans.col(i));
+			outputWhitened = mCholeskyFactors[i].transpose() *
+				((output.middleCols(j, n) - mPredictors[i] * input.middleCols(j, n)).colwise()
+					- mMeans.col(i));
 		} else {
 			negEnergy.colwise() = mPriors.row(i).transpose();
-			outputWhitened = mCholeskyFactors[i].transpose() * (output.colwise() - mMeans.col(i));
+			outputWhitened = mCholeskyFactors[i].transpose() *
+				(output.middleCols(j, n).colwise() - mMeans.col(i));
 		}
 
 		// normalization constants of gates
-		normConsts.row(i) = logSumExp(negEnergy);
+		normConsts.block(i, j, 1, n) = logSumExp(negEnergy);
 
 		// compute expert energy
 		negEnergy -= (scalesExp.col(i) / 2. * outputWhitened.colwise().squaredNorm()).array();
@@ -572,11 +857,20 @@ Array<double, 1, Dynamic> CMT::MCGSM::logLikelihood(
 		negEnergy.colwise() += logPartf;
 
 		// marginalize out scales
-		logLikelihood.row(i) = logSumExp(negEnergy);
+		logLikelihood.block(i, j, 1, n) = logSumExp(negEnergy);
 	}
 
+	Array<double, 1, Dynamic> result(numData);
+
 	// marginalize out components
-	return logSumExp(logLikelihood) - logSumExp(normConsts);
+	#pragma omp parallel for
+	for(int j = 0; j < numData; j += numCols) {
+		int n = min(numCols, numData - j);
+		result.segment(j, n) = logSumExp(logLikelihood.middleCols(j, n))
+			- logSumExp(normConsts.middleCols(j, n));
+	}
+
+	return result;
 }
 
 
@@ -644,6 +938,14 @@ Array<double, 1, Dynamic> CMT::MCGSM::logLikelihood(
 
 
 
+Array<double, 1, Dynamic> CMT::MCGSM::logLikelihood(const Intermediates& intermediates) const {
+	checkIntermediates(intermediates);
+
+	return intermediates.logNormOut - intermediates.logNormIn;
+}
+
+
+
 int CMT::MCGSM::numParameters(const Trainable::Parameters& params_) const {
 	const Parameters& params = dynamic_cast<const Parameters&>(params_);
 
@@ -760,6 +1062,8 @@ void CMT::MCGSM::setParameters(const lbfgsfloatval_t* x, const Trainable::Parame
 		mMeans = MatrixLBFGS(const_cast<double*>(x) + offset, mDimOut, mNumComponents);
 		offset += mMeans.size();
 	}
+
+	mVersion = nextVersion();
 }
 
 
@@ -1066,140 +1370,135 @@ pair<pair<ArrayXXd, ArrayXXd>, Array<double, 1, Dynamic> > CMT::MCGSM::computeDa
 	const MatrixXd& input,
 	const MatrixXd& output) const
 {
-	if(input.rows() > 0) {
-		// compute unnormalized posterior
-		MatrixXd featureOutput = mFeatures.transpose() * input;
-		MatrixXd featureOutputSqr = featureOutput.array().square();
-		MatrixXd weightsSqr = mWeights.array().square();
-		MatrixXd weightsSqrOutput = weightsSqr * featureOutputSqr - 2. * mLinearFeatures * input;
-
-		// containers for intermediate results
-		vector<ArrayXXd> logPosteriorIn(mNumComponents);
-		vector<ArrayXXd> logPosteriorOut(mNumComponents);
-		vector<MatrixXd> predError(mNumComponents);
-		vector<VectorXd> scalesExp(mNumComponents);
-
-		// partial normalization constants
-		ArrayXXd logNormInScales(mNumComponents, input.cols());
-		ArrayXXd logNormOutScales(mNumComponents, input.cols());
-
-		#pragma omp parallel for
-		for(int i = 0; i < mNumComponents; ++i) {
-			scalesExp[i] = mScales.row(i).transpose().array().exp();
-
-			// gate energy
-			ArrayXXd negEnergyGate = -scalesExp[i] / 2. * weightsSqrOutput.row(i);
-			negEnergyGate.colwise() += mPriors.row(i).transpose();
+	return computeDataGradient(Intermediates(*this, input, output));
+}
 
-			predError[i] = mCholeskyFactors[i].transpose() * ((output - mPredictors[i] * input).colwise() - mMeans.col(i));
-			ArrayXXd negEnergyExpert = -scalesExp[i] / 2. * predError[i].colwise().squaredNorm();
 
-			// normalize expert energy
-			double logDet = mCholeskyFactors[i].diagonal().array().abs().log().sum();
-			negEnergyExpert.colwise() += mDimOut / 2. * mScales.row(i).transpose()
-				+ logDet - mDimOut / 2. * log(2. * PI);
 
-			// unnormalized posterior
-			logPosteriorIn[i] = negEnergyGate;
-			logPosteriorOut[i] = negEnergyGate + negEnergyExpert;
+pair<pair<ArrayXXd, ArrayXXd>, Array<double, 1, Dynamic> > CMT::MCGSM::computeDataGradient(
+	const Intermediates& intermediates) const
+{
+	checkIntermediates(intermediates);
 
-			// compute normalization constants for posterior over scales
-			logNormInScales.row(i) = logSumExp(logPosteriorIn[i]);
-			logNormOutScales.row(i) = logSumExp(logPosteriorOut[i]);
-		}
+	const Array<double, 1, Dynamic>& logNormIn = intermediates.logNormIn;
+	const Array<double, 1, Dynamic>& logNormOut = intermediates.logNormOut;
 
-		Array<double, 1, Dynamic> logNormIn;
-		Array<double, 1, Dynamic> logNormOut;
-
-		// compute normalization constants
-		#pragma omp parallel sections
-		{
-			#pragma omp section
-			logNormIn = logSumExp(logNormInScales);
-			#pragma omp section
-			logNormOut = logSumExp(logNormOutScales);
-		}
+	MatrixXd weightsSqr = mWeights.square();
 
-		Array<double, 1, Dynamic> logLikelihood = logNormOut - logNormIn;
+	ArrayXXd inputGradients = ArrayXXd::Zero(mDimIn, logNormOut.cols());
+	ArrayXXd outputGradients = ArrayXXd::Zero(mDimOut, logNormOut.cols());
 
-		ArrayXXd inputGradients = ArrayXXd::Zero(mDimIn, input.cols());
-		ArrayXXd outputGradients = ArrayXXd::Zero(mDimOut, output.cols());
+	#pragma omp parallel for
+	for(int i = 0; i < mNumComponents; ++i) {
+		VectorXd scalesExp = mScales.row(i).transpose().array().exp();
 
-		#pragma omp parallel for
-		for(int i = 0; i < mNumComponents; ++i) {
-			// normalize posterior
-			logPosteriorIn[i].rowwise() -= logNormIn;
-			logPosteriorOut[i].rowwise() -= logNormOut;
+		// posterior over this component and all scales
+		MatrixXd posteriorIn = (intermediates.logJointIn[i].rowwise() - logNormIn).exp();
+		MatrixXd posteriorOut = (intermediates.logJointOut[i].rowwise() - logNormOut).exp();
 
-			// posterior over this component and all scales
-			MatrixXd posteriorIn = logPosteriorIn[i].exp();
-			MatrixXd posteriorOut = logPosteriorOut[i].exp();
-			MatrixXd posteriorDiff = posteriorOut - posteriorIn;
+		ArrayXXd dpdy = -mCholeskyFactors[i] * intermediates.predErrors[i];
+		Array<double, 1, Dynamic> weightsOut = scalesExp.transpose() * posteriorOut;
 
-			ArrayXXd dpdy = -mCholeskyFactors[i] * predError[i];
+		if(mDimIn) {
 			ArrayXXd dpdx = -mPredictors[i].transpose() * dpdy.matrix();
-			ArrayXXd dfdx = -(mFeatures.array().rowwise() * weightsSqr.row(i).array()).matrix() * featureOutput;
+			ArrayXXd dfdx = -(mFeatures.array().rowwise() * weightsSqr.row(i).array()).matrix()
+				* intermediates.featuresOutput;
 			dfdx.colwise() += mLinearFeatures.row(i).array().transpose();
 
-			// weights for this component
-			Array<double, 1, Dynamic> weightsOut = scalesExp[i].transpose() * posteriorOut;
-			Array<double, 1, Dynamic> weightsDiff = scalesExp[i].transpose() * posteriorDiff;
+			Array<double, 1, Dynamic> weightsDiff = scalesExp.transpose() * (posteriorOut - posteriorIn);
 
 			#pragma omp critical
 			{
 				inputGradients += dpdx.rowwise() * weightsOut + dfdx.rowwise() * weightsDiff;
 				outputGradients += dpdy.rowwise() * weightsOut;
 			}
+		} else {
+			#pragma omp critical
+			outputGradients += dpdy.rowwise() * weightsOut;
 		}
+	}
 
-		return make_pair(make_pair(inputGradients, outputGradients), logLikelihood);
-	} else {
-		vector<VectorXd> scalesExp(mNumComponents);
-		vector<MatrixXd> predError(mNumComponents);
-		vector<ArrayXXd> logPosterior(mNumComponents);
-		ArrayXXd logNormScales(mNumComponents, output.cols());
+	return make_pair(make_pair(inputGradients, outputGradients), logNormOut - logNormIn);
+}
 
-		#pragma omp parallel for
-		for(int i = 0; i < mNumComponents; ++i) {
-			scalesExp[i] = mScales.row(i).transpose().array().exp();
-			predError[i] = mCholeskyFactors[i].transpose() * (output.colwise() - mMeans.col(i));
 
-			ArrayXXd negEnergyExpert = -scalesExp[i] / 2. * predError[i].colwise().squaredNorm();
 
-			// normalize expert energy
-			double logDet = mCholeskyFactors[i].diagonal().array().abs().log().sum();
-			negEnergyExpert.colwise() += mDimOut / 2. * mScales.row(i).transpose()
-				+ logDet - mDimOut / 2. * log(2. * PI);
+MatrixXd CMT::MCGSM::featureEnergies(const MatrixXd& input) const {
+	if(!mDimIn)
+		return MatrixXd();
 
-			// posterior over scales and normalization constants
-			logPosterior[i] = negEnergyExpert.colwise() + mPriors.row(i).transpose();
-			logNormScales.row(i) = logSumExp(logPosterior[i]);
-		}
+	int numData = input.cols();
+	int numCols = tileSize(mNumFeatures + mNumComponents);
 
-		
-		Array<double, 1, Dynamic> logNorm = logSumExp(logNormScales);
-		Array<double, 1, Dynamic> logLikelihood = logNorm
-			- logSumExp(VectorXd::Map(mPriors.data(), mPriors.size()))[0];
+	MatrixXd weightsSqr = mWeights.square();
+	MatrixXd weightsOutput(mNumComponents, numData);
 
-		ArrayXXd inputGradients = ArrayXXd::Zero(mDimIn, input.cols());
-		ArrayXXd outputGradients = ArrayXXd::Zero(mDimOut, output.cols());
+	#pragma omp parallel for
+	for(int j = 0; j < numData; j += numCols) {
+		int n = min(numCols, numData - j);
 
-		#pragma omp parallel for
-		for(int i = 0; i < mNumComponents; ++i) {
-			logPosterior[i].rowwise() -= logNorm;
+		MatrixXd featuresOutput = mFeatures.transpose() * input.middleCols(j, n);
 
-			// posterior over this component and scales
-			MatrixXd posterior = logPosterior[i].exp();
+		weightsOutput.middleCols(j, n) = weightsSqr * featuresOutput.array().square().matrix()
+			- 2. * mLinearFeatures * input.middleCols(j, n);
+	}
 
-			ArrayXXd dpdy = -mCholeskyFactors[i] * predError[i];
-			Array<double, 1, Dynamic> weights = scalesExp[i].transpose() * posterior;
+	return weightsOutput;
+}
 
-			#pragma omp critical
-			outputGradients += dpdy.rowwise() * weights;
-		}
 
-		return make_pair(make_pair(inputGradients, outputGradients), logLikelihood);
+
+void CMT::MCGSM::checkIntermediates(const Intermediates& intermediates) const {
+	if(intermediates.mcgsm != this || intermediates.version != mVersion)
+		throw Exception("Intermediates were computed with different model parameters.");
+}
+
+
+
+/**
+ * Alternates between optimization and pruning of unused components. Each round trains on the
+ * given data with pruning disabled.
+ */
+template <class Input>
+bool CMT::MCGSM::trainPruned(
+	const Input& input,
+	const MatrixXd& output,
+	const MatrixXd* inputVal,
+	const MatrixXd* outputVal,
+	const Parameters& params)
+{
+	Parameters paramsRound(params);
+	paramsRound.pruneThreshold = 0.;
+
+	bool converged = false;
+
+	for(int iter = 0; iter < params.maxIter; iter += paramsRound.maxIter) {
+		paramsRound.maxIter = params.pruneIter > 0 ?
+			min(params.pruneIter, params.maxIter - iter) : params.maxIter - iter;
+
+		converged = train(input, output, inputVal, outputVal, paramsRound);
+
+		int numPruned = pruneComponents(params.pruneThreshold);
+
+		if(params.splitComponents)
+			// reuse computational budget by splitting the most probable components
+			for(int i = 0; i < numPruned; ++i) {
+				ArrayXd logMass = logSumExp(mPriors.transpose()).transpose();
+
+				int k;
+				logMass.maxCoeff(&k);
+
+				splitComponent(k);
+			}
+
+		if(params.verbosity > 0 && numPruned > 0)
+			cout << "Pruned " << numPruned << " components." << endl;
+
+		if(converged && !numPruned)
+			break;
 	}
+
+	return converged;
 }
 
 
@@ -1211,9 +1510,12 @@ bool CMT::MCGSM::train(
 	const MatrixXd* outputVal,
 	const Trainable::Parameters& params_)
 {
-	if(!mDimIn) {
-		const Parameters& params = dynamic_cast<const Parameters&>(params_);
+	const Parameters& params = dynamic_cast<const Parameters&>(params_);
+
+	if(params.pruneThreshold > 0.)
+		return trainPruned(input, output, inputVal, outputVal, params);
 
+	if(!mDimIn) {
 		// MCGSM reduces to MoGSM for zero-dimensional inputs
 		MoGSM mogsm(mDimOut, mNumComponents, mNumScales);
 
@@ -1274,3 +1576,38 @@ bool CMT::MCGSM::train(
 		return Trainable::train(input, output, inputVal, outputVal, params_);
 	}
 }
+
+
+
+bool CMT::MCGSM::train(
+	const WindowView& input,
+	const MatrixXd& output,
+	const Trainable::Parameters& params_)
+{
+	const Parameters& params = dynamic_cast<const Parameters&>(params_);
+
+	if(!mDimIn)
+		// windows are empty and copied at no cost
+		return train(MatrixXd(input), output, 0, 0, params_);
+
+	if(params.pruneThreshold > 0.)
+		return trainPruned(input, output, 0, 0, params);
+
+	return Trainable::train(input, output, params_);
+}
+
+
+
+bool CMT::MCGSM::train(
+	const WindowView& input,
+	const MatrixXd& output,
+	const MatrixXd* inputVal,
+	const MatrixXd* outputVal,
+	const Trainable::Parameters& params)
+{
+	if(inputVal || outputVal)
+		throw Exception("Validation data is not supported when training on windows.");
+
+	return train(input, output, params);
+}
+
@@ -204,6 +204,8 @@ void CMT::MLR::setParameters(
 	if(params.trainBiases)
 		for(int i = 1; i < mBiases.rows(); ++i, ++k)
 			mBiases[i] = x[k];
+
+	mVersion = nextVersion();
 }
 
 
@@ -277,7 +279,7 @@ double CMT::MLR::evaluate(
 	const MatrixXd& input,
 	const MatrixXd& output) const
 {
-	return -logLikelihood(input, output).mean() / log(2.);
+	return -logLikelihoodSum(input, output) / output.cols() / log(2.);
 }
 
 
@@ -287,8 +289,7 @@ double CMT::MLR::evaluate(
 	const MatrixXd& output,
 	const Preconditioner& preconditioner) const
 {
-	return -logLikelihood(preconditioner(input, output)).mean() / log(2.)
-		- preconditioner.logJacobian(input, output).mean() / log(2.);
+	return -logLikelihoodSum(input, output, preconditioner) / output.cols() / log(2.);
 }
 
 
@@ -296,7 +297,7 @@ double CMT::MLR::evaluate(
 double CMT::MLR::evaluate(
 	const pair<ArrayXXd, ArrayXXd>& data) const
 {
-	return -logLikelihood(data.first, data.second).mean() / log(2.);
+	return evaluate(data.first, data.second);
 }
 
 
@@ -305,6 +306,5 @@ double CMT::MLR::evaluate(
 	const pair<ArrayXXd, ArrayXXd>& data,
 	const Preconditioner& preconditioner) const
 {
-	return -logLikelihood(preconditioner(data.first, data.second)).mean() / log(2.)
-		- preconditioner.logJacobian(data).mean() / log(2.);
+	return evaluate(data.first, data.second, preconditioner);
 }
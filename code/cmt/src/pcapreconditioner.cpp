@@ -5,6 +5,9 @@
 #include "Eigen/Eigenvalues"
 using Eigen::SelfAdjointEigenSolver;
 
+#include <utility>
+using std::pair;
+
 CMT::PCAPreconditioner::PCAPreconditioner(
 	const ArrayXXd& input,
 	const ArrayXXd& output,
@@ -14,10 +17,19 @@ CMT::PCAPreconditioner::PCAPreconditioner(
 	if(input.cols() != output.cols())
 		throw Exception("Number of inputs and outputs must be the same."); 
 
-	if(input.rows() < 1) {
-		mMeanOut = output.rowwise().mean();
+	Moments moments(input.rows(), output.rows());
+	moments.update(input, output);
+
+	initialize(moments, varExplained, numPCs);
+}
+
 
-		MatrixXd covYY = covariance(output);
+
+void CMT::PCAPreconditioner::initialize(const Moments& moments, double varExplained, int numPCs) {
+	if(moments.dimIn() < 1) {
+		mMeanOut = moments.meanOut();
+
+		MatrixXd covYY = moments.covYY();
 
 		SelfAdjointEigenSolver<MatrixXd> eigenSolver;
 		eigenSolver.compute(covYY);
@@ -26,22 +38,27 @@ CMT::PCAPreconditioner::PCAPreconditioner(
 
 		mLogJacobian = mPreOut.partialPivLu().matrixLU().diagonal().array().abs().log().sum();
 	} else {
-		mMeanIn = input.rowwise().mean();
-		mMeanOut = output.rowwise().mean();
-
-		// concatenate input and output
-		ArrayXXd data(input.rows() + output.rows(), input.cols());
-		data << input.matrix().colwise() - mMeanIn, output.matrix().colwise() - mMeanOut;
+		mMeanIn = moments.meanIn();
+		mMeanOut = moments.meanOut();
 
 		// compute covariances
-		MatrixXd cov = covariance(data);
-		MatrixXd covXX = cov.topLeftCorner(input.rows(), input.rows());
-		MatrixXd covYX = cov.bottomLeftCorner(output.rows(), input.rows());
-		MatrixXd covYY = cov.bottomRightCorner(output.rows(), output.rows());
+		MatrixXd covXX = moments.covXX();
+		MatrixXd covYX = moments.covYX();
+		MatrixXd covYY = moments.covYY();
 
 		SelfAdjointEigenSolver<MatrixXd> eigenSolver;
-		eigenSolver.compute(covXX);
-		mEigenvalues = eigenSolver.eigenvalues();
+		MatrixXd eigenvectors;
+
+		if(numPCs >= 0 && preferRandomizedEigen(numPCs, covXX.rows())) {
+			// only compute the leading eigenvectors
+			pair<VectorXd, MatrixXd> eigen = randomizedEigen(covXX, numPCs);
+			mEigenvalues = eigen.first;
+			eigenvectors = eigen.second;
+		} else {
+			eigenSolver.compute(covXX);
+			mEigenvalues = eigenSolver.eigenvalues();
+			eigenvectors = eigenSolver.eigenvectors();
+		}
 
 		if(numPCs < 0) {
 			double totalVariance = mEigenvalues.sum();
@@ -58,8 +75,8 @@ CMT::PCAPreconditioner::PCAPreconditioner(
 
 		// input whitening
 		mPreIn = mEigenvalues.tail(numPCs).cwiseSqrt().cwiseInverse().asDiagonal() *
-			eigenSolver.eigenvectors().rightCols(numPCs).transpose();
-		mPreInInv = eigenSolver.eigenvectors().rightCols(numPCs) *
+			eigenvectors.rightCols(numPCs).transpose();
+		mPreInInv = eigenvectors.rightCols(numPCs) *
 			mEigenvalues.tail(numPCs).cwiseSqrt().asDiagonal();
 
 		// optimal linear predictor
@@ -91,3 +108,16 @@ CMT::PCAPreconditioner::PCAPreconditioner(
 	mEigenvalues(eigenvalues)
 {
 }
+
+
+
+/**
+ * Computes the preconditioner from means and covariances accumulated over a stream of data.
+ */
+CMT::PCAPreconditioner::PCAPreconditioner(
+	const Moments& moments,
+	double varExplained,
+	int numPCs)
+{
+	initialize(moments, varExplained, numPCs);
+}
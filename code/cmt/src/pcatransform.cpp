@@ -5,6 +5,9 @@
 #include "Eigen/Eigenvalues"
 using Eigen::SelfAdjointEigenSolver;
 
+#include <utility>
+using std::pair;
+
 #include <iostream>
 using std::cout;
 using std::endl;
@@ -67,14 +70,26 @@ void CMT::PCATransform::initialize(
 	if(input.rows() < 1)
 		return;
 
-	mMeanIn = input.rowwise().mean();
+	Moments moments(input.rows());
+	moments.update(input);
 
-	// compute covariances
-	MatrixXd covXX = covariance(input);
+	mMeanIn = moments.meanIn();
 
-	SelfAdjointEigenSolver<MatrixXd> eigenSolver;
-	eigenSolver.compute(covXX);
-	mEigenvalues = eigenSolver.eigenvalues();
+	// compute covariances
+	MatrixXd covXX = moments.covXX();
+
+	MatrixXd eigenvectors;
+
+	if(numPCs >= 0 && preferRandomizedEigen(numPCs, covXX.rows())) {
+		// only compute the leading eigenvectors
+		pair<VectorXd, MatrixXd> eigen = randomizedEigen(covXX, numPCs);
+		mEigenvalues = eigen.first;
+		eigenvectors = eigen.second;
+	} else {
+		SelfAdjointEigenSolver<MatrixXd> eigenSolver(covXX);
+		mEigenvalues = eigenSolver.eigenvalues();
+		eigenvectors = eigenSolver.eigenvectors();
+	}
 
 	if(numPCs < 0) {
 		double totalVariance = mEigenvalues.sum();
@@ -102,7 +117,7 @@ void CMT::PCATransform::initialize(
 
 	// input whitening
 	mPreIn = tmp.tail(numPCs).cwiseSqrt().cwiseInverse().asDiagonal() *
-		eigenSolver.eigenvectors().rightCols(numPCs).transpose();
-	mPreInInv = eigenSolver.eigenvectors().rightCols(numPCs) *
+		eigenvectors.rightCols(numPCs).transpose();
+	mPreInInv = eigenvectors.rightCols(numPCs) *
 		tmp.tail(numPCs).cwiseSqrt().asDiagonal();
 }
@@ -5,6 +5,7 @@
 
 #include "stm.h"
 using CMT::STM;
+using CMT::WindowView;
 
 #include "Eigen/Eigenvalues"
 using Eigen::SelfAdjointEigenSolver;
@@ -17,6 +18,7 @@ using Eigen::Array;
 using Eigen::Dynamic;
 using Eigen::VectorXi;
 using Eigen::VectorXd;
+using Eigen::OuterStride;
 
 #include "nonlinearities.h"
 using CMT::Nonlinearity;
@@ -357,6 +359,8 @@ void CMT::STM::initialize(const MatrixXd& input, const MatrixXd& output) {
 
 	if(dimInLinear() > 0)
 		mLinearPredictor = input.bottomRows(dimInLinear()) * output.transpose() / numSpikes;
+
+	mVersion = nextVersion();
 }
 
 
@@ -494,6 +498,8 @@ void CMT::STM::setParameters(const lbfgsfloatval_t* x, const Trainable::Paramete
 
 	if(params.trainSharpness)
 		mSharpness = x[offset++];
+
+	mVersion = nextVersion();
 }
 
 
@@ -503,6 +509,25 @@ double CMT::STM::parameterGradient(
 	const MatrixXd& outputCompl,
 	const lbfgsfloatval_t* x,
 	lbfgsfloatval_t* g,
+	const Trainable::Parameters& params) const
+{
+	return parameterGradient(
+		WindowView(inputCompl.data(), inputCompl.rows(), inputCompl.cols(), OuterStride<>(inputCompl.rows())),
+		outputCompl, x, g, params);
+}
+
+
+
+/**
+ * If the inputs are windows of a time series, the products of features and predictors with the
+ * inputs are temporal convolutions. They are computed directly on the view, so that windows are
+ * only ever expanded block-wise inside the matrix products.
+ */
+double CMT::STM::parameterGradient(
+	const WindowView& inputCompl,
+	const MatrixXd& outputCompl,
+	const lbfgsfloatval_t* x,
+	lbfgsfloatval_t* g,
 	const Trainable::Parameters& params_) const
 {
  	// check if nonlinearity is differentiable
@@ -568,12 +593,14 @@ double CMT::STM::parameterGradient(
 	// split data into batches for better performance
 	int numData = static_cast<int>(inputCompl.cols());
 	int batchSize = min(max(params.batchSize, 10), numData);
+	int stride = static_cast<int>(inputCompl.outerStride());
 
 	#pragma omp parallel for
 	for(int b = 0; b < inputCompl.cols(); b += batchSize) {
 		int width = min(batchSize, numData - b);
-		const MatrixXd& inputNonlinear = inputCompl.block(0, b, dimInNonlinear(), width);
-		const MatrixXd& inputLinear = inputCompl.block(dimInNonlinear(), b, dimInLinear(), width);
+		const double* data = inputCompl.data() + static_cast<long>(b) * stride;
+		const WindowView inputNonlinear(data, dimInNonlinear(), width, OuterStride<>(stride));
+		const WindowView inputLinear(data + dimInNonlinear(), dimInLinear(), width, OuterStride<>(stride));
 		const MatrixXd& output = outputCompl.middleCols(b, width);
 
 		ArrayXXd featureOutput;
@@ -845,6 +872,7 @@ bool CMT::STM::train(
 			mean = 1e-50;
 
 		mBiases.setConstant(nonlinearity->inverse(mean) - log(numComponents()));
+		mVersion = nextVersion();
 
 		return true;
 
@@ -877,6 +905,7 @@ bool CMT::STM::train(
 		mPredictors = glm.weights().topRows(dimInNonlinear()).transpose();
 		mLinearPredictor = glm.weights().bottomRows(dimInLinear());
 		mBiases.setConstant(glm.bias() - log(numComponents()));
+		mVersion = nextVersion();
 
 		return converged;
 
@@ -884,3 +913,17 @@ bool CMT::STM::train(
 		return Trainable::train(input, output, inputVal, outputVal, params);
 	}
 }
+
+
+
+bool CMT::STM::train(
+	const WindowView& input,
+	const MatrixXd& output,
+	const Trainable::Parameters& params)
+{
+	if(!dimIn() || !dimInNonlinear() || (numComponents() == 1 && numFeatures() == 0))
+		// special cases are handled by the model on a copy of the windows
+		return train(MatrixXd(input), output, 0, 0, params);
+
+	return Trainable::train(input, output, params);
+}
@@ -1,6 +1,10 @@
 #include "lbfgs.h"
 #include "utils.h"
+using CMT::streamingTileSize;
+using CMT::compensatedSum;
+
 #include "exception.h"
+using CMT::Exception;
 
 #include <algorithm>
 using std::max;
@@ -12,13 +16,17 @@ using std::rand;
 #include <cmath>
 using std::exp;
 using std::log;
-
-#include <cstring>
-using std::memcpy;
+using std::abs;
 
 #include <set>
 using std::set;
 
+#include <map>
+using std::map;
+
+#include <string>
+using std::string;
+
 #include <vector>
 using std::vector;
 using std::pair;
@@ -26,8 +34,6 @@ using std::make_pair;
 
 #include <algorithm>
 using std::find;
-using std::copy;
-using std::random_shuffle;
 
 #include "tools.h"
 using CMT::Tuple;
@@ -36,6 +42,7 @@ using CMT::ConditionalDistribution;
 using CMT::ArrayXXb;
 using CMT::Preconditioner;
 using CMT::extractFromImage;
+using CMT::NeighborhoodPlan;
 
 #include "Eigen/Core"
 using Eigen::Block;
@@ -45,6 +52,7 @@ using Eigen::ArrayXd;
 using Eigen::ArrayXXd;
 using Eigen::ArrayXXi;
 using Eigen::VectorXd;
+using Eigen::MatrixXd;
 using Eigen::Map;
 
 #include <iostream>
@@ -102,6 +110,51 @@ VectorXd CMT::extractFromImage(const ArrayXXd& img, const Tuples& indices) {
 
 
 
+CMT::NeighborhoodPlan::NeighborhoodPlan(
+	const ArrayXXb& inputMask,
+	const ArrayXXb& outputMask,
+	int imageRows,
+	int numChannels) : mImageRows(imageRows)
+{
+	pair<Tuples, Tuples> indices = masksToIndices(inputMask, outputMask);
+
+	for(int m = 0; m < numChannels; ++m)
+		addChannel(m, indices);
+}
+
+
+
+CMT::NeighborhoodPlan::NeighborhoodPlan(
+	const vector<ArrayXXb>& inputMask,
+	const vector<ArrayXXb>& outputMask,
+	int imageRows) : mImageRows(imageRows)
+{
+	if(inputMask.size() != outputMask.size())
+		throw Exception("Input and output masks need to have the same number of channels.");
+
+	for(int m = 0; m < inputMask.size(); ++m) {
+		if(inputMask[m].cols() != inputMask[0].cols() || inputMask[m].rows() != inputMask[0].rows())
+			throw Exception("All masks should be of the same size.");
+		addChannel(m, masksToIndices(inputMask[m], outputMask[m]));
+	}
+}
+
+
+
+void CMT::NeighborhoodPlan::addChannel(int channel, const pair<Tuples, Tuples>& indices) {
+	for(int k = 0; k < indices.first.size(); ++k) {
+		mInputChannels.push_back(channel);
+		mInputOffsets.push_back(indices.first[k].first + indices.first[k].second * mImageRows);
+	}
+
+	for(int k = 0; k < indices.second.size(); ++k) {
+		mOutputChannels.push_back(channel);
+		mOutputOffsets.push_back(indices.second[k].first + indices.second[k].second * mImageRows);
+	}
+}
+
+
+
 pair<ArrayXXd, ArrayXXd> CMT::generateDataFromImage(
 	const ArrayXXd& img,
 	const ArrayXXb& inputMask,
@@ -113,23 +166,17 @@ pair<ArrayXXd, ArrayXXd> CMT::generateDataFromImage(
 	if(w < 1 || h < 1)
 		throw Exception("Image not large enough for these masks.");
 
-	// precompute indices of active pixels in masks
-	pair<Tuples, Tuples> inOutIndices = masksToIndices(inputMask, outputMask);
-	Tuples& inputIndices = inOutIndices.first;
-	Tuples& outputIndices = inOutIndices.second;
+	// precompute locations of active pixels in masks
+	NeighborhoodPlan plan(inputMask, outputMask, img.rows());
 
 	pair<ArrayXXd, ArrayXXd> data = make_pair(
-		ArrayXXd(inputIndices.size(), w * h),
-		ArrayXXd(outputIndices.size(), w * h));
-
-	for(int k = 0, i = 0; i < h; ++i)
-		for(int j = 0; j < w; ++j, ++k) {
-			// extract input and output
-			MatrixXd patch = img.block(i, j, inputMask.rows(), inputMask.cols());
+		ArrayXXd(plan.dimIn(), w * h),
+		ArrayXXd(plan.dimOut(), w * h));
 
-			data.first.col(k) = extractFromImage(patch, inputIndices);
-			data.second.col(k) = extractFromImage(patch, outputIndices);
-		}
+	// extract inputs and outputs
+	#pragma omp parallel for if(w * h > 256)
+	for(int k = 0; k < w * h; ++k)
+		plan.gather(img, k / w, k % w, data.first.col(k).data(), data.second.col(k).data());
 
 	return data;
 }
@@ -148,39 +195,28 @@ pair<ArrayXXd, ArrayXXd> CMT::generateDataFromImage(
 	if(numSamples <= 0)
 		return generateDataFromImage(img, inputMask, outputMask);
 
-	if(numSamples > w * h)
+	if(numSamples > static_cast<long>(w) * h)
 		throw Exception("Image not large enough for this many samples.");
 
-	// precompute indices of active pixels in masks
-	pair<Tuples, Tuples> inOutIndices = masksToIndices(inputMask, outputMask);
-	Tuples& inputIndices = inOutIndices.first;
-	Tuples& outputIndices = inOutIndices.second;
-
-	// sample random image locations
-	set<int> indices = randomSelect(numSamples, w * h);
+	// precompute locations of active pixels in masks
+	NeighborhoodPlan plan(inputMask, outputMask, img.rows());
 
-	// randomize order of indices
-	vector<int> indicesRand(indices.size());
-	copy(indices.begin(), indices.end(), indicesRand.begin());
-	random_shuffle(indicesRand.begin(), indicesRand.end());
+	// sample random image locations in random order
+	vector<long> indices = randomSample(numSamples, static_cast<long>(w) * h);
 
 	// allocate memory
 	pair<ArrayXXd, ArrayXXd> data = make_pair(
-		ArrayXXd(inputIndices.size(), numSamples),
-		ArrayXXd(outputIndices.size(), numSamples));
-
-	int k = 0;
+		ArrayXXd(plan.dimIn(), numSamples),
+		ArrayXXd(plan.dimOut(), numSamples));
 
-	for(vector<int>::iterator iter = indicesRand.begin(); iter != indicesRand.end(); ++iter, ++k) {
+	#pragma omp parallel for if(numSamples > 256)
+	for(int k = 0; k < numSamples; ++k) {
 		// compute indices of image location
-		int i = *iter / w;
-		int j = *iter % w;
+		int i = indices[k] / w;
+		int j = indices[k] % w;
 
 		// extract input and output
-		MatrixXd patch = img.block(i, j, inputMask.rows(), inputMask.cols());
-
-		data.first.col(k) = extractFromImage(patch, inputIndices);
-		data.second.col(k) = extractFromImage(patch, outputIndices);
+		plan.gather(img, i, j, data.first.col(k).data(), data.second.col(k).data());
 	}
 
 	return data;
@@ -201,29 +237,24 @@ pair<ArrayXXd, ArrayXXd> CMT::generateDataFromImage(
 	if(inputMask.cols() != outputMask.cols() || inputMask.rows() != outputMask.rows())
 		throw Exception("Input and output masks should be of the same size.");
 
+	for(int m = 0; m < numChannels; ++m)
+		if(img[m].cols() != img[0].cols() || img[m].rows() != img[0].rows())
+			throw Exception("All image channels should be of the same size.");
+
 	int w = img[0].cols() - inputMask.cols() + 1;
 	int h = img[0].rows() - inputMask.rows() + 1;
 
-	// precompute indices of active pixels in masks
-	pair<Tuples, Tuples> inOutIndices = masksToIndices(inputMask, outputMask);
-	Tuples& inputIndices = inOutIndices.first;
-	Tuples& outputIndices = inOutIndices.second;
-
-	int numInputs = inputIndices.size();
-	int numOutputs = outputIndices.size();
+	// precompute locations of active pixels in masks
+	NeighborhoodPlan plan(inputMask, outputMask, img[0].rows(), numChannels);
 
 	pair<ArrayXXd, ArrayXXd> data = make_pair(
-		ArrayXXd(numChannels * numInputs, w * h),
-		ArrayXXd(numChannels * numOutputs, w * h));
+		ArrayXXd(plan.dimIn(), w * h),
+		ArrayXXd(plan.dimOut(), w * h));
 
 	// extract inputs and outputs
-	for(int k = 0, i = 0; i < h; ++i)
-		for(int j = 0; j < w; ++j, ++k)
-			for(int m = 0; m < numChannels; ++m) {
-				MatrixXd patch = img[m].block(i, j, inputMask.rows(), inputMask.cols());
-				data.first.block(m * numInputs, k, numInputs, 1) = extractFromImage(patch, inputIndices);
-				data.second.block(m * numOutputs, k, numOutputs, 1) = extractFromImage(patch, outputIndices);
-			}
+	#pragma omp parallel for if(w * h > 256)
+	for(int k = 0; k < w * h; ++k)
+		plan.gather(img, k / w, k % w, data.first.col(k).data(), data.second.col(k).data());
 
 	return data;
 }
@@ -247,45 +278,34 @@ pair<ArrayXXd, ArrayXXd> CMT::generateDataFromImage(
 	if(inputMask.cols() != outputMask.cols() || inputMask.rows() != outputMask.rows())
 		throw Exception("Input and output masks should be of the same size.");
 
+	for(int m = 0; m < numChannels; ++m)
+		if(img[m].cols() != img[0].cols() || img[m].rows() != img[0].rows())
+			throw Exception("All image channels should be of the same size.");
+
 	int w = img[0].cols() - inputMask.cols() + 1;
 	int h = img[0].rows() - inputMask.rows() + 1;
 
-	if(numSamples > w * h)
+	if(numSamples > static_cast<long>(w) * h)
 		throw Exception("Image not large enough for this many samples.");
 
-	// precompute indices of active pixels in masks
-	pair<Tuples, Tuples> inOutIndices = masksToIndices(inputMask, outputMask);
-	Tuples& inputIndices = inOutIndices.first;
-	Tuples& outputIndices = inOutIndices.second;
-
-	// sample random image locations
-	set<int> indices = randomSelect(numSamples, w * h);
+	// precompute locations of active pixels in masks
+	NeighborhoodPlan plan(inputMask, outputMask, img[0].rows(), numChannels);
 
-	// randomize order of indices
-	vector<int> indicesRand(indices.size());
-	copy(indices.begin(), indices.end(), indicesRand.begin());
-	random_shuffle(indicesRand.begin(), indicesRand.end());
-
-	int numInputs = inputIndices.size();
-	int numOutputs = outputIndices.size();
+	// sample random image locations in random order
+	vector<long> indices = randomSample(numSamples, static_cast<long>(w) * h);
 
 	pair<ArrayXXd, ArrayXXd> data = make_pair(
-		ArrayXXd(numChannels * numInputs, numSamples),
-		ArrayXXd(numChannels * numOutputs, numSamples));
-
-	int k = 0;
+		ArrayXXd(plan.dimIn(), numSamples),
+		ArrayXXd(plan.dimOut(), numSamples));
 
-	for(vector<int>::iterator iter = indicesRand.begin(); iter != indicesRand.end(); ++iter, ++k) {
+	#pragma omp parallel for if(numSamples > 256)
+	for(int k = 0; k < numSamples; ++k) {
 		// compute indices of image location
-		int i = *iter / w;
-		int j = *iter % w;
+		int i = indices[k] / w;
+		int j = indices[k] % w;
 
 		// extract input and output
-		for(int m = 0; m < numChannels; ++m) {
-			MatrixXd patch = img[m].block(i, j, inputMask.rows(), inputMask.cols());
-			data.first.block(m * numInputs, k, numInputs, 1) = extractFromImage(patch, inputIndices);
-			data.second.block(m * numOutputs, k, numOutputs, 1) = extractFromImage(patch, outputIndices);
-		}
+		plan.gather(img, i, j, data.first.col(k).data(), data.second.col(k).data());
 	}
 
 	return data;
@@ -306,51 +326,24 @@ pair<ArrayXXd, ArrayXXd> CMT::generateDataFromImage(
 	if(inputMask.size() != numChannels || outputMask.size() != numChannels)
 		throw Exception("Image and masks need to have the same number of channels.");
 
-	int w = img[0].cols() - inputMask[0].cols() + 1;
-	int h = img[0].rows() - inputMask[0].rows() + 1;
-
-	vector<Tuples> inputIndices;
-	vector<Tuples> outputIndices;
-
-	int numInputs = 0;
-	int numOutputs = 0;
-
-	// precompute indices of active pixels in masks
-	for(int m = 0; m < numChannels; ++m) {
-		if(inputMask[m].cols() != inputMask[0].cols() || inputMask[m].rows() != outputMask[0].rows())
-			throw Exception("Input and output masks should be of the same size.");
+	for(int m = 0; m < numChannels; ++m)
 		if(img[m].cols() != img[0].cols() || img[m].rows() != img[0].rows())
 			throw Exception("All image channels should be of the same size.");
 
-		// precompute indices of active pixels in masks
-		pair<Tuples, Tuples> inOutIndices = masksToIndices(inputMask[m], outputMask[m]);
-		inputIndices.push_back(inOutIndices.first);
-		outputIndices.push_back(inOutIndices.second);
+	int w = img[0].cols() - inputMask[0].cols() + 1;
+	int h = img[0].rows() - inputMask[0].rows() + 1;
 
-		numInputs += inputIndices[m].size();
-		numOutputs += outputIndices[m].size();
-	}
+	// precompute locations of active pixels in masks
+	NeighborhoodPlan plan(inputMask, outputMask, img[0].rows());
 
 	pair<ArrayXXd, ArrayXXd> data = make_pair(
-		ArrayXXd(numInputs, w * h),
-		ArrayXXd(numOutputs, w * h));
-
-	for(int k = 0, i = 0; i < h; ++i)
-		for(int j = 0; j < w; ++j, ++k) {
-			int offsetIn = 0;
-			int offsetOut = 0;
-
-			// extract input and output
-			for(int m = 0; m < numChannels; ++m) {
-				MatrixXd patch = img[m].block(i, j, inputMask[m].rows(), inputMask[m].cols());
-
-				data.first.block(offsetIn, k, inputIndices[m].size(), 1) = extractFromImage(patch, inputIndices[m]);
-				data.second.block(offsetOut, k, outputIndices[m].size(), 1) = extractFromImage(patch, outputIndices[m]);
+		ArrayXXd(plan.dimIn(), w * h),
+		ArrayXXd(plan.dimOut(), w * h));
 
-				offsetIn += inputIndices[m].size();
-				offsetOut += outputIndices[m].size();
-			}
-		}
+	// extract inputs and outputs
+	#pragma omp parallel for if(w * h > 256)
+	for(int k = 0; k < w * h; ++k)
+		plan.gather(img, k / w, k % w, data.first.col(k).data(), data.second.col(k).data());
 
 	return data;
 }
@@ -374,66 +367,34 @@ pair<ArrayXXd, ArrayXXd> CMT::generateDataFromImage(
 	if(inputMask.size() != numChannels || outputMask.size() != numChannels)
 		throw Exception("Image and masks need to have the same number of channels.");
 
-	int w = img[0].cols() - inputMask[0].cols() + 1;
-	int h = img[0].rows() - inputMask[0].rows() + 1;
-
-	if(numSamples > w * h)
-		throw Exception("Image not large enough for this many samples.");
-
-	vector<Tuples> inputIndices;
-	vector<Tuples> outputIndices;
-
-	int numInputs = 0;
-	int numOutputs = 0;
-
-	// precompute indices of active pixels in masks
-	for(int m = 0; m < numChannels; ++m) {
-		if(inputMask[m].cols() != inputMask[0].cols() || inputMask[m].rows() != outputMask[0].rows())
-			throw Exception("Input and output masks should be of the same size.");
+	for(int m = 0; m < numChannels; ++m)
 		if(img[m].cols() != img[0].cols() || img[m].rows() != img[0].rows())
 			throw Exception("All image channels should be of the same size.");
 
-		// precompute indices of active pixels in masks
-		pair<Tuples, Tuples> inOutIndices = masksToIndices(inputMask[m], outputMask[m]);
-		inputIndices.push_back(inOutIndices.first);
-		outputIndices.push_back(inOutIndices.second);
+	int w = img[0].cols() - inputMask[0].cols() + 1;
+	int h = img[0].rows() - inputMask[0].rows() + 1;
 
-		numInputs += inputIndices[m].size();
-		numOutputs += outputIndices[m].size();
-	}
+	if(numSamples > static_cast<long>(w) * h)
+		throw Exception("Image not large enough for this many samples.");
 
-	// sample random image locations
-	set<int> indices = randomSelect(numSamples, w * h);
+	// precompute locations of active pixels in masks
+	NeighborhoodPlan plan(inputMask, outputMask, img[0].rows());
 
-	// randomize order of indices
-	vector<int> indicesRand(indices.size());
-	copy(indices.begin(), indices.end(), indicesRand.begin());
-	random_shuffle(indicesRand.begin(), indicesRand.end());
+	// sample random image locations in random order
+	vector<long> indices = randomSample(numSamples, static_cast<long>(w) * h);
 
 	pair<ArrayXXd, ArrayXXd> data = make_pair(
-		ArrayXXd(numInputs, numSamples),
-		ArrayXXd(numOutputs, numSamples));
-
-	int k = 0;
+		ArrayXXd(plan.dimIn(), numSamples),
+		ArrayXXd(plan.dimOut(), numSamples));
 
-	for(vector<int>::iterator iter = indicesRand.begin(); iter != indicesRand.end(); ++iter, ++k) {
+	#pragma omp parallel for if(numSamples > 256)
+	for(int k = 0; k < numSamples; ++k) {
 		// compute indices of image location
-		int i = *iter / w;
-		int j = *iter % w;
-
-		int offsetIn = 0;
-		int offsetOut = 0;
+		int i = indices[k] / w;
+		int j = indices[k] % w;
 
 		// extract input and output
-		for(int m = 0; m < numChannels; ++m) {
-			MatrixXd patch = img[m].block(i, j, inputMask[m].rows(), inputMask[m].cols());
-
-			data.first.block(offsetIn, k, inputIndices[m].size(), 1) = extractFromImage(patch, inputIndices[m]);
-			data.second.block(offsetOut, k, outputIndices[m].size(), 1) = extractFromImage(patch, outputIndices[m]);
-
-			offsetIn += inputIndices[m].size();
-			offsetOut += outputIndices[m].size();
-		}
+		plan.gather(img, i, j, data.first.col(k).data(), data.second.col(k).data());
 	}
 
 	return data;
@@ -452,52 +413,29 @@ pair<ArrayXXd, ArrayXXd> CMT::generateDataFromVideo(
 	if(inputMask.size() != outputMask.size())
 		throw Exception("Masks need to have the same number of frames.");
 
+	for(int f = 0; f < video.size(); ++f)
+		if(video[f].cols() != video[0].cols() || video[f].rows() != video[0].rows())
+			throw Exception("All video frames should be of the same size.");
+
 	int w = video[0].cols() - inputMask[0].cols() + 1;
 	int h = video[0].rows() - inputMask[0].rows() + 1;
 	int l = video.size() - inputMask.size() + 1;
 
-	vector<Tuples> inputIndices;
-	vector<Tuples> outputIndices;
-
-	int numInputs = 0;
-	int numOutputs = 0;
-
-	// precompute indices of active pixels in masks
-	for(int m = 0; m < inputMask.size(); ++m) {
-		if(inputMask[m].cols() != inputMask[0].cols() || inputMask[m].rows() != outputMask[0].rows())
-			throw Exception("Input and output masks should be of the same size.");
-		if(video[m].cols() != video[0].cols() || video[m].rows() != video[0].rows())
-			throw Exception("All video frames should be of the same size.");
-
-		pair<Tuples, Tuples> inOutIndices = masksToIndices(inputMask[m], outputMask[m]);
-		inputIndices.push_back(inOutIndices.first);
-		outputIndices.push_back(inOutIndices.second);
-
-		numInputs += inputIndices[m].size();
-		numOutputs += outputIndices[m].size();
-	}
+	// precompute locations of active pixels in masks
+	NeighborhoodPlan plan(inputMask, outputMask, video[0].rows());
 
 	pair<ArrayXXd, ArrayXXd> data = make_pair(
-		ArrayXXd(numInputs, w * h * l),
-		ArrayXXd(numOutputs, w * h * l));
-
-	for(int k = 0, f = 0; f < l; ++f)
-		for(int i = 0; i < h; ++i)
-			for(int j = 0; j < w; ++j, ++k) {
-				int offsetIn = 0;
-				int offsetOut = 0;
-
-				// extract input and output
-				for(int m = 0; m < inputMask.size(); ++m) {
-					MatrixXd patch = video[m + f].block(i, j, inputMask[m].rows(), inputMask[m].cols());
+		ArrayXXd(plan.dimIn(), w * h * l),
+		ArrayXXd(plan.dimOut(), w * h * l));
 
-					data.first.block(offsetIn, k, inputIndices[m].size(), 1) = extractFromImage(patch, inputIndices[m]);
-					data.second.block(offsetOut, k, outputIndices[m].size(), 1) = extractFromImage(patch, outputIndices[m]);
+	// extract inputs and outputs
+	#pragma omp parallel for if(w * h * l > 256)
+	for(int k = 0; k < w * h * l; ++k) {
+		int r = k % (w * h);
 
-					offsetIn += inputIndices[m].size();
-					offsetOut += outputIndices[m].size();
-				}
-			}
+		plan.gather(video, r / w, r % w,
+			data.first.col(k).data(), data.second.col(k).data(), k / (w * h));
+	}
 
 	return data;
 }
@@ -519,68 +457,37 @@ pair<ArrayXXd, ArrayXXd> CMT::generateDataFromVideo(
 	if(inputMask.size() != outputMask.size())
 		throw Exception("Masks need to have the same number of frames.");
 
+	for(int f = 0; f < video.size(); ++f)
+		if(video[f].cols() != video[0].cols() || video[f].rows() != video[0].rows())
+			throw Exception("All video frames should be of the same size.");
+
 	int w = video[0].cols() - inputMask[0].cols() + 1;
 	int h = video[0].rows() - inputMask[0].rows() + 1;
 	int l = video.size() - inputMask.size() + 1;
 
-	if(numSamples > w * h * l)
+	if(numSamples > static_cast<long>(w) * h * l)
 		throw Exception("Video not large enough for this many samples.");
 
-	vector<Tuples> inputIndices;
-	vector<Tuples> outputIndices;
-
-	int numInputs = 0;
-	int numOutputs = 0;
-
-	// precompute indices of active pixels in masks
-	for(int m = 0; m < inputMask.size(); ++m) {
-		if(inputMask[m].cols() != inputMask[0].cols() || inputMask[m].rows() != outputMask[0].rows())
-			throw Exception("Input and output masks should be of the same size.");
-		if(video[m].cols() != video[0].cols() || video[m].rows() != video[0].rows())
-			throw Exception("All video frames should be of the same size.");
-
-		pair<Tuples, Tuples> inOutIndices = masksToIndices(inputMask[m], outputMask[m]);
-		inputIndices.push_back(inOutIndices.first);
-		outputIndices.push_back(inOutIndices.second);
+	// precompute locations of active pixels in masks
+	NeighborhoodPlan plan(inputMask, outputMask, video[0].rows());
 
-		numInputs += inputIndices[m].size();
-		numOutputs += outputIndices[m].size();
-	}
-
-	// sample random video locations
-	set<int> indices = randomSelect(numSamples, w * h * l);
-
-	// randomize order of indices
-	vector<int> indicesRand(indices.size());
-	copy(indices.begin(), indices.end(), indicesRand.begin());
-	random_shuffle(indicesRand.begin(), indicesRand.end());
+	// sample random video locations in random order
+	vector<long> indices = randomSample(numSamples, static_cast<long>(w) * h * l);
 
 	pair<ArrayXXd, ArrayXXd> data = make_pair(
-		ArrayXXd(numInputs, numSamples),
-		ArrayXXd(numOutputs, numSamples));
-
-	int k = 0;
+		ArrayXXd(plan.dimIn(), numSamples),
+		ArrayXXd(plan.dimOut(), numSamples));
 
-	for(vector<int>::iterator iter = indicesRand.begin(); iter != indicesRand.end(); ++iter, ++k) {
+	#pragma omp parallel for if(numSamples > 256)
+	for(int k = 0; k < numSamples; ++k) {
 		// compute indices of video location
-		int f = *iter / (w * h);
-		int r = *iter % (w * h);
+		int f = indices[k] / (w * h);
+		int r = indices[k] % (w * h);
 		int i = r / w;
 		int j = r % w;
 
-		int offsetIn = 0;
-		int offsetOut = 0;
-
 		// extract input and output
-		for(int m = 0; m < inputMask.size(); ++m) {
-			MatrixXd patch = video[m + f].block(i, j, inputMask[m].rows(), inputMask[m].cols());
-
-			data.first.block(offsetIn, k, inputIndices[m].size(), 1) = extractFromImage(patch, inputIndices[m]);
-			data.second.block(offsetOut, k, outputIndices[m].size(), 1) = extractFromImage(patch, outputIndices[m]);
-
-			offsetIn += inputIndices[m].size();
-			offsetOut += outputIndices[m].size();
-		}
+		plan.gather(video, i, j, data.first.col(k).data(), data.second.col(k).data(), f);
 	}
 
 	return data;
@@ -588,6 +495,7 @@ pair<ArrayXXd, ArrayXXd> CMT::generateDataFromVideo(
 
 
 
+
 ArrayXXd CMT::densityGradient(
 	const ArrayXXd& img,
 	const ConditionalDistribution& model,
@@ -650,31 +558,20 @@ ArrayXXd CMT::densityGradient(
 	int numRows = (m + h - 1) / h;
 	int numCols = (n + w - 1) / w;
 
-	ArrayXXd inputs = ArrayXXd::Zero(inputIndices.size(), numRows * numCols);
-	ArrayXXd outputs = ArrayXXd::Zero(outputIndices.size(), numRows * numCols);
-
-	for(int i = 0; i < m; i += h)
-		#pragma omp parallel for
-		for(int j = 0; j < n; j += w) {
-			int k = i / h * numCols + j / w;
+	NeighborhoodPlan plan(inputMask, outputMask, img.rows());
 
-			// extract input and output
-			MatrixXd patch = img.block(i, j, inputMask.rows(), inputMask.cols());
+	MatrixXd inputs(inputIndices.size(), numRows * numCols);
+	MatrixXd outputs(outputIndices.size(), numRows * numCols);
 
-			inputs.col(k) = extractFromImage(patch, inputIndices);
-			outputs.col(k) = extractFromImage(patch, outputIndices);
-		}
+	#pragma omp parallel for
+	for(int k = 0; k < numRows * numCols; ++k)
+		plan.gather(img, k / numCols * h, k % numCols * w, inputs.col(k).data(), outputs.col(k).data());
 
 	// compute gradients of pixels
 	pair<pair<ArrayXXd, ArrayXXd>, Array<double, 1, Dynamic> > results;
 
 	if(preconditioner) {
-		pair<ArrayXXd, ArrayXXd> data = preconditioner->operator()(inputs, outputs);
-		results = model.computeDataGradient(data.first, data.second);
-
-		// adjust gradient and likelihood to take transformation into account
-		results.first = preconditioner->adjustGradient(results.first.first, results.first.second);
-		results.second += preconditioner->logJacobian(inputs, outputs);
+		results = model.computeDataGradient(inputs, outputs, *preconditioner);
 	} else {
 		results = model.computeDataGradient(inputs, outputs);
 	}
@@ -685,18 +582,18 @@ ArrayXXd CMT::densityGradient(
 	// combine gradients into image
 	ArrayXXd gradient = ArrayXXd::Zero(img.rows(), img.cols());
 
-	for(int i = 0; i < m; i += h)
-		for(int j = 0; j < n; j += w) {
-			int k = i / h * numCols + j / w;
+	// rows of patches which are this far apart don't overlap and can be added concurrently
+	int stride = (inputMask.rows() + h - 1) / h;
 
-			Block<ArrayXXd> patch = gradient.block(
-				i, j, inputMask.rows(), inputMask.cols());
+	for(int r = 0; r < stride; ++r)
+		#pragma omp parallel for
+		for(int a = r; a < numRows; a += stride)
+			for(int b = 0; b < numCols; ++b) {
+				int k = a * numCols + b;
 
-			for(int l = 0; l < inputIndices.size(); ++l)
-				patch(inputIndices[l].first, inputIndices[l].second) += inputGradients(l, k);
-			for(int l = 0; l < outputIndices.size(); ++l)
-				patch(outputIndices[l].first, outputIndices[l].second) += outputGradients(l, k);
-		}
+				plan.accumulate(gradient, a * h, b * w,
+					inputGradients.col(k).data(), outputGradients.col(k).data());
+			}
 
 	return gradient;
 }
@@ -792,38 +689,20 @@ vector<ArrayXXd> CMT::densityGradient(
 	int numCols = (n + w - 1) / w;
 
 	// extract inputs and outputs from image
-	ArrayXXd inputs(numInputs, numRows * numCols);
-	ArrayXXd outputs(numOutputs, numRows * numCols);
-
-	for(int i = 0; i < m; i += h)
-		#pragma omp parallel for
-		for(int j = 0; j < n; j += w) {
-			int k = i / h * numCols + j / w;
-
-			for(int c = 0, offIn = 0, offOut = 0; c < numChannels; ++c) {
-				// extract input and output
-				MatrixXd patch = img[c].block(i, j, inputMask[c].rows(), inputMask[c].cols());
+	NeighborhoodPlan plan(inputMask, outputMask, img[0].rows());
 
-				inputs.block(offIn, k, inputIndices[c].size(), 1) =
-					extractFromImage(patch, inputIndices[c]);
-				outputs.block(offOut, k, outputIndices[c].size(), 1) =
-					extractFromImage(patch, outputIndices[c]);
+	MatrixXd inputs(numInputs, numRows * numCols);
+	MatrixXd outputs(numOutputs, numRows * numCols);
 
-				offIn += inputIndices[c].size();
-				offOut += outputIndices[c].size();
-			}
-		}
+	#pragma omp parallel for
+	for(int k = 0; k < numRows * numCols; ++k)
+		plan.gather(img, k / numCols * h, k % numCols * w, inputs.col(k).data(), outputs.col(k).data());
 
 	// compute gradients of pixels
 	pair<pair<ArrayXXd, ArrayXXd>, Array<double, 1, Dynamic> > results;
 
 	if(preconditioner) {
-		pair<ArrayXXd, ArrayXXd> data = preconditioner->operator()(inputs, outputs);
-		results = model.computeDataGradient(data.first, data.second);
-
-		// adjust gradient and likelihood to take transformation into account
-		results.first = preconditioner->adjustGradient(results.first.first, results.first.second);
-		results.second += preconditioner->logJacobian(inputs, outputs);
+		results = model.computeDataGradient(inputs, outputs, *preconditioner);
 	} else {
 		results = model.computeDataGradient(inputs, outputs);
 	}
@@ -837,31 +716,231 @@ vector<ArrayXXd> CMT::densityGradient(
 	for(int c = 0; c < numChannels; ++c)
 		gradient.push_back(ArrayXXd::Zero(img[c].rows(), img[c].cols()));
 
-	for(int i = 0; i < m; i += h)
-		for(int j = 0; j < n; j += w) {
-			int k = i / h * numCols + j / w;
+	// rows of patches which are this far apart don't overlap and can be added concurrently
+	int stride = (inputMask[0].rows() + h - 1) / h;
+
+	for(int r = 0; r < stride; ++r)
+		#pragma omp parallel for
+		for(int a = r; a < numRows; a += stride)
+			for(int b = 0; b < numCols; ++b) {
+				int k = a * numCols + b;
+
+				plan.accumulate(gradient, a * h, b * w,
+					inputGradients.col(k).data(), outputGradients.col(k).data());
+			}
+
+	return gradient;
+}
+
+
+
+/**
+ * Computes the average negative log-likelihood in bits per output component of all
+ * neighborhoods of an image. Neighborhoods are gathered tile by tile into buffers which are
+ * reused by each thread, so that memory requirements don't grow with the size of the image.
+ */
+template <class Image>
+static double evaluateImageTiles(
+	const Image& img,
+	int imgRows,
+	int imgCols,
+	const ConditionalDistribution& model,
+	const NeighborhoodPlan& plan,
+	int maskRows,
+	int maskCols,
+	const Preconditioner* preconditioner)
+{
+	int numInputs = plan.dimIn();
+	int numOutputs = plan.dimOut();
+
+	if(preconditioner) {
+		if(numInputs != preconditioner->dimIn() || numOutputs != preconditioner->dimOut())
+			throw Exception("Preconditioner and masks are incompatible.");
+		if(preconditioner->dimInPre() != model.dimIn() || preconditioner->dimOutPre() != model.dimOut())
+			throw Exception("Model and preconditioner are incompatible.");
+	} else {
+		if(numInputs != model.dimIn() || numOutputs != model.dimOut())
+			throw Exception("Model and masks are incompatible.");
+	}
+
+	// number of positions in image masks can take
+	int h = imgRows - maskRows + 1;
+	int w = imgCols - maskCols + 1;
+
+	if(w < 1 || h < 1)
+		throw Exception("Image not large enough for these masks.");
+
+	// tiles of neighboring positions share most of their pixels
+	int tileRows = min(h, 64);
+	int tileCols = max(1, min(w, streamingTileSize(w * h) / tileRows));
+	int numTileRows = (h + tileRows - 1) / tileRows;
+	int numTileCols = (w + tileCols - 1) / tileCols;
+	int numTiles = numTileRows * numTileCols;
+
+	vector<double> logLikSums(numTiles);
+
+	#pragma omp parallel if(numTiles > 1)
+	{
+		MatrixXd inputs;
+		MatrixXd outputs;
+
+		#pragma omp for schedule(dynamic)
+		for(int t = 0; t < numTiles; ++t) {
+			int iOff = t / numTileCols * tileRows;
+			int jOff = t % numTileCols * tileCols;
+			int numRows = min(tileRows, h - iOff);
+			int numCols = min(tileCols, w - jOff);
+
+			// only tiles at the border of the image require new buffers
+			if(inputs.cols() != numRows * numCols) {
+				inputs.resize(numInputs, numRows * numCols);
+				outputs.resize(numOutputs, numRows * numCols);
+			}
 
-			for(int c = 0, offIn = 0, offOut = 0; c < numChannels; ++c) {
-				Block<ArrayXXd> patch = gradient[c].block(
-					i, j, inputMask[c].rows(), inputMask[c].cols());
+			for(int b = 0, k = 0; b < numCols; ++b)
+				for(int a = 0; a < numRows; ++a, ++k)
+					plan.gather(img, iOff + a, jOff + b, inputs.col(k).data(), outputs.col(k).data());
 
-				for(int l = 0; l < inputIndices[c].size(); ++l)
-					patch(inputIndices[c][l].first, inputIndices[c][l].second) +=
-						inputGradients(offIn + l, k);
-				for(int l = 0; l < outputIndices[c].size(); ++l)
-					patch(outputIndices[c][l].first, outputIndices[c][l].second) +=
-						outputGradients(offOut + l, k);
+			if(preconditioner) {
+				ArrayXXd inputTile = inputs;
+				ArrayXXd outputTile = outputs;
 
-				offIn += inputIndices[c].size();
-				offOut += outputIndices[c].size();
+				logLikSums[t] = model.logLikelihood((*preconditioner)(inputTile, outputTile)).sum()
+					+ preconditioner->logJacobian(inputTile, outputTile).sum();
+			} else {
+				logLikSums[t] = model.logLikelihood(inputs, outputs).sum();
 			}
 		}
+	}
 
-	return gradient;
+	return -compensatedSum(logLikSums) / (static_cast<double>(w) * h) / log(2.) / model.dimOut();
 }
 
 
 
+double CMT::evaluateImage(
+	const ArrayXXd& img,
+	const ConditionalDistribution& model,
+	const ArrayXXb& inputMask,
+	const ArrayXXb& outputMask,
+	const Preconditioner* preconditioner)
+{
+	return evaluateImageTiles(
+		img,
+		img.rows(),
+		img.cols(),
+		model,
+		NeighborhoodPlan(inputMask, outputMask, img.rows()),
+		inputMask.rows(),
+		inputMask.cols(),
+		preconditioner);
+}
+
+
+
+double CMT::evaluateImage(
+	const vector<ArrayXXd>& img,
+	const ConditionalDistribution& model,
+	const vector<ArrayXXb>& inputMask,
+	const vector<ArrayXXb>& outputMask,
+	const Preconditioner* preconditioner)
+{
+	int numChannels = img.size();
+
+	if(!numChannels)
+		throw Exception("Image should have at least one channel.");
+
+	if(inputMask.size() != numChannels || outputMask.size() != numChannels)
+		throw Exception("Image and masks need to have the same number of channels.");
+
+	for(int m = 0; m < numChannels; ++m)
+		if(img[m].cols() != img[0].cols() || img[m].rows() != img[0].rows())
+			throw Exception("All image channels should be of the same size.");
+
+	return evaluateImageTiles(
+		img,
+		img[0].rows(),
+		img[0].cols(),
+		model,
+		NeighborhoodPlan(inputMask, outputMask, img[0].rows()),
+		inputMask[0].rows(),
+		inputMask[0].cols(),
+		preconditioner);
+}
+
+
+
+/**
+ * Integer division rounding towards negative infinity.
+ */
+static int floorDiv(int x, int y) {
+	return x / y - (x % y < 0);
+}
+
+
+
+/**
+ * Groups the output blocks visited by a raster scan into wavefronts. Blocks on the same wavefront
+ * don't read each other's outputs and can be sampled at the same time. Sampling the wavefronts in
+ * order reads and writes pixels in the same order as the raster scan.
+ *
+ * Block (a, b) is placed on wavefront a * slope + b, where the slope is the smallest value which
+ * keeps every block behind the blocks whose output it reads and ahead of the blocks which will
+ * overwrite its input.
+ *
+ * @param inputIndices locations of input pixels of each channel
+ * @param iMin first row of output block within masks
+ * @param jMin first column of output block within masks
+ * @param h height of output block
+ * @param w width of output block
+ * @return for each wavefront the upper-left corners of its blocks in the image
+ */
+vector<Tuples> CMT::wavefronts(
+	const vector<Tuples>& inputIndices,
+	int iMin,
+	int jMin,
+	int h,
+	int w,
+	int numBlockRows,
+	int numBlockCols)
+{
+	if(numBlockRows < 1 || numBlockCols < 1)
+		return vector<Tuples>();
+
+	int slope = 0;
+
+	for(int m = 0; m < inputIndices.size(); ++m)
+		for(Tuples::const_iterator it = inputIndices[m].begin(); it != inputIndices[m].end(); ++it) {
+			// position of the block writing the input pixel relative to the reading block
+			int da = floorDiv(it->first - iMin, h);
+			int db = floorDiv(it->second - jMin, w);
+
+			if(da < 0)
+				// pixel has to be written before it is read
+				slope = max(slope, -floorDiv(-1 - db, -da));
+			else if(da > 0)
+				// pixel has to be read before it is overwritten
+				slope = max(slope, -floorDiv(db, da));
+		}
+
+	// a raster scan satisfies all constraints
+	slope = min(slope, numBlockCols);
+
+	vector<Tuples> blocks((numBlockRows - 1) * slope + numBlockCols);
+
+	for(int a = 0; a < numBlockRows; ++a)
+		for(int b = 0; b < numBlockCols; ++b)
+			blocks[a * slope + b].push_back(make_pair(a * h, b * w));
+
+	return blocks;
+}
+
+
+
+/**
+ * Generates an image by sampling output blocks in raster-scan order. Blocks on the same wavefront
+ * are sampled with a single call to the model.
+ */
 ArrayXXd CMT::sampleImage(
 	ArrayXXd img,
 	const ConditionalDistribution& model,
@@ -871,6 +950,40 @@ ArrayXXd CMT::sampleImage(
 	double minValue,
 	double maxValue)
 {
+	return sampleImages(
+		vector<ArrayXXd>(1, img),
+		model,
+		inputMask,
+		outputMask,
+		preconditioner,
+		minValue,
+		maxValue)[0];
+}
+
+
+
+/**
+ * Generates multiple images of the same size at once. The images are generated in lockstep, so
+ * that the model is applied to the corresponding blocks of all images in a single call.
+ */
+vector<ArrayXXd> CMT::sampleImages(
+	vector<ArrayXXd> imgs,
+	const ConditionalDistribution& model,
+	const ArrayXXb& inputMask,
+	const ArrayXXb& outputMask,
+	const Preconditioner* preconditioner,
+	double minValue,
+	double maxValue)
+{
+	int numImages = imgs.size();
+
+	if(!numImages)
+		return imgs;
+
+	for(int n = 1; n < numImages; ++n)
+		if(imgs[n].rows() != imgs[0].rows() || imgs[n].cols() != imgs[0].cols())
+			throw Exception("All images should be of the same size.");
+
 	if(inputMask.cols() != outputMask.cols() || inputMask.rows() != outputMask.rows())
 		throw Exception("Input and output masks should be of the same size.");
 
@@ -921,31 +1034,54 @@ ArrayXXd CMT::sampleImage(
 			throw Exception("Model and masks are incompatible.");
 	}
 
-	for(int i = 0; i + inputMask.rows() <= img.rows(); i += h)
-		for(int j = 0; j + inputMask.cols() <= img.cols(); j += w) {
-			// extract causal neighborhood
-			VectorXd input = extractFromImage(
-				img.block(i, j, inputMask.rows(), inputMask.cols()), inputIndices);
+	int numInputs = inputIndices.size();
 
-			VectorXd output;
+	vector<Tuples> blocks = wavefronts(
+		vector<Tuples>(1, inputIndices), iMin, jMin, h, w,
+		imgs[0].rows() < inputMask.rows() ? 0 : (imgs[0].rows() - inputMask.rows()) / h + 1,
+		imgs[0].cols() < inputMask.cols() ? 0 : (imgs[0].cols() - inputMask.cols()) / w + 1);
 
-			// sample output
-			if(preconditioner) {
-				input = preconditioner->operator()(input);
-				output = preconditioner->inverse(input, model.sample(input)).second;
-			} else {
-				output = model.sample(input);
-			}
+	NeighborhoodPlan plan(inputMask, outputMask, imgs[0].rows());
 
-			output = output.cwiseMin(maxValue);
-			output = output.cwiseMax(minValue);
+	for(int t = 0; t < blocks.size(); ++t) {
+		// each column corresponds to one block of one image
+		int numBlocks = blocks[t].size() * numImages;
 
-			// replace pixels in image by output
-			for(int k = 0; k < outputIndices.size(); ++k)
-				img(i + outputIndices[k].first, j + outputIndices[k].second) = output[k];
+		MatrixXd input(numInputs, numBlocks);
+
+		// extract causal neighborhoods
+		#pragma omp parallel for if(numBlocks > 256)
+		for(int l = 0; l < numBlocks; ++l) {
+			int i = blocks[t][l / numImages].first;
+			int j = blocks[t][l / numImages].second;
+
+			plan.gather(imgs[l % numImages], i, j, input.col(l).data(), 0);
 		}
 
-	return img;
+		MatrixXd output;
+
+		// sample outputs
+		if(preconditioner) {
+			input = preconditioner->operator()(input);
+			output = preconditioner->inverse(input, model.sample(input)).second;
+		} else {
+			output = model.sample(input);
+		}
+
+		output = output.cwiseMin(maxValue);
+		output = output.cwiseMax(minValue);
+
+		// replace pixels in image by outputs
+		#pragma omp parallel for if(numBlocks > 256)
+		for(int l = 0; l < numBlocks; ++l) {
+			int i = blocks[t][l / numImages].first;
+			int j = blocks[t][l / numImages].second;
+
+			plan.scatter(imgs[l % numImages], i, j, output.col(l).data());
+		}
+	}
+
+	return imgs;
 }
 
 
@@ -962,6 +1098,10 @@ vector<ArrayXXd> CMT::sampleImage(
 	if(!img.size())
 		throw Exception("Image should have at least one channel.");
 
+	for(int m = 0; m < img.size(); ++m)
+		if(img[m].cols() != img[0].cols() || img[m].rows() != img[0].rows())
+			throw Exception("All image channels should be of the same size.");
+
 	if(inputMask.cols() != outputMask.cols() || inputMask.rows() != outputMask.rows())
 		throw Exception("Input and output masks should be of the same size.");
 
@@ -1027,40 +1167,46 @@ vector<ArrayXXd> CMT::sampleImage(
 			throw Exception("Model and masks are incompatible.");
 	}
 
-	for(int i = 0; i + inputMask.rows() <= img[0].rows(); i += h)
-		for(int j = 0; j + inputMask.cols() <= img[0].cols(); j += w) {
-			VectorXd input(numInputs * numChannels);
+	vector<Tuples> blocks = wavefronts(
+		vector<Tuples>(1, inputIndices), iMin, jMin, h, w,
+		img[0].rows() < inputMask.rows() ? 0 : (img[0].rows() - inputMask.rows()) / h + 1,
+		img[0].cols() < inputMask.cols() ? 0 : (img[0].cols() - inputMask.cols()) / w + 1);
 
-			// extract causal neighborhood
-			#pragma omp parallel for
-			for(int m = 0; m < numChannels; ++m)
-				input.segment(m * numInputs, numInputs) = extractFromImage(
-					img[m].block(i, j, inputMask.rows(), inputMask.cols()), inputIndices);
+	NeighborhoodPlan plan(inputMask, outputMask, img[0].rows(), numChannels);
 
-			// sample output
-			VectorXd output;
-			
-			if(preconditioner) {
-				input = preconditioner->operator()(input);
-				output = model.sample(input);
-				output = preconditioner->inverse(input, output).second;
-			} else {
-				output = model.sample(input);
-			}
+	for(int t = 0; t < blocks.size(); ++t) {
+		int numBlocks = blocks[t].size();
 
-			// bound outputs
-			for(int k = 0; k < numOutputs; ++k) {
-				output[k] = min(maxValues[k], output[k]);
-				output[k] = max(minValues[k], output[k]);
-			}
+		MatrixXd input(numInputs * numChannels, numBlocks);
+
+		// extract causal neighborhoods
+		#pragma omp parallel for if(numBlocks > 256)
+		for(int l = 0; l < numBlocks; ++l)
+			plan.gather(img, blocks[t][l].first, blocks[t][l].second, input.col(l).data(), 0);
+
+		// sample outputs
+		MatrixXd output;
+
+		if(preconditioner) {
+			input = preconditioner->operator()(input);
+			output = model.sample(input);
+			output = preconditioner->inverse(input, output).second;
+		} else {
+			output = model.sample(input);
+		}
 
-			// replace pixels in image by output
-			#pragma omp parallel for
-			for(int m = 0; m < numChannels; ++m)
-				for(int k = 0; k < outputIndices.size(); ++k)
-					img[m](i + outputIndices[k].first, j + outputIndices[k].second) = output[m * numOutputs + k];
+		// bound outputs
+		for(int k = 0; k < numOutputs; ++k) {
+			output.row(k) = output.row(k).cwiseMin(maxValues[k]);
+			output.row(k) = output.row(k).cwiseMax(minValues[k]);
 		}
 
+		// replace pixels in image by outputs
+		#pragma omp parallel for if(numBlocks > 256)
+		for(int l = 0; l < numBlocks; ++l)
+			plan.scatter(img, blocks[t][l].first, blocks[t][l].second, output.col(l).data());
+	}
+
 	return img;
 }
 
@@ -1159,46 +1305,114 @@ vector<ArrayXXd> CMT::sampleImage(
 			throw Exception("Model and masks are incompatible.");
 	}
 
-	for(int i = 0; i + inputMask[0].rows() <= img[0].rows(); i += h)
-		for(int j = 0; j + inputMask[0].cols() <= img[0].cols(); j += w) {
-			VectorXd input(numInputs);
+	vector<Tuples> blocks = wavefronts(
+		inputIndices, iMin, jMin, h, w,
+		img[0].rows() < inputMask[0].rows() ? 0 : (img[0].rows() - inputMask[0].rows()) / h + 1,
+		img[0].cols() < inputMask[0].cols() ? 0 : (img[0].cols() - inputMask[0].cols()) / w + 1);
 
-			// extract causal neighborhood
-			for(int m = 0, offset = 0; m < numChannels; ++m) {
-				input.segment(offset, inputIndices[m].size()) = extractFromImage(
-					img[m].block(i, j, inputMask[m].rows(), inputMask[m].cols()), inputIndices[m]);
-				offset += inputIndices[m].size();
-			}
+	NeighborhoodPlan plan(inputMask, outputMask, img[0].rows());
 
-			// sample output
-			VectorXd output;
+	for(int t = 0; t < blocks.size(); ++t) {
+		int numBlocks = blocks[t].size();
 
-			if(preconditioner) {
-				input = preconditioner->operator()(input);
-				output = preconditioner->inverse(input, model.sample(input)).second;
-			} else {
-				output = model.sample(input);
-			}
+		MatrixXd input(numInputs, numBlocks);
 
-			// bound outputs
-			for(int k = 0; k < numOutputs; ++k) {
-				output[k] = min(maxValues[k], output[k]);
-				output[k] = max(minValues[k], output[k]);
-			}
+		// extract causal neighborhoods
+		#pragma omp parallel for if(numBlocks > 256)
+		for(int l = 0; l < numBlocks; ++l)
+			plan.gather(img, blocks[t][l].first, blocks[t][l].second, input.col(l).data(), 0);
 
-			// replace pixels in image by model's output
-			for(int m = 0, offset = 0; m < numChannels; ++m) {
-				for(int k = 0; k < outputIndices[m].size(); ++k)
-					img[m](i + outputIndices[m][k].first, j + outputIndices[m][k].second) = output[offset + k];
-				offset += outputIndices[m].size();
-			}
+		// sample outputs
+		MatrixXd output;
+
+		if(preconditioner) {
+			input = preconditioner->operator()(input);
+			output = preconditioner->inverse(input, model.sample(input)).second;
+		} else {
+			output = model.sample(input);
+		}
+
+		// bound outputs
+		for(int k = 0; k < numOutputs; ++k) {
+			output.row(k) = output.row(k).cwiseMin(maxValues[k]);
+			output.row(k) = output.row(k).cwiseMax(minValues[k]);
 		}
 
+		// replace pixels in image by model's outputs
+		#pragma omp parallel for if(numBlocks > 256)
+		for(int l = 0; l < numBlocks; ++l)
+			plan.scatter(img, blocks[t][l].first, blocks[t][l].second, output.col(l).data());
+	}
+
 	return img;
 }
 
 
 
+/**
+ * Greedily partitions sites into groups such that no two sites of a group differ by one of the
+ * given offsets. If the offsets describe which sites interact, the sites of a group can be
+ * updated concurrently.
+ *
+ * @param sites locations of sites
+ * @param offsets symmetric set of offsets between interacting sites
+ * @return list of groups of sites
+ */
+static vector<Tuples> colorSites(const Tuples& sites, const Tuples& offsets) {
+	vector<Tuples> groups;
+	map<Tuple, int> colors;
+
+	for(Tuples::const_iterator site = sites.begin(); site != sites.end(); ++site) {
+		set<int> used;
+
+		// colors of interacting sites which have already been assigned
+		for(Tuples::const_iterator offset = offsets.begin(); offset != offsets.end(); ++offset) {
+			map<Tuple, int>::iterator it = colors.find(
+				make_pair(site->first + offset->first, site->second + offset->second));
+			if(it != colors.end())
+				used.insert(it->second);
+		}
+
+		int color = 0;
+		while(used.count(color))
+			++color;
+
+		if(color == groups.size())
+			groups.push_back(Tuples());
+
+		groups[color].push_back(*site);
+		colors[*site] = color;
+	}
+
+	return groups;
+}
+
+
+
+/**
+ * Computes all nonzero differences between locations.
+ */
+static Tuples differences(const Tuples& locations) {
+	set<Tuple> offsets;
+
+	for(int k = 0; k < locations.size(); ++k)
+		for(int l = 0; l < locations.size(); ++l)
+			if(locations[k] != locations[l])
+				offsets.insert(make_pair(
+					locations[k].first - locations[l].first,
+					locations[k].second - locations[l].second));
+
+	return Tuples(offsets.begin(), offsets.end());
+}
+
+
+
+/**
+ * Samples output blocks of an image conditioned on labels with Metropolis-within-Gibbs. Blocks
+ * whose updates don't affect the same neighborhoods are updated in parallel. If the image is to
+ * be initialized, the first sweep instead samples all blocks in raster order and accepts every
+ * proposal.
+ */
 ArrayXXd CMT::sampleImageConditionally(
 	ArrayXXd img,
 	ArrayXXi labels,
@@ -1261,6 +1475,8 @@ ArrayXXd CMT::sampleImageConditionally(
 	}
 
 	// extract causal neighborhoods and corresponding output regions
+	NeighborhoodPlan plan(inputMask, outputMask, img.rows());
+
 	vector<vector<VectorXd> > inputs;
 	vector<vector<VectorXd> > outputs;
 	vector<vector<double> > logLik;
@@ -1285,9 +1501,9 @@ ArrayXXd CMT::sampleImageConditionally(
  				continue;
  			}
 
-			ArrayXXd patch = img.block(i, j, inputMask.rows(), inputMask.cols());
-			inputs[i].push_back(extractFromImage(patch, inputIndices));
-			outputs[i].push_back(extractFromImage(patch, outputIndices));
+			inputs[i].push_back(VectorXd(plan.dimIn()));
+			outputs[i].push_back(VectorXd(plan.dimOut()));
+			plan.gather(img, i, j, inputs[i][j].data(), outputs[i][j].data());
 
 			Array<int, 1, Dynamic> label(1);
 			label[0] = labels(i / h, j / w);
@@ -1330,29 +1546,64 @@ ArrayXXd CMT::sampleImageConditionally(
 
 			Tuples::iterator it = find(inputIndices.begin(), inputIndices.end(), make_pair(i, j));
 
-			if(it != inputIndices.end())
+			if(it != inputIndices.end()) {
 				idxIn[k].push_back(distance(inputIndices.begin(), it));
 				idxOut[k].push_back(l);
+			}
 		}
 	}
 
-	for(int iter = 0; iter < numIter; ++iter)
-		// walk through image from top left to bottom right
-		for(int i = 0; i + inputMask.rows() <= img.rows(); i += h)
-			for(int j = 0; j + inputMask.cols() <= img.cols(); j += w) {
+	// blocks interact if their updates touch the same neighborhood
+	Tuples affected = offsets;
+	affected.push_back(make_pair(0, 0));
+
+	Tuples blocks;
+
+	for(int i = 0; i + inputMask.rows() <= img.rows(); i += h)
+		for(int j = 0; j + inputMask.cols() <= img.cols(); j += w)
+			blocks.push_back(make_pair(i, j));
+
+	vector<Tuples> groups = colorSites(blocks, differences(affected));
+
+	// initialization visits blocks one at a time in raster order, so that each block is sampled
+	// given the blocks sampled before it
+	vector<Tuples> raster;
+
+	for(int b = 0; b < blocks.size(); ++b)
+		raster.push_back(Tuples(1, blocks[b]));
+
+	for(int iter = 0; iter < numIter; ++iter) {
+		const vector<Tuples>& sweep = iter == 0 && initialize ? raster : groups;
+
+		for(int g = 0; g < sweep.size(); ++g) {
+			vector<VectorXd> proposals(sweep[g].size());
+			vector<double> logUniform(sweep[g].size());
+
+			// random numbers are drawn serially, as the generators are not thread-safe
+			for(int b = 0; b < sweep[g].size(); ++b) {
+				int i = sweep[g][b].first;
+				int j = sweep[g][b].second;
+
 				Array<int, 1, Dynamic> label(1);
 				label[0] = labels(i / h, j / w);
 
-				// propose output
-				VectorXd output;
-
 				if(preconditioner) {
 					VectorXd input = preconditioner->operator()(inputs[i][j]);
-					output = preconditioner->inverse(input, model.sample(input, label)).second;
+					proposals[b] = preconditioner->inverse(input, model.sample(input, label)).second;
 				} else {
-					output = model.sample(inputs[i][j], label);
+					proposals[b] = model.sample(inputs[i][j], label);
 				}
 
+				logUniform[b] = log(rand() / static_cast<double>(RAND_MAX));
+			}
+
+			#pragma omp parallel for schedule(dynamic) if(sweep[g].size() > 1)
+			for(int b = 0; b < sweep[g].size(); ++b) {
+				int i = sweep[g][b].first;
+				int j = sweep[g][b].second;
+
+				const VectorXd& output = proposals[b];
+
 				vector<VectorXd> inputsUpdated;
 				vector<double> logLikUpdated;
 				vector<double> logPrbUpdated;
@@ -1364,7 +1615,7 @@ ArrayXXd CMT::sampleImageConditionally(
 					int m = i + offsets[k].first;
 					int n = j + offsets[k].second;
 
-					if(m >= inputs.size() || n >= inputs[m].size()) {
+					if(m < 0 || n < 0 || m >= inputs.size() || n >= inputs[m].size()) {
 						inputsUpdated.push_back(VectorXd());
 						logLikUpdated.push_back(0.);
 						logPrbUpdated.push_back(0.);
@@ -1398,7 +1649,7 @@ ArrayXXd CMT::sampleImageConditionally(
 				}
 
 				// accept/reject proposed output
-				if((iter == 0 && initialize) || log(rand() / static_cast<double>(RAND_MAX)) < logAlpha) {
+				if((iter == 0 && initialize) || logUniform[b] < logAlpha) {
 					// update inputs and outputs
 					outputs[i][j] = output;
 
@@ -1406,7 +1657,7 @@ ArrayXXd CMT::sampleImageConditionally(
 						int m = i + offsets[k].first;
 						int n = j + offsets[k].second;
 
-						if(m >= inputs.size() || n >= inputs[m].size())
+						if(m < 0 || n < 0 || m >= inputs.size() || n >= inputs[m].size())
 							continue;
 
 						inputs[m][n] = inputsUpdated[k];
@@ -1415,6 +1666,8 @@ ArrayXXd CMT::sampleImageConditionally(
 					}
 				}
 			}
+		}
+	}
 
 	// replace pixels by sampled pixels
 	for(int i = 0; i + inputMask.rows() <= img.rows(); i += h)
@@ -1490,12 +1743,14 @@ ArrayXXi CMT::sampleLabelsConditionally(
 
 	labels.setConstant(-1);
 
+	NeighborhoodPlan plan(inputMask, outputMask, img.rows());
+
+	ArrayXd input(plan.dimIn());
+	ArrayXd output(plan.dimOut());
+
 	for(int i = 0; i + inputMask.rows() <= img.rows(); i += h) {
 		for(int j = 0; j + inputMask.cols() <= img.cols(); j += w) {
-			ArrayXXd patch = img.block(i, j, inputMask.rows(), inputMask.cols());
-
-			ArrayXd input  = extractFromImage(patch, inputIndices);
-			ArrayXd output = extractFromImage(patch, outputIndices);
+			plan.gather(img, i, j, input.data(), output.data());
 
 			if(preconditioner) {
 				pair<ArrayXXd, ArrayXXd> data = preconditioner->operator()(input, output);
@@ -1524,6 +1779,10 @@ vector<ArrayXXd> CMT::sampleVideo(
 	if(inputMask.size() != outputMask.size())
 		throw Exception("Masks need to have the same number of frames.");
 
+	for(int f = 0; f < video.size(); ++f)
+		if(video[f].cols() != video[0].cols() || video[f].rows() != video[0].rows())
+			throw Exception("All video frames should be of the same size.");
+
 	vector<Tuples> inputIndices;
 	vector<Tuples> outputIndices;
 
@@ -1543,8 +1802,6 @@ vector<ArrayXXd> CMT::sampleVideo(
 			throw Exception("Input and output masks should be of the same size.");
 		if(inputMask[m].cols() != inputMask[0].cols() || inputMask[m].rows() != outputMask[0].rows())
 			throw Exception("Input and output masks should be of the same size.");
-		if(video[m].cols() != video[0].cols() || video[m].rows() != video[0].cols())
-			throw Exception("All video frames should be of the same size.");
 
 		inputIndices.push_back(Tuples());
 		outputIndices.push_back(Tuples());
@@ -1595,17 +1852,15 @@ vector<ArrayXXd> CMT::sampleVideo(
 			throw Exception("Model and masks are incompatible.");
 	}
 
+	NeighborhoodPlan plan(inputMask, outputMask, video[0].rows());
+
 	for(int f = 0; f + inputMask.size() <= video.size(); f += l)
 		for(int i = 0; i + inputMask[0].rows() <= video[0].rows(); i += h)
 			for(int j = 0; j + inputMask[0].cols() <= video[0].cols(); j += w) {
 				VectorXd input(numInputs);
 
 				// extract causal neighborhood
-				for(int m = 0, offset = 0; m < inputMask.size(); ++m) {
-					input.segment(offset, inputIndices[m].size()) = extractFromImage(
-						video[f + m].block(i, j, inputMask[m].rows(), inputMask[m].cols()), inputIndices[m]);
-					offset += inputIndices[m].size();
-				}
+				plan.gather(video, i, j, input.data(), 0, f);
 
 				// sample output
 				VectorXd output;
@@ -1618,11 +1873,7 @@ vector<ArrayXXd> CMT::sampleVideo(
 				}
 
 				// replace pixels in video by model's output
-				for(int m = 0, offset = 0; m < inputMask.size(); ++m) {
-					for(int k = 0; k < outputIndices[m].size(); ++k)
-						video[f + m](i + outputIndices[m][k].first, j + outputIndices[m][k].second) = output[offset + k];
-					offset += outputIndices[m].size();
-				}
+				plan.scatter(video, i, j, output.data(), f);
 			}
 
 	return video;
@@ -1630,48 +1881,62 @@ vector<ArrayXXd> CMT::sampleVideo(
 
 
 
-inline double computeEnergy(
-	const ArrayXXd& img,
+/**
+ * Computes the energy, i.e. the negative log-likelihood of all patches affected by a single
+ * pixel, for several values of that pixel at once.
+ *
+ * @param inputs inputs of all patches containing the pixel
+ * @param outputs outputs of all patches containing the pixel
+ * @param locations row of the pixel in the inputs of each patch, or -1 if it is the output
+ * @param values values of the pixel for which to compute the energy
+ */
+static ArrayXd computeEnergies(
 	const ConditionalDistribution& model,
-	const ArrayXXb& inputMask,
-	const ArrayXXb& outputMask,
-	const Tuples& inputIndices,
-	const Tuples& outputIndices,
 	const Preconditioner* preconditioner,
-	int i,
-	int j,
-	const Tuples& offsets)
+	const MatrixXd& inputs,
+	const MatrixXd& outputs,
+	const vector<int>& locations,
+	const ArrayXd& values)
 {
-	double energy = 0.;
+	int numPatches = locations.size();
+	int numValues = values.size();
 
-	for(Tuples::const_iterator offset = offsets.begin(); offset != offsets.end(); ++offset) {
-		if(i + offset->first < 0 || j + offset->second < 0 || i + offset->first + inputMask.rows() >= img.rows() || j + offset->second + inputMask.cols() >= img.cols()) {
-			std::cout << i << ", " << j << ", " << offset->first << ", " << offset->second << std::endl;
-		}
+	MatrixXd inputsAll = inputs.replicate(1, numValues);
+	MatrixXd outputsAll = outputs.replicate(1, numValues);
 
-		// extract inputs and outputs from image
-		ArrayXXd patch = img.block(
-			i + offset->first,
-			j + offset->second,
-			inputMask.rows(),
-			inputMask.cols());
-		VectorXd input = extractFromImage(patch, inputIndices);
-		VectorXd output = extractFromImage(patch, outputIndices);
+	for(int k = 0; k < numValues; ++k)
+		for(int l = 0; l < numPatches; ++l)
+			if(locations[l] < 0)
+				outputsAll(0, k * numPatches + l) = values[k];
+			else
+				inputsAll(locations[l], k * numPatches + l) = values[k];
 
-		// update energy
-		if(preconditioner) {
-			pair<ArrayXXd, ArrayXXd> data = preconditioner->operator()(input, output);
-			energy -= model.logLikelihood(data.first, data.second)[0] + preconditioner->logJacobian(input, output)[0];
-		} else {
-			energy -= model.logLikelihood(input, output)[0];
-		}
-	}
+	// evaluate all patches for all values in a single call
+	Array<double, 1, Dynamic> logLik;
+
+	if(preconditioner)
+		logLik = model.logLikelihood(inputsAll, outputsAll, *preconditioner);
+	else
+		logLik = model.logLikelihood(inputsAll, outputsAll);
 
-	return energy;
+	ArrayXd energies(numValues);
+
+	for(int k = 0; k < numValues; ++k)
+		energies[k] = -logLik.segment(k * numPatches, numPatches).sum();
+
+	return energies;
 }
 
 
 
+/**
+ * Replaces pixels by samples from their conditional distribution given all other pixels. Each
+ * pixel is updated using multiple-try Metropolis, so that all proposals of an update are
+ * evaluated by the model at once. Pixels which are not part of any patch fitting into the image
+ * are left untouched.
+ *
+ * @param numSteps number of proposals per pixel and iteration
+ */
 ArrayXXd CMT::fillInImage(
 	ArrayXXd img,
 	const ConditionalDistribution& model,
@@ -1685,6 +1950,9 @@ ArrayXXd CMT::fillInImage(
 	if(fillInMask.rows() != img.rows() || fillInMask.cols() != img.cols())
 		throw Exception("Image and mask size incompatible.");
 
+	if(numSteps < 1)
+		throw Exception("Number of steps should be positive.");
+
 	Tuples fillInIndices = maskToIndices(fillInMask);
 	pair<Tuples, Tuples> inOutIndices = masksToIndices(inputMask, outputMask);
 	Tuples& inputIndices = inOutIndices.first;
@@ -1694,56 +1962,87 @@ ArrayXXd CMT::fillInImage(
 	if(outputIndices.size() != 1)
 		throw Exception("Only one-pixel output masks are currently supported.");
 
-	// TODO: remove pixels from fillInIndices which cannot be predicted
+	// compute offsets of patches containing a pixel and location of pixel in patch
+	vector<int> locations;
 
-	// compute offsets
 	offsets.push_back(make_pair(-outputIndices[0].first, -outputIndices[0].second));
-	for(int i = 0; i < inputIndices.size(); ++i)
+	locations.push_back(-1);
+
+	for(int i = 0; i < inputIndices.size(); ++i) {
 		offsets.push_back(make_pair(-inputIndices[i].first, -inputIndices[i].second));
+		locations.push_back(i);
+	}
+
+	NeighborhoodPlan plan(inputMask, outputMask, img.rows());
+
+	// pixels which don't share a patch can be updated at the same time
+	vector<Tuples> groups = colorSites(fillInIndices, differences(offsets));
 
 	for(int i = 0; i < numIterations; ++i)
-		for(Tuples::iterator iter = fillInIndices.begin(); iter != fillInIndices.end(); ++iter) {
-			// sample from cauchy distribution
-			ArrayXd noise = sampleNormal(numSteps) / 4.;
-			ArrayXd uni = ArrayXd::Random(numSteps).abs();
-
-			double valueOld = img(iter->first, iter->second);
-			double energyOld = computeEnergy(
-				img, 
-				model, 
-				inputMask, outputMask,
-				inputIndices, outputIndices,
-				preconditioner,
-				iter->first, iter->second,
-				offsets);
-
-			int counter = 0;
-
-			for(int j = 0; j < numSteps; ++j) {
-				// proposal sample
-				img(iter->first, iter->second) = valueOld + noise[j];
-
-				double energyNew = computeEnergy(
-					img, 
-					model, 
-					inputMask, outputMask,
-					inputIndices, outputIndices,
-					preconditioner,
-					iter->first, iter->second,
-					offsets);
-
-				if(uni[j] >= exp(energyOld - energyNew)) {
-					// reject proposed step
-					img(iter->first, iter->second) = valueOld;
-				} else {
-					// accept proposed step
-					valueOld = img(iter->first, iter->second);
-					energyOld = energyNew;
-					++counter;
+		for(int g = 0; g < groups.size(); ++g) {
+			// random numbers are drawn serially, as the generators are not thread-safe
+			ArrayXXd noise = sampleNormal(numSteps, groups[g].size()) / 4.;
+			ArrayXXd noiseRef = sampleNormal(numSteps, groups[g].size()) / 4.;
+			ArrayXXd uniform = ArrayXXd::Random(2, groups[g].size()).abs();
+
+			#pragma omp parallel for schedule(dynamic) if(groups[g].size() > 1)
+			for(int p = 0; p < groups[g].size(); ++p) {
+				Tuples::const_iterator iter = groups[g].begin() + p;
+
+				// gather all patches containing the pixel which fit into the image
+				Tuples patches;
+				vector<int> patchLocations;
+
+				for(int l = 0; l < offsets.size(); ++l) {
+					int m = iter->first + offsets[l].first;
+					int n = iter->second + offsets[l].second;
+
+					if(m >= 0 && n >= 0 && m + inputMask.rows() <= img.rows() && n + inputMask.cols() <= img.cols()) {
+						patches.push_back(make_pair(m, n));
+						patchLocations.push_back(locations[l]);
+					}
 				}
-			}
 
-			std::cout << "acceptance rate: " << static_cast<double>(counter) / numSteps << std::endl;
+				// pixel is not modeled
+				if(patches.empty())
+					continue;
+
+				MatrixXd inputs(inputIndices.size(), patches.size());
+				MatrixXd outputs(1, patches.size());
+
+				for(int l = 0; l < patches.size(); ++l)
+					plan.gather(img, patches[l].first, patches[l].second,
+						inputs.col(l).data(), outputs.col(l).data());
+
+				double valueOld = img(iter->first, iter->second);
+
+				// evaluate proposals
+				ArrayXd proposals = valueOld + noise.col(p);
+				ArrayXd energies = computeEnergies(
+					model, preconditioner, inputs, outputs, patchLocations, proposals);
+
+				// select one of the proposals according to its probability
+				ArrayXd weights = (energies.minCoeff() - energies).exp();
+				double urand = uniform(0, p) * weights.sum();
+				double cdf = weights[0];
+				int k = 0;
+
+				while(cdf < urand && k < numSteps - 1)
+					cdf += weights[++k];
+
+				// reference points for the reverse move
+				ArrayXd references = proposals[k] + noiseRef.col(p);
+				references[numSteps - 1] = valueOld;
+
+				ArrayXd energiesRef = computeEnergies(
+					model, preconditioner, inputs, outputs, patchLocations, references);
+
+				// accept proposal with probability given by ratio of total weights
+				double logAlpha = logSumExp(-energies)[0] - logSumExp(-energiesRef)[0];
+
+				if(log(uniform(1, p)) < logAlpha)
+					img(iter->first, iter->second) = proposals[k];
+			}
 		}
 
 	return img;
@@ -1755,10 +2054,8 @@ struct BFGSInstance {
 	const Tuples* positions;
 	const ConditionalDistribution* model;
 	ArrayXXd* img;
-	const Tuples* inputIndices;
-	const Tuples* outputIndices;
+	const NeighborhoodPlan* plan;
 	const Tuples* block;
-	const ArrayXXb* inputMask;
 	const Preconditioner* preconditioner;
 };
 
@@ -1773,41 +2070,28 @@ lbfgsfloatval_t fillInImageMAPGradient(
 {
 	const Tuples& positions = *static_cast<BFGSInstance*>(instance)->positions;
 	const ConditionalDistribution& model = *static_cast<BFGSInstance*>(instance)->model;
-	const Tuples& inputIndices = *static_cast<BFGSInstance*>(instance)->inputIndices;
-	const Tuples& outputIndices = *static_cast<BFGSInstance*>(instance)->outputIndices;
+	const NeighborhoodPlan& plan = *static_cast<BFGSInstance*>(instance)->plan;
 	const Tuples& block = *static_cast<BFGSInstance*>(instance)->block;
 	ArrayXXd& img = *static_cast<BFGSInstance*>(instance)->img;
-	const ArrayXXb& inputMask = *static_cast<BFGSInstance*>(instance)->inputMask;
 	const Preconditioner* preconditioner = static_cast<BFGSInstance*>(instance)->preconditioner;
 
 	// extract relevant inputs and outputs from image
-	ArrayXXd inputs(inputIndices.size(), positions.size());
-	ArrayXXd outputs(outputIndices.size(), positions.size());
+	MatrixXd inputs(plan.dimIn(), positions.size());
+	MatrixXd outputs(plan.dimOut(), positions.size());
 
 	// load current state of pixels into image
 	for(int i = 0; i < block.size(); ++i)
 		img(block[i].first, block[i].second) = x[i];
 
-	for(int i = 0; i < positions.size(); ++i) {
-		ArrayXXd patch = img.block(
-			positions[i].first,
-			positions[i].second,
-			inputMask.rows(),
-			inputMask.cols());
-		inputs.col(i) = extractFromImage(patch, inputIndices);
-		outputs.col(i) = extractFromImage(patch, outputIndices);
-	}
+	for(int i = 0; i < positions.size(); ++i)
+		plan.gather(img, positions[i].first, positions[i].second,
+			inputs.col(i).data(), outputs.col(i).data());
 
 	// compute gradients
 	pair<pair<ArrayXXd, ArrayXXd>, Array<double, 1, Dynamic> > results;
 	
 	if(preconditioner) {
-		pair<ArrayXXd, ArrayXXd> data = preconditioner->operator()(inputs, outputs);
-		results = model.computeDataGradient(data.first, data.second);
-
-		// adjust gradient and likelihood to take transformation into account
-		results.first = preconditioner->adjustGradient(results.first.first, results.first.second);
-		results.second += preconditioner->logJacobian(inputs, outputs);
+		results = model.computeDataGradient(inputs, outputs, *preconditioner);
 	} else {
 		results = model.computeDataGradient(inputs, outputs);
 	}
@@ -1819,19 +2103,9 @@ lbfgsfloatval_t fillInImageMAPGradient(
 	// combine gradients
 	ArrayXXd gradient = ArrayXXd::Zero(img.rows(), img.cols());
 
-	for(int i = 0; i < positions.size(); ++i) {
-		Block<ArrayXXd> patch = gradient.block(
-			positions[i].first,
-			positions[i].second,
-			inputMask.rows(),
-			inputMask.cols());
-
-		for(int j = 0; j < inputIndices.size(); ++j)
-			patch(inputIndices[j].first, inputIndices[j].second) += inputGradient(j, i);
-
-		for(int j = 0; j < outputIndices.size(); ++j)
-			patch(outputIndices[j].first, outputIndices[j].second) += outputGradient(j, i);
-	}
+	for(int i = 0; i < positions.size(); ++i)
+		plan.accumulate(gradient, positions[i].first, positions[i].second,
+			inputGradient.col(i).data(), outputGradient.col(i).data());
 
 	// store relevant part of gradient
 	if(g) {
@@ -1844,6 +2118,11 @@ lbfgsfloatval_t fillInImageMAPGradient(
 
 
 
+/**
+ * Finds the MAP estimate of missing pixels by alternately optimizing blocks of pixels. Blocks
+ * whose pixels don't appear in the same neighborhoods are optimized in parallel, each on its own
+ * copy of the image region it depends on.
+ */
 ArrayXXd CMT::fillInImageMAP(
 	ArrayXXd img,
 	const ConditionalDistribution& model,
@@ -1856,6 +2135,8 @@ ArrayXXd CMT::fillInImageMAP(
 {
 	if(fillInMask.rows() != img.rows() || fillInMask.cols() != img.cols())
 		throw Exception("Image and mask size incompatible.");
+	if(patchSize < 1)
+		throw Exception("Patch size should be positive.");
 
 	pair<Tuples, Tuples> inOutIndices = masksToIndices(inputMask, outputMask);
 	Tuples& inputIndices = inOutIndices.first;
@@ -1865,79 +2146,161 @@ ArrayXXd CMT::fillInImageMAP(
 	if(outputIndices.size() != 1)
 		throw Exception("Only one-pixel output masks are currently supported.");
 
-	// TODO: remove pixels from fillInIndices which cannot be predicted (or extend image)
+	// precompute relative positions of neighborhoods which depend on a pixel
+	Tuples offsets;
+	offsets.push_back(make_pair(-outputIndices[0].first, -outputIndices[0].second));
+	for(int i = 0; i < inputIndices.size(); ++i)
+		offsets.push_back(make_pair(-inputIndices[i].first, -inputIndices[i].second));
 
-	// divide unobserved pixels into blocks
+	// divide unobserved pixels into blocks, including blocks at the bottom and right border
+	Tuples blockIndices;
 	vector<Tuples> blocks;
+	vector<Tuples> positions;
+	Tuples origins;
+	Tuples regionSizes;
 
-	// TODO: add missing blocks
-	for(int i = 0; i < img.rows() - patchSize; i += patchSize) {
-		for(int j = 0; j < img.cols() - patchSize; j += patchSize) {
-			Tuples indices = maskToIndices(fillInMask.block(i, j, patchSize, patchSize));
+	for(int i = 0; i < img.rows(); i += patchSize) {
+		for(int j = 0; j < img.cols(); j += patchSize) {
+			Tuples block = maskToIndices(fillInMask.block(i, j,
+				min(patchSize, static_cast<int>(img.rows()) - i),
+				min(patchSize, static_cast<int>(img.cols()) - j)));
 
-			if(indices.size()) {
-				for(Tuples::iterator it = indices.begin(); it != indices.end(); ++it) {
-					it->first += i;
-					it->second += j;
+			if(block.empty())
+				continue;
+
+			// neighborhoods which depend on the block and lie within the image
+			set<Tuple> uniquePositions;
+			for(int k = 0; k < block.size(); ++k)
+				for(int l = 0; l < offsets.size(); ++l) {
+					int m = i + block[k].first + offsets[l].first;
+					int n = j + block[k].second + offsets[l].second;
+
+					if(m >= 0 && n >= 0
+						&& m + inputMask.rows() <= img.rows()
+						&& n + inputMask.cols() <= img.cols())
+						uniquePositions.insert(make_pair(m, n));
 				}
-				blocks.push_back(indices);
+
+			// pixels which cannot be predicted are left untouched
+			if(uniquePositions.empty())
+				continue;
+
+			Tuples blockPositions(uniquePositions.begin(), uniquePositions.end());
+
+			// bounding box of all pixels the block's objective depends on
+			int rowMin = img.rows();
+			int colMin = img.cols();
+			int rowMax = 0;
+			int colMax = 0;
+
+			for(int k = 0; k < blockPositions.size(); ++k) {
+				rowMin = min(rowMin, blockPositions[k].first);
+				colMin = min(colMin, blockPositions[k].second);
+				rowMax = max(rowMax, blockPositions[k].first + static_cast<int>(inputMask.rows()));
+				colMax = max(colMax, blockPositions[k].second + static_cast<int>(inputMask.cols()));
+			}
+
+			// make locations relative to the region
+			for(int k = 0; k < block.size(); ++k) {
+				block[k].first += i - rowMin;
+				block[k].second += j - colMin;
+			}
+
+			for(int k = 0; k < blockPositions.size(); ++k) {
+				blockPositions[k].first -= rowMin;
+				blockPositions[k].second -= colMin;
 			}
+
+			blockIndices.push_back(make_pair(i / patchSize, j / patchSize));
+			blocks.push_back(block);
+			positions.push_back(blockPositions);
+			origins.push_back(make_pair(rowMin, colMin));
+			regionSizes.push_back(make_pair(rowMax - rowMin, colMax - colMin));
 		}
 	}
 
-	Tuples fillInIndices = maskToIndices(fillInMask);
+	// blocks interact if a neighborhood contains pixels of both blocks
+	int rowRange = (inputMask.rows() + patchSize - 2) / patchSize;
+	int colRange = (inputMask.cols() + patchSize - 2) / patchSize;
 
-	// precompute relative positions of neighborhoods which depend on a pixel
-	Tuples offsets;
-	offsets.push_back(make_pair(-outputIndices[0].first, -outputIndices[0].second));
-	for(int i = 0; i < inputIndices.size(); ++i)
-		offsets.push_back(make_pair(-inputIndices[i].first, -inputIndices[i].second));
+	Tuples blockOffsets;
+	for(int i = -rowRange; i <= rowRange; ++i)
+		for(int j = -colRange; j <= colRange; ++j)
+			if(i || j)
+				blockOffsets.push_back(make_pair(i, j));
+
+	// assign each block its index so that groups can refer to blocks
+	map<Tuple, int> blockLookup;
+	for(int k = 0; k < blockIndices.size(); ++k)
+		blockLookup[blockIndices[k]] = k;
+
+	vector<Tuples> groups = colorSites(blockIndices, blockOffsets);
+
+	// optimization hyperparameters
+	lbfgs_parameter_t params;
+	lbfgs_parameter_init(&params);
+	params.max_iterations = 50;
+	params.m = 6;
+	params.epsilon = 1e-5;
+	params.linesearch = LBFGS_LINESEARCH_MORETHUENTE;
+	params.max_linesearch = 100;
+	params.ftol = 1e-4;
+	params.xtol = 1e-32;
+
+	string errorMessage;
 
 	for(int i = 0; i < numIterations; ++i)
-		// alternately optimize each block of pixels
-		for(int j = 0; j < blocks.size(); ++j) {
-			Tuples& block = blocks[j];
+		// alternately optimize each group of blocks
+		for(int g = 0; g < groups.size(); ++g) {
+			vector<ArrayXXd> regions(groups[g].size());
+
+			// copy regions before any block of the group changes the image
+			#pragma omp parallel for if(groups[g].size() > 1)
+			for(int b = 0; b < groups[g].size(); ++b) {
+				int k = blockLookup.find(groups[g][b])->second;
+				regions[b] = img.block(
+					origins[k].first,
+					origins[k].second,
+					regionSizes[k].first,
+					regionSizes[k].second);
+			}
 
-			// compute relevant neighborhood positions
-			set<Tuple> uniquePositions;
-			for(int k = 0; k < block.size(); ++k)
-				for(int l = 0; l < offsets.size(); ++l)
-					uniquePositions.insert(make_pair(
-						block[k].first + offsets[l].first,
-						block[k].second + offsets[l].second));
+			#pragma omp parallel for schedule(dynamic) if(groups[g].size() > 1)
+			for(int b = 0; b < groups[g].size(); ++b) {
+				int k = blockLookup.find(groups[g][b])->second;
+				Tuples& block = blocks[k];
+				ArrayXXd& region = regions[b];
 
-			// turn set into vector
-			Tuples positions(uniquePositions.begin(), uniquePositions.end());
+				// copy pixels into array
+				lbfgsfloatval_t* x = lbfgs_malloc(block.size());
 
-			// copy pixels into array
-			lbfgsfloatval_t* x = lbfgs_malloc(block.size());
+				for(int l = 0; l < block.size(); ++l)
+					x[l] = region(block[l].first, block[l].second);
 
-			for(int k = 0; k < block.size(); ++k)
-				x[k] = img(block[k].first, block[k].second);
-
-			// summarize variables needed to compute gradient
-			BFGSInstance instance = {
-				&positions, &model, &img, &inputIndices, &outputIndices, &block, &inputMask, preconditioner };
-
-			// optimization hyperparameters
-			lbfgs_parameter_t params;
-			lbfgs_parameter_init(&params);
-			params.max_iterations = 50;
-			params.m = 6;
-			params.epsilon = 1e-5;
-			params.linesearch = LBFGS_LINESEARCH_MORETHUENTE;
-			params.max_linesearch = 100;
-			params.ftol = 1e-4;
-			params.xtol = 1e-32;
-
-			// start optimization
-			lbfgs(block.size(), x, 0, &fillInImageMAPGradient, 0, &instance, &params);
-
-			// copy pixels back
-			for(int k = 0; k < block.size(); ++k)
-				img(block[k].first, block[k].second) = x[k];
+				// neighborhoods are extracted from the region instead of the image
+				NeighborhoodPlan plan(inputMask, outputMask, region.rows());
+
+				// summarize variables needed to compute gradient
+				BFGSInstance instance = {
+					&positions[k], &model, &region, &plan, &block, preconditioner };
+
+				// exceptions may not leave parallel regions
+				try {
+					lbfgs(block.size(), x, 0, &fillInImageMAPGradient, 0, &instance, &params);
+				} catch(Exception& exception) {
+					#pragma omp critical (fillInImageMAP)
+					errorMessage = exception.message();
+				}
+
+				// copy pixels back
+				for(int l = 0; l < block.size(); ++l)
+					img(origins[k].first + block[l].first, origins[k].second + block[l].second) = x[l];
 
-			lbfgs_free(x);
+				lbfgs_free(x);
+			}
+
+			if(!errorMessage.empty())
+				throw Exception(errorMessage.c_str());
 		}
 
 	return img;
@@ -1946,29 +2309,26 @@ ArrayXXd CMT::fillInImageMAP(
 
 
 ArrayXXd CMT::extractWindows(const ArrayXXd& timeSeries, int windowLength) {
-	ArrayXXd windows(timeSeries.rows() * windowLength, timeSeries.cols() - windowLength + 1);
+	#ifdef EIGEN_DEFAULT_TO_ROW_MAJOR
+	if(windowLength < 1)
+		throw Exception("Window length should be positive.");
+	if(windowLength > timeSeries.cols())
+		throw Exception("Window length should not exceed the length of the time series.");
 
-	#ifndef EIGEN_DEFAULT_TO_ROW_MAJOR
-	const double* dataFrom = timeSeries.data();
-	double* dataTo = windows.data();
-	#endif
+	ArrayXXd windows(timeSeries.rows() * windowLength, timeSeries.cols() - windowLength + 1);
 
 	#pragma omp parallel for
-	for(int t = 0; t < windows.cols(); ++t) {
+	for(int t = 0; t < windows.cols(); ++t)
 		// read entries from time series in column-major order
-		#ifdef EIGEN_DEFAULT_TO_ROW_MAJOR
 		for(int j = 0, k = 0; j < windowLength; ++j)
 			for(int i = 0; i < timeSeries.rows(); ++i, ++k)
 				windows(k, t) = timeSeries(i, t + j);
-		#else
-		memcpy(
-			dataTo + t * windows.rows(),
-			dataFrom + t * timeSeries.rows(),
-			sizeof(double) * windows.rows());
-		#endif
-	}
 
 	return windows;
+	#else
+	// copy of the overlapping columns of the view
+	return windowView(timeSeries, windowLength);
+	#endif
 }
 
 
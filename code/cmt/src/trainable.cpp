@@ -15,10 +15,21 @@ using Eigen::MatrixXd;
 #include <limits>
 using std::numeric_limits;
 
+#include <algorithm>
+using std::min;
+using std::max;
+
+#include <vector>
+using std::vector;
+
 #ifdef _WIN32
 	#undef max
+	#undef min
 #endif
 
+// number of batches copied at once when training on windows of a time series
+#define WINDOW_CHUNK_BATCHES 16
+
 #include <cmath>
 using std::log;
 using std::pow;
@@ -104,6 +115,7 @@ CMT::Trainable::InstanceLBFGS::InstanceLBFGS(
 	params(params),
 	input(input),
 	output(output),
+	windows(0),
 	inputVal(0),
 	outputVal(0),
 	logLoss(numeric_limits<double>::max()),
@@ -126,6 +138,7 @@ CMT::Trainable::InstanceLBFGS::InstanceLBFGS(
 	params(params),
 	input(input),
 	output(output),
+	windows(0),
 	inputVal(inputVal),
 	outputVal(outputVal),
 	logLoss(numeric_limits<double>::max()),
@@ -137,6 +150,27 @@ CMT::Trainable::InstanceLBFGS::InstanceLBFGS(
 
 
 
+CMT::Trainable::InstanceLBFGS::InstanceLBFGS(
+	CMT::Trainable* cd,
+	const CMT::Trainable::Parameters* params,
+	const WindowView* windows,
+	const MatrixXd* output) :
+	cd(cd),
+	params(params),
+	input(0),
+	output(output),
+	windows(windows),
+	inputVal(0),
+	outputVal(0),
+	logLoss(numeric_limits<double>::max()),
+	counter(0),
+	parameters(0),
+	fx(numeric_limits<double>::max())
+{
+}
+
+
+
 CMT::Trainable::InstanceLBFGS::~InstanceLBFGS() {
 	if(parameters)
 		lbfgs_free(parameters);
@@ -144,11 +178,30 @@ CMT::Trainable::InstanceLBFGS::~InstanceLBFGS() {
 
 
 
+CMT::Trainable::Trainable() : mVersion(nextVersion()) {
+}
+
+
+
 CMT::Trainable::~Trainable() {
 }
 
 
 
+unsigned long CMT::Trainable::nextVersion() {
+	// versions are unique across all models so that assigned or copied models
+	// never share a version with a different set of parameters
+	static unsigned long counter = 0;
+	unsigned long version;
+
+	#pragma omp critical (nextVersion)
+	version = ++counter;
+
+	return version;
+}
+
+
+
 int CMT::Trainable::callbackLBFGS(
 	void* instance,
 	const lbfgsfloatval_t* x,
@@ -224,14 +277,65 @@ lbfgsfloatval_t CMT::Trainable::evaluateLBFGS(
 	const InstanceLBFGS& inst = *static_cast<InstanceLBFGS*>(instance);
 	const CMT::Trainable& cd = *inst.cd;
 	const CMT::Trainable::Parameters& params = *inst.params;
-	const MatrixXd& input = *inst.input;
 	const MatrixXd& output = *inst.output;
 
+	if(inst.windows)
+		return cd.parameterGradient(*inst.windows, output, x, g, params);
+
+	const MatrixXd& input = *inst.input;
+
 	return cd.parameterGradient(input, output, x, g, params);
 }
 
 
 
+/**
+ * Computes the same average as the other parameterGradient, but only ever copies a few batches
+ * of windows into memory. Regularization terms are averaged along with the data terms and
+ * therefore are counted exactly once.
+ */
+double CMT::Trainable::parameterGradient(
+	const WindowView& input,
+	const MatrixXd& output,
+	const lbfgsfloatval_t* x,
+	lbfgsfloatval_t* g,
+	const Parameters& params) const
+{
+	int numData = static_cast<int>(input.cols());
+	int numParams = numParameters(params);
+
+	// large enough for models to process several batches in parallel
+	int chunkSize = min(max(params.batchSize, 10) * WINDOW_CHUNK_BATCHES, numData);
+
+	vector<lbfgsfloatval_t> gChunk(g ? numParams : 0);
+
+	if(g)
+		for(int i = 0; i < numParams; ++i)
+			g[i] = 0.;
+
+	double value = 0.;
+
+	for(int c = 0; c < numData; c += chunkSize) {
+		int width = min(chunkSize, numData - c);
+		double weight = static_cast<double>(width) / numData;
+
+		value += weight * parameterGradient(
+			input.middleCols(c, width),
+			output.middleCols(c, width),
+			x,
+			g ? &gChunk[0] : 0,
+			params);
+
+		if(g)
+			for(int i = 0; i < numParams; ++i)
+				g[i] += weight * gChunk[i];
+	}
+
+	return value;
+}
+
+
+
 MatrixXd CMT::Trainable::fisherInformation( 
 	const MatrixXd& input,
 	const MatrixXd& output,
@@ -348,6 +452,45 @@ bool CMT::Trainable::train(
 	if(numParameters(params) < 1)
 		return true;
 
+	// wrap all additional arguments to optimization routine
+	InstanceLBFGS instance(this, &params, &input, &output, inputVal, outputVal);
+
+	return optimize(instance, params);
+}
+
+
+
+/**
+ * Trains the model on all windows of a time series without storing them all at once.
+ */
+bool CMT::Trainable::train(
+	const WindowView& input,
+	const MatrixXd& output,
+	const Parameters& params)
+{
+	if(input.rows() != dimIn() || output.rows() != dimOut())
+		throw Exception("Data has wrong dimensionality.");
+
+	if(input.cols() != output.cols())
+		throw Exception("The number of inputs and outputs should be the same.");
+
+	if(input.cols() < 1)
+		return true;
+
+	if(numParameters(params) < 1)
+		return true;
+
+	InstanceLBFGS instance(this, &params, &input, &output);
+
+	return optimize(instance, params);
+}
+
+
+
+bool CMT::Trainable::optimize(InstanceLBFGS& instance, const Parameters& params) {
+	const MatrixXd* inputVal = instance.inputVal;
+	const MatrixXd* outputVal = instance.outputVal;
+
 	// create copy of model parameters for L-BFGS
 	lbfgsfloatval_t* x = parameters(params);
 
@@ -361,9 +504,6 @@ bool CMT::Trainable::train(
 	hyperparams.max_linesearch = 100;
 	hyperparams.ftol = 1e-4;
 
-	// wrap all additional arguments to optimization routine
-	InstanceLBFGS instance(this, &params, &input, &output, inputVal, outputVal);
-
 	if(params.verbosity > 0) {
 		if(inputVal && outputVal) {
 			cout << setw(6) << 0;
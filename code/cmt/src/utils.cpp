@@ -7,6 +7,7 @@ using Eigen::Array;
 using Eigen::ArrayXXd;
 using Eigen::ArrayXXi;
 using Eigen::MatrixXd;
+using Eigen::VectorXd;
 using Eigen::VectorXi;
 
 #include "Eigen/SVD"
@@ -14,6 +15,12 @@ using Eigen::JacobiSVD;
 using Eigen::ComputeThinU;
 using Eigen::ComputeThinV;
 
+#include "Eigen/QR"
+using Eigen::HouseholderQR;
+
+#include "Eigen/Eigenvalues"
+using Eigen::SelfAdjointEigenSolver;
+
 #include <cmath>
 using std::exp;
 using std::log;
@@ -21,6 +28,7 @@ using std::floor;
 using std::tanh;
 using std::sinh;
 using std::cosh;
+using std::abs;
 #ifdef __GXX_EXPERIMENTAL_CXX0X__
 using std::lgamma;
 using std::tgamma;
@@ -29,13 +37,21 @@ using std::tgamma;
 #include <cstdlib>
 using std::rand;
 
+#include <vector>
+using std::vector;
+
 #include <set>
 using std::set;
 using std::pair;
+using std::make_pair;
 
 #include <algorithm>
 using std::greater;
 using std::sort;
+using std::unique;
+using std::random_shuffle;
+using std::max;
+using std::min;
 
 #include <limits>
 using std::numeric_limits;
@@ -152,12 +168,66 @@ Array<double, 1, Dynamic> CMT::logMeanExp(const ArrayXXd& array) {
 
 
 
+/**
+ * Sums values using Kahan-Babuska (Neumaier) summation to reduce rounding errors.
+ */
+double CMT::compensatedSum(const vector<double>& values) {
+	double sum = 0.;
+	double c = 0.;
+
+	for(int i = 0; i < values.size(); ++i) {
+		double t = sum + values[i];
+
+		if(abs(sum) >= abs(values[i]))
+			c += (sum - t) + values[i];
+		else
+			c += (values[i] - t) + sum;
+
+		sum = t;
+	}
+
+	return sum + c;
+}
+
+
+
+/**
+ * Number of data points processed at once when streaming over a data set. Small data sets are
+ * processed in one go, larger data sets are split into enough tiles to keep all threads busy.
+ */
+int CMT::streamingTileSize(int numData) {
+	return max(256, min(4096, numData / 64));
+}
+
+
+
+static mt19937& normalGenerator() {
+	static mt19937 gen(rand());
+	return gen;
+}
+
+
+
+/**
+ * Seeds all random number generators, including the one used for normal samples.
+ */
+void CMT::seed(unsigned int seed) {
+	srand(seed);
+
+	#pragma omp critical (sampleNormal)
+	normalGenerator().seed(rand());
+}
+
+
+
 ArrayXXd CMT::sampleNormal(int m, int n) {
- 	static mt19937 gen(rand());
+	mt19937& gen = normalGenerator();
 
 	normal_distribution<double> normal;
 	ArrayXXd samples(m, n);
 
+	// the generator is shared between threads
+	#pragma omp critical (sampleNormal)
 	for(int i = 0; i < samples.size(); ++i)
 		samples(i) = normal(gen);
 
@@ -263,29 +333,65 @@ ArrayXXi CMT::sampleBinomial(const ArrayXXi& n, const ArrayXXd& p) {
 
 
 set<int> CMT::randomSelect(int k, int n) {
+	vector<long> indices = randomSample(k, n);
+	return set<int>(indices.begin(), indices.end());
+}
+
+
+
+/**
+ * Uniformly samples an integer between 0 and n - 1, where n may exceed RAND_MAX.
+ */
+static inline long randomIndex(long n) {
+	if(n <= RAND_MAX)
+		return rand() % n;
+	return (static_cast<unsigned long>(rand()) * (RAND_MAX + 1ul) + rand()) % n;
+}
+
+
+
+/**
+ * Selects k distinct integers between 0 and n - 1 uniformly at random and returns them in random
+ * order.
+ *
+ * If k is a sizable fraction of n, Floyd's algorithm is used together with a bitmap marking
+ * selected integers. Otherwise, integers are drawn with replacement and duplicates are replaced
+ * by new draws, so that memory requirements only depend on k.
+ */
+vector<long> CMT::randomSample(int k, long n) {
 	if(k > n)
 		throw Exception("k must be smaller than n.");
 	if(k < 0 || n < 0)
 		throw Exception("n and k must be non-negative.");
 
-	// TODO: a hash map could be more efficient
-	set<int> indices;
+	vector<long> indices;
+	indices.reserve(k);
 
-	if(k <= n / 2) {
-		for(int i = 0; i < k; ++i)
-			while(indices.insert(rand() % n).second != true) {
-				// repeat until insertion successful
-			}
+	if(n / 32 <= k) {
+		vector<bool> selected(n, false);
+
+		for(long j = n - k; j < n; ++j) {
+			long t = randomIndex(j + 1);
+
+			if(selected[t])
+				t = j;
+
+			selected[t] = true;
+			indices.push_back(t);
+		}
 	} else {
-		// fill set with all indices
-		for(int i = 0; i < n; ++i)
-			indices.insert(i);
-		for(int i = 0; i < n - k; ++i)
-			while(!indices.erase(rand() % n)) {
-				// repeat until deletion successful
-			}
+		while(indices.size() < k) {
+			while(indices.size() < k)
+				indices.push_back(randomIndex(n));
+
+			// remove duplicates
+			sort(indices.begin(), indices.end());
+			indices.erase(unique(indices.begin(), indices.end()), indices.end());
+		}
 	}
 
+	random_shuffle(indices.begin(), indices.end());
+
 	return indices;
 }
 
@@ -330,6 +436,199 @@ MatrixXd CMT::covariance(const MatrixXd& input, const MatrixXd& output) {
 
 
 
+CMT::Moments::Moments(int dimIn, int dimOut) :
+	mDimIn(dimIn),
+	mDimOut(dimOut),
+	mNumData(0.),
+	mMean(VectorXd::Zero(dimIn + dimOut)),
+	mScatter(MatrixXd::Zero(dimIn + dimOut, dimIn + dimOut))
+{
+	if(mDimIn < 0 || mDimOut < 0)
+		throw Exception("Dimensionalities have to be non-negative.");
+}
+
+
+
+void CMT::Moments::update(const MatrixXd& data) {
+	if(data.rows() != mDimIn + mDimOut)
+		throw Exception("Data has wrong dimensionality.");
+
+	// inputs and outputs are stacked, so tiles need no splitting into rows
+	updateTiled(data, MatrixXd(0, data.cols()));
+}
+
+
+
+void CMT::Moments::update(const ArrayXXd& data) {
+	if(data.rows() != mDimIn + mDimOut)
+		throw Exception("Data has wrong dimensionality.");
+	updateTiled(data, ArrayXXd(0, data.cols()));
+}
+
+
+
+void CMT::Moments::update(const MatrixXd& input, const MatrixXd& output) {
+	if(input.rows() != mDimIn || output.rows() != mDimOut)
+		throw Exception("Data has wrong dimensionality.");
+	if(mDimIn && mDimOut && input.cols() != output.cols())
+		throw Exception("Number of inputs and outputs must be the same.");
+	updateTiled(input, output);
+}
+
+
+
+void CMT::Moments::update(const ArrayXXd& input, const ArrayXXd& output) {
+	if(input.rows() != mDimIn || output.rows() != mDimOut)
+		throw Exception("Data has wrong dimensionality.");
+	if(mDimIn && mDimOut && input.cols() != output.cols())
+		throw Exception("Number of inputs and outputs must be the same.");
+	updateTiled(input, output);
+}
+
+
+
+void CMT::Moments::update(const Moments& moments) {
+	if(moments.mDimIn != mDimIn || moments.mDimOut != mDimOut)
+		throw Exception("Moments have different dimensionalities.");
+	merge(moments.mNumData, moments.mMean, moments.mScatter);
+}
+
+
+
+template <class ArrayType>
+void CMT::Moments::updateTiled(const ArrayType& input, const ArrayType& output) {
+	int dimIn = input.rows();
+	int dimOut = output.rows();
+	int numData = dimIn ? input.cols() : output.cols();
+	int numCols = streamingTileSize(numData);
+	int numTiles = (numData + numCols - 1) / numCols;
+	int numBlocks = min(numTiles, 64);
+
+	if(!numData)
+		return;
+
+	vector<double> blockNumData(numBlocks, 0.);
+	vector<VectorXd> blockMeans(numBlocks);
+	vector<MatrixXd> blockScatters(numBlocks);
+
+	// accumulate contiguous blocks of tiles in parallel
+	#pragma omp parallel for
+	for(int b = 0; b < numBlocks; ++b) {
+		Moments moments(dimIn, dimOut);
+
+		for(int t = b * numTiles / numBlocks; t < (b + 1) * numTiles / numBlocks; ++t) {
+			int j = t * numCols;
+			int n = min(numCols, numData - j);
+
+			VectorXd mean(dimIn + dimOut);
+			MatrixXd scatter(dimIn + dimOut, dimIn + dimOut);
+			MatrixXd inputCentered;
+			MatrixXd outputCentered;
+
+			// two-pass estimates within a tile
+			if(dimIn) {
+				mean.head(dimIn) = input.middleCols(j, n).matrix().rowwise().mean();
+				inputCentered = input.middleCols(j, n).matrix().colwise() - mean.head(dimIn);
+				scatter.topLeftCorner(dimIn, dimIn) = inputCentered * inputCentered.transpose();
+			}
+
+			if(dimOut) {
+				mean.tail(dimOut) = output.middleCols(j, n).matrix().rowwise().mean();
+				outputCentered = output.middleCols(j, n).matrix().colwise() - mean.tail(dimOut);
+				scatter.bottomRightCorner(dimOut, dimOut) = outputCentered * outputCentered.transpose();
+			}
+
+			if(dimIn && dimOut) {
+				scatter.bottomLeftCorner(dimOut, dimIn) = outputCentered * inputCentered.transpose();
+				scatter.topRightCorner(dimIn, dimOut) = scatter.bottomLeftCorner(dimOut, dimIn).transpose();
+			}
+
+			moments.merge(n, mean, scatter);
+		}
+
+		blockNumData[b] = moments.mNumData;
+		blockMeans[b] = moments.mMean;
+		blockScatters[b] = moments.mScatter;
+	}
+
+	// combine blocks pairwise
+	for(int step = 1; step < numBlocks; step *= 2)
+		#pragma omp parallel for
+		for(int b = 0; b < numBlocks - step; b += 2 * step) {
+			Moments moments(dimIn, dimOut);
+			moments.merge(blockNumData[b], blockMeans[b], blockScatters[b]);
+			moments.merge(blockNumData[b + step], blockMeans[b + step], blockScatters[b + step]);
+
+			blockNumData[b] = moments.mNumData;
+			blockMeans[b] = moments.mMean;
+			blockScatters[b] = moments.mScatter;
+		}
+
+	merge(blockNumData[0], blockMeans[0], blockScatters[0]);
+}
+
+
+
+/**
+ * Combines statistics of two sets of data points (Chan et al., 1979).
+ */
+void CMT::Moments::merge(double numData, const VectorXd& mean, const MatrixXd& scatter) {
+	if(numData <= 0.)
+		return;
+
+	if(mNumData <= 0.) {
+		mNumData = numData;
+		mMean = mean;
+		mScatter = scatter;
+		return;
+	}
+
+	double numDataTotal = mNumData + numData;
+	VectorXd delta = mean - mMean;
+
+	mMean += delta * (numData / numDataTotal);
+	mScatter += scatter + delta * delta.transpose() * (mNumData * numData / numDataTotal);
+	mNumData = numDataTotal;
+}
+
+
+
+VectorXd CMT::Moments::meanIn() const {
+	return mMean.head(mDimIn);
+}
+
+
+
+VectorXd CMT::Moments::meanOut() const {
+	return mMean.tail(mDimOut);
+}
+
+
+
+MatrixXd CMT::Moments::covXX() const {
+	return mScatter.topLeftCorner(mDimIn, mDimIn) / mNumData;
+}
+
+
+
+MatrixXd CMT::Moments::covYX() const {
+	return mScatter.bottomLeftCorner(mDimOut, mDimIn) / mNumData;
+}
+
+
+
+MatrixXd CMT::Moments::covYY() const {
+	return mScatter.bottomRightCorner(mDimOut, mDimOut) / mNumData;
+}
+
+
+
+MatrixXd CMT::Moments::covariance() const {
+	return mScatter / mNumData;
+}
+
+
+
 MatrixXd CMT::corrCoef(const MatrixXd& data) {
 	MatrixXd C = covariance(data);
 	VectorXd c = C.diagonal();
@@ -361,6 +660,52 @@ MatrixXd CMT::pInverse(const MatrixXd& matrix) {
 
 
 
+/**
+ * Computes the largest eigenvalues and corresponding eigenvectors of a symmetric positive
+ * semidefinite matrix using a randomized range finder followed by subspace iteration
+ * (Halko et al., 2011). Eigenvalues are returned in increasing order.
+ */
+pair<VectorXd, MatrixXd> CMT::randomizedEigen(
+	const MatrixXd& matrix,
+	int numEigen,
+	int numIter,
+	int oversampling)
+{
+	if(matrix.rows() != matrix.cols())
+		throw Exception("Matrix has to be square.");
+	if(numEigen < 0 || numEigen > matrix.rows())
+		throw Exception("Invalid number of eigenvalues.");
+
+	int dim = matrix.rows();
+	int numCols = min(dim, numEigen + oversampling);
+
+	// orthonormal basis approximately spanning the range of the matrix
+	MatrixXd basis = HouseholderQR<MatrixXd>(matrix * sampleNormal(dim, numCols).matrix())
+		.householderQ() * MatrixXd::Identity(dim, numCols);
+
+	for(int i = 0; i < numIter; ++i)
+		basis = HouseholderQR<MatrixXd>(matrix * basis).householderQ()
+			* MatrixXd::Identity(dim, numCols);
+
+	// solve eigenvalue problem in the subspace
+	SelfAdjointEigenSolver<MatrixXd> eigenSolver(basis.transpose() * matrix * basis);
+
+	return make_pair(
+		eigenSolver.eigenvalues().tail(numEigen),
+		basis * eigenSolver.eigenvectors().rightCols(numEigen));
+}
+
+
+
+/**
+ * Randomized eigendecompositions pay off only if few eigenvectors of a large matrix are needed.
+ */
+bool CMT::preferRandomizedEigen(int numEigen, int dim) {
+	return dim >= 64 && 4 * (numEigen + 10) <= dim;
+}
+
+
+
 double CMT::logDetPD(const MatrixXd& matrix) {
 	return 2. * matrix.llt().matrixLLT().diagonal().array().log().sum();
 }
@@ -404,3 +749,26 @@ MatrixXd CMT::deleteCols(const MatrixXd& matrix, vector<int> indices) {
 
 	return result;
 }
+
+
+
+/**
+ * Represents all overlapping windows of a time series as columns of a matrix without copying
+ * the time series. The view is only valid as long as the time series exists.
+ */
+CMT::WindowView CMT::windowView(const ArrayXXd& timeSeries, int windowLength) {
+	#ifdef EIGEN_DEFAULT_TO_ROW_MAJOR
+	throw Exception("Window views require column-major storage.");
+	#endif
+
+	if(windowLength < 1)
+		throw Exception("Window length should be positive.");
+	if(windowLength > timeSeries.cols())
+		throw Exception("Window length should not exceed the length of the time series.");
+
+	return WindowView(
+		timeSeries.data(),
+		timeSeries.rows() * windowLength,
+		timeSeries.cols() - windowLength + 1,
+		Eigen::OuterStride<>(timeSeries.rows()));
+}
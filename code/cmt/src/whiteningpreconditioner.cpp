@@ -6,13 +6,25 @@
 using Eigen::SelfAdjointEigenSolver;
 
 CMT::WhiteningPreconditioner::WhiteningPreconditioner(const ArrayXXd& input, const ArrayXXd& output) {
-	if(input.rows() == 0) {
-		if(output.cols() < output.rows())
+	if(input.rows() > 0 && input.cols() != output.cols())
+		throw Exception("Number of inputs and outputs must be the same."); 
+
+	Moments moments(input.rows(), output.rows());
+	moments.update(input, output);
+
+	initialize(moments);
+}
+
+
+
+void CMT::WhiteningPreconditioner::initialize(const Moments& moments) {
+	if(moments.dimIn() == 0) {
+		if(moments.numData() < moments.dimOut())
 			throw Exception("Too few inputs to compute whitening transform."); 
 
-		mMeanOut = output.rowwise().mean();
+		mMeanOut = moments.meanOut();
 
-		MatrixXd cov = covariance(output);
+		MatrixXd cov = moments.covYY();
 
 		SelfAdjointEigenSolver<MatrixXd> eigenSolver;
 
@@ -24,23 +36,16 @@ CMT::WhiteningPreconditioner::WhiteningPreconditioner(const ArrayXXd& input, con
 		// log-Jacobian determinant
 		mLogJacobian = mPreOut.partialPivLu().matrixLU().diagonal().array().abs().log().sum();
 	} else {
-		if(input.cols() != output.cols())
-			throw Exception("Number of inputs and outputs must be the same."); 
-		if(input.cols() < input.rows())
+		if(moments.numData() < moments.dimIn())
 			throw Exception("Too few inputs to compute whitening transform."); 
 
-		mMeanIn = input.rowwise().mean();
-		mMeanOut = output.rowwise().mean();
-
-		// concatenate input and output
-		ArrayXXd data(input.rows() + output.rows(), input.cols());
-		data << input.matrix().colwise() - mMeanIn, output.matrix().colwise() - mMeanOut;
+		mMeanIn = moments.meanIn();
+		mMeanOut = moments.meanOut();
 
 		// compute covariances
-		MatrixXd cov = covariance(data);
-		MatrixXd covXX = cov.topLeftCorner(input.rows(), input.rows());
-		MatrixXd covYX = cov.bottomLeftCorner(output.rows(), input.rows());
-		MatrixXd covYY = cov.bottomRightCorner(output.rows(), output.rows());
+		MatrixXd covXX = moments.covXX();
+		MatrixXd covYX = moments.covYX();
+		MatrixXd covYY = moments.covYY();
 
 		SelfAdjointEigenSolver<MatrixXd> eigenSolver;
 
@@ -79,3 +84,12 @@ CMT::WhiteningPreconditioner::WhiteningPreconditioner(
 		meanIn, meanOut, preIn, preInInv, preOut, preOutInv, predictor)
 {
 }
+
+
+
+/**
+ * Computes the preconditioner from means and covariances accumulated over a stream of data.
+ */
+CMT::WhiteningPreconditioner::WhiteningPreconditioner(const Moments& moments) {
+	initialize(moments);
+}
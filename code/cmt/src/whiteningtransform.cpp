@@ -31,10 +31,13 @@ void CMT::WhiteningTransform::initialize(const ArrayXXd& input, int dimOut) {
 	if(input.cols() < input.rows())
 		throw Exception("Too few inputs to compute whitening transform."); 
 
-	mMeanIn = input.rowwise().mean();
+	Moments moments(input.rows());
+	moments.update(input);
+
+	mMeanIn = moments.meanIn();
 
 	// compute covariances
-	MatrixXd covXX = covariance(input);
+	MatrixXd covXX = moments.covXX();
 
 	// input whitening
 	SelfAdjointEigenSolver<MatrixXd> eigenSolver;
@@ -67,8 +67,8 @@ else:
 	include_dirs = []
 	library_dirs = []
 	libraries = ['gomp']
-	extra_compile_args = ['-std=c++0x', '-Wno-cpp', '-Wno-unused-local-typedefs', '-fopenmp']
-	extra_link_args = []
+	extra_compile_args = ['-std=c++0x', '-Wno-cpp', '-Wno-unused-local-typedefs', '-fopenmp', '-pthread']
+	extra_link_args = ['-pthread']
 
 
 modules = [
@@ -81,10 +81,12 @@ modules = [
 			'code/cmt/python/src/fvbninterface.cpp',
 			'code/cmt/python/src/glminterface.cpp',
 			'code/cmt/python/src/gsminterface.cpp',
+			'code/cmt/python/src/imagedataloaderinterface.cpp',
 			'code/cmt/python/src/mcbminterface.cpp',
 			'code/cmt/python/src/mcgsminterface.cpp',
 			'code/cmt/python/src/module.cpp',
 			'code/cmt/python/src/mixtureinterface.cpp',
+			'code/cmt/python/src/momentsinterface.cpp',
 			'code/cmt/python/src/mlrinterface.cpp',
 			'code/cmt/python/src/nonlinearitiesinterface.cpp',
 			'code/cmt/python/src/patchmodelinterface.cpp',
@@ -101,6 +103,8 @@ modules = [
 			'code/cmt/src/distribution.cpp',
 			'code/cmt/src/glm.cpp',
 			'code/cmt/src/gsm.cpp',
+			'code/cmt/src/imagecodec.cpp',
+			'code/cmt/src/imagedataloader.cpp',
 			'code/cmt/src/mcbm.cpp',
 			'code/cmt/src/mcgsm.cpp',
 			'code/cmt/src/mixture.cpp',